@@ -47,25 +47,38 @@
 #include "ACSimpleCodec.h"
 #include <string.h>
 
+#if defined(__linux__)
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+	#if defined(SYS_memfd_create)
+		#define AC_SIMPLE_CODEC_CAN_MIRROR	1
+	#endif
+#endif
+
 //=============================================================================
 //	ACSimpleCodec
 //=============================================================================
 
 static const UInt32 kBufferPad = 64; // this is used to prevent end from passing start.
 
-ACSimpleCodec::ACSimpleCodec(UInt32 inInputBufferByteSize)
+ACSimpleCodec::ACSimpleCodec(UInt32 inInputBufferByteSize, bool inUseMirroredInputBuffer)
 :
 	ACBaseCodec(),
 	mInputBuffer(NULL),
 	mInputBufferByteSize(inInputBufferByteSize+kBufferPad),
 	mInputBufferStart(0),
-	mInputBufferEnd(0)
+	mInputBufferEnd(0),
+	mUseMirroredInputBuffer(inUseMirroredInputBuffer),
+	mInputBufferIsMirrored(false),
+	mBorrowedInputData(NULL),
+	mBorrowedInputByteSize(0)
 {
 }
 
 ACSimpleCodec::~ACSimpleCodec()
 {
-	delete[] mInputBuffer;
+	DeallocateInputBuffer();
 }
 
 void	ACSimpleCodec::Initialize(const AudioStreamBasicDescription* inInputFormat, const AudioStreamBasicDescription* inOutputFormat, const void* inMagicCookie, UInt32 inMagicCookieByteSize)
@@ -78,12 +91,12 @@ void	ACSimpleCodec::Initialize(const AudioStreamBasicDescription* inInputFormat,
 void	ACSimpleCodec::Uninitialize()
 {
 	//	get rid of the buffer
-	delete[] mInputBuffer;
-	mInputBuffer = NULL;
+	DeallocateInputBuffer();
 	
 	//	reset the ring buffer state
 	mInputBufferStart = 0;
 	mInputBufferEnd = 0;
+	mPacketSizes.clear();
 	
 	ACBaseCodec::Uninitialize();
 }
@@ -98,6 +111,7 @@ void	ACSimpleCodec::Reset()
 	//	reset the ring buffer state
 	mInputBufferStart = 0;
 	mInputBufferEnd = 0;
+	mPacketSizes.clear();
 	
 	ACBaseCodec::Reset();
 }
@@ -111,8 +125,13 @@ UInt32	ACSimpleCodec::GetUsedInputBufferByteSize() const
 {
 	UInt32 theAnswer = 0;
 	
+	if(mBorrowedInputData != NULL)
+	{
+		//	the caller's data is standing in for the ring buffer
+		theAnswer = mBorrowedInputByteSize;
+	}
 	//	this object uses a ring buffer
-	if(mInputBufferStart <= mInputBufferEnd)
+	else if(mInputBufferStart <= mInputBufferEnd)
 	{
 		//	the active region is contiguous
 		theAnswer = mInputBufferEnd - mInputBufferStart;
@@ -129,7 +148,7 @@ UInt32	ACSimpleCodec::GetUsedInputBufferByteSize() const
 
 void	ACSimpleCodec::AppendInputData(const void* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets, const AudioStreamPacketDescription* inPacketDescription)
 {
-	//	this buffer handling code doesn't care about such things as the packet descriptions
+	//	the packet descriptions only matter for VBR input
 	if(!mIsInitialized) CODEC_THROW(kAudioCodecStateError);
 	
 	//	this is a ring buffer we're dealing with, so we need to set up a few things
@@ -140,6 +159,13 @@ void	ACSimpleCodec::AppendInputData(const void* inInputData, UInt32& ioInputData
 
 	const Byte* theInputData = static_cast<const Byte*>(inInputData);
 	
+	//	variable sized packets are queued up by their descriptions
+	if(mInputFormat.mBytesPerPacket == 0)
+	{
+		AppendInputPackets(theInputData, ioInputDataByteSize, ioNumberPackets, inPacketDescription, theAvailableByteSize);
+		return;
+	}
+	
 	// >>jamesmcc: added this because ioNumberPackets was not being updated if less was taken than given.
 	// THIS ASSUMES CBR!
 	UInt32 bytesPerPacketOfInput = mInputFormat.mBytesPerPacket;
@@ -159,14 +185,89 @@ void	ACSimpleCodec::AppendInputData(const void* inInputData, UInt32& ioInputData
 	}
 	// <<jamesmcc 
 	
+	CopyIntoInputBuffer(theInputData, ioInputDataByteSize);
+}
+
+void	ACSimpleCodec::AppendInputPackets(const Byte* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets, const AudioStreamPacketDescription* inPacketDescription, UInt32 inAvailableByteSize)
+{
+	UInt32 theMaxAvailableInputBytes = ioInputDataByteSize;
+	UInt32 theNumberPackets = 0;
+	UInt32 theUsedInputByteSize = 0;
+	
+	if(inPacketDescription != NULL)
+	{
+		//	take whole packets for as long as they fit
+		while(theNumberPackets < ioNumberPackets)
+		{
+			const AudioStreamPacketDescription& thePacket = inPacketDescription[theNumberPackets];
+			
+			//	stop at anything that doesn't pass a basic sanity check
+			if((thePacket.mDataByteSize == 0) || (thePacket.mStartOffset < 0) || (thePacket.mStartOffset + thePacket.mDataByteSize > theMaxAvailableInputBytes)) break;
+			UInt32 thePacketEnd = static_cast<UInt32>(thePacket.mStartOffset) + thePacket.mDataByteSize;
+
+			//	no partial packets
+			if(thePacket.mDataByteSize > inAvailableByteSize) break;
+			
+			CopyIntoInputBuffer(inInputData + thePacket.mStartOffset, thePacket.mDataByteSize);
+			mPacketSizes.push_back(thePacket.mDataByteSize);
+			inAvailableByteSize -= thePacket.mDataByteSize;
+			
+			if(thePacketEnd > theUsedInputByteSize)
+			{
+				theUsedInputByteSize = thePacketEnd;
+			}
+			++theNumberPackets;
+		}
+	}
+	else if((ioNumberPackets > 0) && (ioInputDataByteSize > 0) && (ioInputDataByteSize <= inAvailableByteSize))
+	{
+		//	without descriptions all we can do is take the data as one packet
+		CopyIntoInputBuffer(inInputData, ioInputDataByteSize);
+		mPacketSizes.push_back(ioInputDataByteSize);
+		theUsedInputByteSize = ioInputDataByteSize;
+		theNumberPackets = 1;
+	}
+	
+	ioNumberPackets = theNumberPackets;
+	ioInputDataByteSize = theUsedInputByteSize;
+}
+
+UInt32	ACSimpleCodec::GetQueuedPacketByteSize(UInt32 inPacketIndex) const
+{
+	if(inPacketIndex >= mPacketSizes.size()) CODEC_THROW(kAudioCodecUnspecifiedError);
+	
+	return mPacketSizes[inPacketIndex];
+}
+
+void	ACSimpleCodec::ConsumeInputPacket()
+{
+	if(mPacketSizes.empty()) CODEC_THROW(kAudioCodecUnspecifiedError);
+	
+	ConsumeInputData(mPacketSizes.front());
+}
+
+void	ACSimpleCodec::CopyIntoInputBuffer(const Byte* inInputData, UInt32 inInputDataByteSize)
+{
 	//	now we have to copy the data taking into account the wrap around and where the start is
-	if(mInputBufferEnd + ioInputDataByteSize < mInputBufferByteSize)
+	if(mInputBufferIsMirrored)
+	{
+		//	the copy can run straight on into the second mapping
+		memcpy(mInputBuffer + mInputBufferEnd, inInputData, inInputDataByteSize);
+		
+		//	adjust the end point
+		mInputBufferEnd += inInputDataByteSize;
+		if(mInputBufferEnd >= mInputBufferByteSize)
+		{
+			mInputBufferEnd -= mInputBufferByteSize;
+		}
+	}
+	else if(mInputBufferEnd + inInputDataByteSize < mInputBufferByteSize)
 	{
 		//	no wrap around here
-		memcpy(mInputBuffer + mInputBufferEnd, theInputData, ioInputDataByteSize);
+		memcpy(mInputBuffer + mInputBufferEnd, inInputData, inInputDataByteSize);
 		
 		//	adjust the end point
-		mInputBufferEnd += ioInputDataByteSize;
+		mInputBufferEnd += inInputDataByteSize;
 	}
 	else
 	{
@@ -174,16 +275,15 @@ void	ACSimpleCodec::AppendInputData(const void* inInputData, UInt32& ioInputData
 		
 		//	copy the first part
 		UInt32 theBeforeWrapByteSize = mInputBufferByteSize - mInputBufferEnd;
-		memcpy(mInputBuffer + mInputBufferEnd, theInputData, theBeforeWrapByteSize);
+		memcpy(mInputBuffer + mInputBufferEnd, inInputData, theBeforeWrapByteSize);
 		
 		//	and the rest
-		UInt32 theAfterWrapByteSize = ioInputDataByteSize - theBeforeWrapByteSize;
-		memcpy(mInputBuffer, theInputData + theBeforeWrapByteSize, theAfterWrapByteSize);
+		UInt32 theAfterWrapByteSize = inInputDataByteSize - theBeforeWrapByteSize;
+		memcpy(mInputBuffer, inInputData + theBeforeWrapByteSize, theAfterWrapByteSize);
 		
 		//	adjust the end point
 		mInputBufferEnd = theAfterWrapByteSize;
 	}
-	
 }
 
 void	ACSimpleCodec::ConsumeInputData(UInt32 inConsumedByteSize)
@@ -193,7 +293,44 @@ void	ACSimpleCodec::ConsumeInputData(UInt32 inConsumedByteSize)
 	
 	if(inConsumedByteSize > GetUsedInputBufferByteSize()) CODEC_THROW(kAudioCodecUnspecifiedError);
 	
-	if(inConsumedByteSize <= theContiguousRange)
+	//	keep the packet queue in step, the front packet may be left partly consumed
+	if(mBorrowedInputData == NULL)
+	{
+		UInt32 theByteSize = inConsumedByteSize;
+		while((theByteSize > 0) && !mPacketSizes.empty())
+		{
+			if(theByteSize < mPacketSizes.front())
+			{
+				mPacketSizes.front() -= theByteSize;
+				theByteSize = 0;
+			}
+			else
+			{
+				theByteSize -= mPacketSizes.front();
+				mPacketSizes.pop_front();
+			}
+		}
+	}
+	
+	if(mBorrowedInputData != NULL)
+	{
+		//	the caller's data is never cleared, just step over it
+		mBorrowedInputData += inConsumedByteSize;
+		mBorrowedInputByteSize -= inConsumedByteSize;
+	}
+	else if(mInputBufferIsMirrored)
+	{
+		//	clearing through the first mapping clears the second one too
+		memset(mInputBuffer + mInputBufferStart, 0, inConsumedByteSize);
+		
+		//	adjust the start
+		mInputBufferStart += inConsumedByteSize;
+		if(mInputBufferStart >= mInputBufferByteSize)
+		{
+			mInputBufferStart -= mInputBufferByteSize;
+		}
+	}
+	else if(inConsumedByteSize <= theContiguousRange)
 	{
 		//	the region to consume doesn't wrap
 		
@@ -233,6 +370,9 @@ Byte* ACSimpleCodec::GetBytes(UInt32& ioNumberBytes) const
 	//UInt32 theAvailableByteSize = GetInputBufferByteSize() - theUsedByteSize;
 	
 	if (ioNumberBytes > theUsedByteSize) ioNumberBytes = theUsedByteSize;
+	
+	//	borrowed data, and anything in a mirrored buffer, is always contiguous
+	if((mBorrowedInputData != NULL) || mInputBufferIsMirrored) return GetInputBufferStart();
 		
 	SInt32 leftOver = mInputBufferStart + ioNumberBytes - mInputBufferByteSize;
 	
@@ -247,21 +387,189 @@ Byte* ACSimpleCodec::GetBytes(UInt32& ioNumberBytes) const
 }
 
 
+UInt32	ACSimpleCodec::ProduceOutputPacketsDirect(const void* inInputData, UInt32& ioInputDataByteSize, void* outOutputData, UInt32& ioOutputDataByteSize, UInt32& ioNumberPackets, AudioStreamPacketDescription* outPacketDescription)
+{
+	if(!mIsInitialized) CODEC_THROW(kAudioCodecStateError);
+	
+	const Byte* theInputData = static_cast<const Byte*>(inInputData);
+	UInt32 theInputPacketByteSize = GetInputPacketByteSize();
+	UInt32 theUsedInputByteSize = 0;
+	Byte* theOutputData = static_cast<Byte*>(outOutputData);
+	UInt32 theProducedByteSize = 0;
+	UInt32 theNumberPacketsProduced = 0;
+	UInt32 theAnswer = kAudioCodecProduceOutputPacketNeedsMoreInputData;
+	
+	if(theInputPacketByteSize == 0) CODEC_THROW(kAudioCodecStateError);
+	
+	//	first finish off what's in the input buffer from last time
+	if(GetUsedInputBufferByteSize() > 0)
+	{
+		UInt32 theTopUpByteSize = (theInputPacketByteSize - (GetUsedInputBufferByteSize() % theInputPacketByteSize)) % theInputPacketByteSize;
+		if(theTopUpByteSize > ioInputDataByteSize)
+		{
+			theTopUpByteSize = ioInputDataByteSize;
+		}
+		AppendPartialPacket(theInputData, theTopUpByteSize);
+		theUsedInputByteSize += theTopUpByteSize;
+		
+		theProducedByteSize = ioOutputDataByteSize;
+		theNumberPacketsProduced = ioNumberPackets;
+		theAnswer = ProduceOutputPackets(theOutputData, theProducedByteSize, theNumberPacketsProduced, outPacketDescription);
+	}
+	
+	//	then the whole packets straight out of the caller's buffer, which can only
+	//	happen once the input buffer has been drained
+	UInt32 theWholePacketsByteSize = ((ioInputDataByteSize - theUsedInputByteSize) / theInputPacketByteSize) * theInputPacketByteSize;
+	bool theCanContinue = (theAnswer != kAudioCodecProduceOutputPacketFailure) && (theAnswer != kAudioCodecProduceOutputPacketAtEOF);
+	if(theCanContinue && (GetUsedInputBufferByteSize() == 0) && (theWholePacketsByteSize > 0) && (theNumberPacketsProduced < ioNumberPackets))
+	{
+		UInt32 theByteSize = ioOutputDataByteSize - theProducedByteSize;
+		UInt32 theNumberPackets = ioNumberPackets - theNumberPacketsProduced;
+		AudioStreamPacketDescription* thePacketDescription = (outPacketDescription != NULL) ? (outPacketDescription + theNumberPacketsProduced) : NULL;
+		
+		mBorrowedInputData = theInputData + theUsedInputByteSize;
+		mBorrowedInputByteSize = theWholePacketsByteSize;
+		try
+		{
+			theAnswer = ProduceOutputPackets(theOutputData + theProducedByteSize, theByteSize, theNumberPackets, thePacketDescription);
+		}
+		catch(...)
+		{
+			mBorrowedInputData = NULL;
+			mBorrowedInputByteSize = 0;
+			throw;
+		}
+		theUsedInputByteSize += theWholePacketsByteSize - mBorrowedInputByteSize;
+		mBorrowedInputData = NULL;
+		mBorrowedInputByteSize = 0;
+		
+		//	the packet descriptions are relative to where we pointed the codec
+		for(UInt32 thePacketIndex = 0; (thePacketDescription != NULL) && (thePacketIndex < theNumberPackets); ++thePacketIndex)
+		{
+			thePacketDescription[thePacketIndex].mStartOffset += theProducedByteSize;
+		}
+		
+		theProducedByteSize += theByteSize;
+		theNumberPacketsProduced += theNumberPackets;
+	}
+	
+	//	and hang on to a partial packet at the end for next time
+	if((GetUsedInputBufferByteSize() == 0) && ((ioInputDataByteSize - theUsedInputByteSize) < theInputPacketByteSize))
+	{
+		UInt32 theLeftOverByteSize = ioInputDataByteSize - theUsedInputByteSize;
+		AppendPartialPacket(theInputData + theUsedInputByteSize, theLeftOverByteSize);
+		theUsedInputByteSize += theLeftOverByteSize;
+	}
+	
+	//	a failure or the end of the stream stands, otherwise the answer depends on
+	//	whether the two calls between them satisfied the request
+	if((theAnswer != kAudioCodecProduceOutputPacketFailure) && (theAnswer != kAudioCodecProduceOutputPacketAtEOF))
+	{
+		if(theNumberPacketsProduced < ioNumberPackets)
+		{
+			theAnswer = kAudioCodecProduceOutputPacketNeedsMoreInputData;
+		}
+		else if(theAnswer == kAudioCodecProduceOutputPacketNeedsMoreInputData)
+		{
+			//	the last call ran out of input, but between them the request was satisfied
+			theAnswer = kAudioCodecProduceOutputPacketSuccess;
+		}
+	}
+	
+	ioInputDataByteSize = theUsedInputByteSize;
+	ioOutputDataByteSize = theProducedByteSize;
+	ioNumberPackets = theNumberPacketsProduced;
+	
+	return theAnswer;
+}
+
+void	ACSimpleCodec::AppendPartialPacket(const Byte* inInputData, UInt32& ioInputDataByteSize)
+{
+	//	AppendInputData only takes whole packets of the input format, which for a
+	//	decoder is an encoded packet, so a partial one goes in as raw bytes
+	UInt32 theAvailableByteSize = GetInputBufferByteSize() - GetUsedInputBufferByteSize();
+	if(ioInputDataByteSize > theAvailableByteSize)
+	{
+		ioInputDataByteSize = theAvailableByteSize;
+	}
+	CopyIntoInputBuffer(inInputData, ioInputDataByteSize);
+}
+
 void	ACSimpleCodec::ReallocateInputBuffer(UInt32 inInputBufferByteSize)
 {
-	mInputBufferByteSize = inInputBufferByteSize + kBufferPad;
+	//	toss the old buffer, a mirrored one has to be unmapped at its old size
+	DeallocateInputBuffer();
 	
-	//	toss the old buffer
-	delete[] mInputBuffer;
-	mInputBuffer = NULL;
+	mInputBufferByteSize = inInputBufferByteSize + kBufferPad;
 	
 	//	allocate the new one
-	// allocate extra in order to allow making contiguous data.
-	UInt32 allocSize = 2*inInputBufferByteSize + kBufferPad;
-	mInputBuffer = new Byte[allocSize];
-	memset(mInputBuffer, 0, allocSize);
+	if(!mUseMirroredInputBuffer || !AllocateMirroredInputBuffer())
+	{
+		// allocate extra in order to allow making contiguous data.
+		UInt32 allocSize = 2*inInputBufferByteSize + kBufferPad;
+		mInputBuffer = new Byte[allocSize];
+		memset(mInputBuffer, 0, allocSize);
+	}
 	
 	//	reset the ring buffer state
 	mInputBufferStart = 0;
 	mInputBufferEnd = 0;
+	mPacketSizes.clear();
+}
+
+bool	ACSimpleCodec::AllocateMirroredInputBuffer()
+{
+	bool theAnswer = false;
+	
+#if AC_SIMPLE_CODEC_CAN_MIRROR
+	//	the size has to be a whole number of pages for the mappings to line up,
+	//	which may make the buffer a little bigger than asked for
+	UInt32 thePageSize = static_cast<UInt32>(sysconf(_SC_PAGESIZE));
+	UInt32 theByteSize = ((mInputBufferByteSize + thePageSize - 1) / thePageSize) * thePageSize;
+	
+	int theFile = static_cast<int>(syscall(SYS_memfd_create, "ACSimpleCodec", 0));
+	if(theFile >= 0)
+	{
+		if(ftruncate(theFile, theByteSize) == 0)
+		{
+			//	reserve room for both copies, then map the file over each half
+			void* theAddress = mmap(NULL, 2 * theByteSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(theAddress != MAP_FAILED)
+			{
+				Byte* theBuffer = static_cast<Byte*>(theAddress);
+				if(	(mmap(theBuffer, theByteSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, theFile, 0) != MAP_FAILED) &&
+					(mmap(theBuffer + theByteSize, theByteSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, theFile, 0) != MAP_FAILED))
+				{
+					mInputBuffer = theBuffer;
+					mInputBufferByteSize = theByteSize;
+					mInputBufferIsMirrored = true;
+					theAnswer = true;
+				}
+				else
+				{
+					munmap(theAddress, 2 * theByteSize);
+				}
+			}
+		}
+		
+		//	the mappings keep the pages alive
+		close(theFile);
+	}
+#endif
+	
+	return theAnswer;
+}
+
+void	ACSimpleCodec::DeallocateInputBuffer()
+{
+#if AC_SIMPLE_CODEC_CAN_MIRROR
+	if(mInputBufferIsMirrored)
+	{
+		munmap(mInputBuffer, 2 * mInputBufferByteSize);
+		mInputBuffer = NULL;
+		mInputBufferIsMirrored = false;
+	}
+#endif
+	delete[] mInputBuffer;
+	mInputBuffer = NULL;
 }
@@ -47,12 +47,23 @@
 //=============================================================================
 
 #include "ACBaseCodec.h"
+#include <deque>
 
 //=============================================================================
 //	ACSimpleCodec
 //
 //	This extension of ACBaseCodec provides for a simple ring buffer to handle
 //	input data.
+//
+//	For CBR input, the packets are found by their size. For VBR input (an input
+//	format with mBytesPerPacket of 0), AppendInputData takes as many whole packets
+//	as fit, using the packet descriptions, and keeps a queue of their sizes so that
+//	the subclass can pull them out one at a time.
+//
+//	On Linux the ring buffer can optionally be built from the same pages mapped
+//	twice, back to back, so that any span of it is contiguous in memory and
+//	nothing needs to be copied or split when the data wraps around. Where that
+//	isn't available, or the mapping fails, the usual heap buffer is used.
 //=============================================================================
 
 class ACSimpleCodec
@@ -62,7 +73,7 @@ class ACSimpleCodec
 
 //	Construction/Destruction
 public:
-						ACSimpleCodec(UInt32 inInputBufferByteSize);
+						ACSimpleCodec(UInt32 inInputBufferByteSize, bool inUseMirroredInputBuffer = false);
 	virtual				~ACSimpleCodec();
 
 //	Data Handling
@@ -75,22 +86,58 @@ public:
 	virtual UInt32		GetInputBufferByteSize() const;
 	virtual UInt32		GetUsedInputBufferByteSize() const;
 
+	//	Does the work of an AppendInputData followed by a ProduceOutputPackets, but
+	//	the whole packets in inInputData are handed to ProduceOutputPackets in place
+	//	rather than being copied through the input buffer. Only what it takes to
+	//	finish a partial packet left over from before, and a partial packet at the
+	//	end of inInputData, go into the input buffer. On return ioInputDataByteSize
+	//	is how much of the input was used. CBR only. This is for hosts that link a
+	//	codec in and call it directly; the component dispatch only knows the
+	//	selectors AudioCodec.h defines, so it isn't reachable through a component.
+	UInt32				ProduceOutputPacketsDirect(const void* inInputData, UInt32& ioInputDataByteSize, void* outOutputData, UInt32& ioOutputDataByteSize, UInt32& ioNumberPackets, AudioStreamPacketDescription* outPacketDescription);
+
 protected:
 	void				ConsumeInputData(UInt32 inConsumedByteSize);	
-	Byte*				GetInputBufferStart() const { return mInputBuffer + mInputBufferStart; }
-	UInt32				GetInputBufferContiguousByteSize() const { return (mInputBufferStart <= mInputBufferEnd) ? (mInputBufferEnd - mInputBufferStart) : (mInputBufferByteSize - mInputBufferStart); }
+	Byte*				GetInputBufferStart() const { return (mBorrowedInputData != NULL) ? const_cast<Byte*>(mBorrowedInputData) : (mInputBuffer + mInputBufferStart); }
+	UInt32				GetInputBufferContiguousByteSize() const { return (mBorrowedInputData != NULL) ? mBorrowedInputByteSize : ((mInputBufferStart <= mInputBufferEnd) ? (mInputBufferEnd - mInputBufferStart) : (mInputBufferByteSize - mInputBufferStart)); }
 	virtual void		ReallocateInputBuffer(UInt32 inInputBufferByteSize);
 	
+	//	the number of input bytes that make up one output packet
+	virtual UInt32		GetInputPacketByteSize() const { return mInputFormat.mBytesPerPacket; }
+	
+	bool				InputBufferIsMirrored() const { return mInputBufferIsMirrored; }
+	
+	//	the queue of VBR packets in the input buffer, oldest first. If the oldest
+	//	packet was partly consumed, its size is what's left of it.
+	UInt32				GetNumberQueuedPackets() const { return static_cast<UInt32>(mPacketSizes.size()); }
+	UInt32				GetQueuedPacketByteSize(UInt32 inPacketIndex) const;
+	void				ConsumeInputPacket();
+	
 	// returns a pointer to contiguous bytes. 
 	// will do some copying if the request wraps around the internal buffer.
 	// request must be less than available bytes
 	Byte*				GetBytes(UInt32& ioNumberBytes) const;
 
 private:	
+	bool				AllocateMirroredInputBuffer();
+	void				DeallocateInputBuffer();
+	void				CopyIntoInputBuffer(const Byte* inInputData, UInt32 inInputDataByteSize);
+	void				AppendPartialPacket(const Byte* inInputData, UInt32& ioInputDataByteSize);
+	void				AppendInputPackets(const Byte* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets, const AudioStreamPacketDescription* inPacketDescription, UInt32 inAvailableByteSize);
+
 	Byte*				mInputBuffer;
 	UInt32				mInputBufferByteSize;
 	UInt32				mInputBufferStart;
 	UInt32				mInputBufferEnd;
+	bool				mUseMirroredInputBuffer;
+	bool				mInputBufferIsMirrored;
+	
+	//	while ProduceOutputPacketsDirect is running, the caller's data stands in for the input buffer
+	const Byte*			mBorrowedInputData;
+	UInt32				mBorrowedInputByteSize;
+	
+	//	the sizes of the VBR packets in the input buffer
+	std::deque<UInt32>	mPacketSizes;
 
 };
 
@@ -0,0 +1,188 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACWorkerPool.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACWorkerPool.h"
+#include <unistd.h>
+
+//=============================================================================
+//	ACWorkerPool
+//=============================================================================
+
+ACWorkerPool::ACWorkerPool(UInt32 inNumberThreads)
+:
+	mThreads(),
+	mTaskProc(NULL),
+	mRefCon(NULL),
+	mNumberTasks(0),
+	mNextTask(0),
+	mNumberTasksDone(0),
+	mGeneration(0),
+	mQuit(false)
+{
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mWorkCondition, NULL);
+	pthread_cond_init(&mDoneCondition, NULL);
+	
+	//	the calling thread always works too, so it doesn't need a thread of its own
+	for(UInt32 theIndex = 1; theIndex < inNumberThreads; ++theIndex)
+	{
+		pthread_t theThread;
+		if(pthread_create(&theThread, NULL, WorkerEntry, this) != 0)
+		{
+			//	run with what we've got
+			break;
+		}
+		mThreads.push_back(theThread);
+	}
+}
+
+ACWorkerPool::~ACWorkerPool()
+{
+	pthread_mutex_lock(&mMutex);
+	mQuit = true;
+	pthread_cond_broadcast(&mWorkCondition);
+	pthread_mutex_unlock(&mMutex);
+	
+	for(std::vector<pthread_t>::iterator theIterator = mThreads.begin(); theIterator != mThreads.end(); ++theIterator)
+	{
+		pthread_join(*theIterator, NULL);
+	}
+	
+	pthread_cond_destroy(&mDoneCondition);
+	pthread_cond_destroy(&mWorkCondition);
+	pthread_mutex_destroy(&mMutex);
+}
+
+void	ACWorkerPool::Run(TaskProc inTaskProc, void* inRefCon, UInt32 inNumberTasks)
+{
+	if(inNumberTasks == 0)
+	{
+		return;
+	}
+	
+	if(mThreads.empty() || (inNumberTasks == 1))
+	{
+		//	nothing to hand off
+		for(UInt32 theTask = 0; theTask < inNumberTasks; ++theTask)
+		{
+			inTaskProc(inRefCon, theTask);
+		}
+		return;
+	}
+	
+	//	publish the work and wake up the workers
+	pthread_mutex_lock(&mMutex);
+	mTaskProc = inTaskProc;
+	mRefCon = inRefCon;
+	mNumberTasks = inNumberTasks;
+	mNextTask = 0;
+	mNumberTasksDone = 0;
+	++mGeneration;
+	pthread_cond_broadcast(&mWorkCondition);
+	
+	//	pitch in, then wait for the stragglers
+	RunTasks();
+	while(mNumberTasksDone < mNumberTasks)
+	{
+		pthread_cond_wait(&mDoneCondition, &mMutex);
+	}
+	
+	mTaskProc = NULL;
+	mRefCon = NULL;
+	pthread_mutex_unlock(&mMutex);
+}
+
+UInt32	ACWorkerPool::GetNumberProcessors()
+{
+	long theAnswer = sysconf(_SC_NPROCESSORS_ONLN);
+	return (theAnswer > 0) ? static_cast<UInt32>(theAnswer) : 1;
+}
+
+void*	ACWorkerPool::WorkerEntry(void* inWorkerPool)
+{
+	static_cast<ACWorkerPool*>(inWorkerPool)->WorkerLoop();
+	return NULL;
+}
+
+void	ACWorkerPool::WorkerLoop()
+{
+	UInt32 theLastGeneration = 0;
+	
+	pthread_mutex_lock(&mMutex);
+	while(!mQuit)
+	{
+		if(mGeneration != theLastGeneration)
+		{
+			theLastGeneration = mGeneration;
+			RunTasks();
+		}
+		else
+		{
+			pthread_cond_wait(&mWorkCondition, &mMutex);
+		}
+	}
+	pthread_mutex_unlock(&mMutex);
+}
+
+void	ACWorkerPool::RunTasks()
+{
+	//	called with mMutex held, which is dropped while each task runs
+	while((mTaskProc != NULL) && (mNextTask < mNumberTasks))
+	{
+		UInt32 theTask = mNextTask++;
+		TaskProc theTaskProc = mTaskProc;
+		void* theRefCon = mRefCon;
+		
+		pthread_mutex_unlock(&mMutex);
+		theTaskProc(theRefCon, theTask);
+		pthread_mutex_lock(&mMutex);
+		
+		if(++mNumberTasksDone == mNumberTasks)
+		{
+			pthread_cond_signal(&mDoneCondition);
+		}
+	}
+}
@@ -0,0 +1,109 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACWorkerPool.h
+
+=============================================================================*/
+#if !defined(__ACWorkerPool_h__)
+#define __ACWorkerPool_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACCodec.h"
+#include <pthread.h>
+#include <vector>
+
+//=============================================================================
+//	ACWorkerPool
+//
+//	A small fixed size pool of worker threads for codecs that can split a
+//	large request into independent pieces of work. Run() hands out the task
+//	indices 0 through inNumberTasks - 1 to the workers and to the calling
+//	thread and doesn't return until every task has finished. Tasks must not
+//	throw.
+//=============================================================================
+
+class ACWorkerPool
+{
+
+public:
+	typedef void		(*TaskProc)(void* inRefCon, UInt32 inTaskIndex);
+
+//	Construction/Destruction
+public:
+						ACWorkerPool(UInt32 inNumberThreads);
+						~ACWorkerPool();
+
+//	Operations
+public:
+	//	the number of threads that take part in Run(), including the caller
+	UInt32				GetNumberThreads() const { return mThreads.size() + 1; }
+	
+	void				Run(TaskProc inTaskProc, void* inRefCon, UInt32 inNumberTasks);
+	
+	//	the number of processors currently online
+	static UInt32		GetNumberProcessors();
+
+//	Implementation
+private:
+	static void*		WorkerEntry(void* inWorkerPool);
+	void				WorkerLoop();
+	void				RunTasks();
+
+	std::vector<pthread_t>	mThreads;
+	pthread_mutex_t		mMutex;
+	pthread_cond_t		mWorkCondition;
+	pthread_cond_t		mDoneCondition;
+	
+	TaskProc			mTaskProc;
+	void*				mRefCon;
+	UInt32				mNumberTasks;
+	UInt32				mNextTask;
+	UInt32				mNumberTasksDone;
+	UInt32				mGeneration;
+	bool				mQuit;
+
+//	not copyable
+						ACWorkerPool(const ACWorkerPool&);
+	ACWorkerPool&		operator=(const ACWorkerPool&);
+
+};
+
+#endif
@@ -109,20 +109,21 @@ enum {
 //=============================================================================
 //	ACFLACCodec
 //=============================================================================
-FLAC__StreamMetadata_StreamInfo ACFLACCodec::mStreamInfo = {0};
-UInt32 ACFLACCodec::mCookieDefined = false;
-
-ACFLACCodec::ACFLACCodec(UInt32 inInputBufferByteSize, OSType theSubType)
+ACFLACCodec::ACFLACCodec(UInt32 inInputBufferPackets, OSType theSubType)
 :
 	ACBaseCodec(theSubType)
 {
 	mBitDepth = 0;
 	mAvgBitRate = 0;
 	mMaxFrameBytes = 0;
+	mFramesPerPacket = kFramesPerPacket;
+	mInputBufferPackets = inInputBufferPackets;
 	mMagicCookieLength = 0;
 	
 	memset( mMagicCookie, 0, 256 );
 	mCookieSet = 0;
+	memset( &mStreamInfo, 0, sizeof(FLAC__StreamMetadata_StreamInfo) );
+	mCookieDefined = false;
 }
 
 ACFLACCodec::~ACFLACCodec()
@@ -229,6 +230,11 @@ void	ACFLACCodec::GetPropertyInfo(AudioCodecPropertyID inPropertyID, UInt32& out
 			outWritable = false;
 			break;
 
+		case kFLACCodecPropertyMemoryFootprint:
+			outPropertyDataSize = sizeof(UInt32);
+			outWritable = false;
+			break;
+
 		default:
 			ACBaseCodec::GetPropertyInfo(inPropertyID, outPropertyDataSize, outWritable);
 			break;
@@ -280,7 +286,7 @@ void	ACFLACCodec::GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPrope
 		case kAudioCodecPropertyPacketFrameSize:
 			if(ioPropertyDataSize == sizeof(UInt32))
 			{
-                *reinterpret_cast<UInt32*>(outPropertyData) = kFramesPerPacket;
+                *reinterpret_cast<UInt32*>(outPropertyData) = mFramesPerPacket;
             }
 			else
 			{
@@ -437,11 +443,28 @@ void	ACFLACCodec::GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPrope
 			}
 			break;
 			
+		case kFLACCodecPropertyMemoryFootprint:
+			if(ioPropertyDataSize == sizeof(UInt32))
+			{
+				*reinterpret_cast<UInt32*>(outPropertyData) = GetMemoryFootprint();
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+			
 		default:
 			ACBaseCodec::GetProperty(inPropertyID, ioPropertyDataSize, outPropertyData);
 	}
 }
 
+// The encoder and decoder add what they allocate
+UInt32	ACFLACCodec::GetMemoryFootprint() const
+{
+	return sizeof(*this);
+}
+
 //FLAC__StreamMetadata_StreamInfo
 void ACFLACCodec::GetMagicCookie(void* outMagicCookieData, UInt32& ioMagicCookieDataByteSize) const
 {
@@ -484,7 +507,7 @@ void ACFLACCodec::GetMagicCookie(void* outMagicCookieData, UInt32& ioMagicCookie
 		CODEC_THROW(kAudioCodecBadPropertySizeError);
 	}
 	
-	tempMaxFrameBytes = kInputBufferPackets * mOutputFormat.mChannelsPerFrame * ((10 + kMaxSampleSize) / 8) + 1;
+	tempMaxFrameBytes = mFramesPerPacket * mOutputFormat.mChannelsPerFrame * ((10 + kMaxSampleSize) / 8) + 1;
 
 	buffer = (Byte *)calloc( atomSize, 1 );
 	currPtr = buffer;
@@ -542,8 +565,8 @@ void ACFLACCodec::GetMagicCookie(void* outMagicCookieData, UInt32& ioMagicCookie
 	}
 	else
 	{
-		config->min_blocksize	= EndianU32_NtoB( kFLACDefaultFrameSize );
-		config->max_blocksize	= EndianU32_NtoB( kFLACDefaultFrameSize );
+		config->min_blocksize	= EndianU32_NtoB( mFramesPerPacket );
+		config->max_blocksize	= EndianU32_NtoB( mFramesPerPacket );
 		config->min_framesize	= EndianU32_NtoB( 0 );
 		config->max_framesize	= EndianU32_NtoB( 0 );
 		config->sample_rate		= EndianU32_NtoB( (UInt32)(mOutputFormat.mSampleRate) );
@@ -722,6 +745,7 @@ void ACFLACCodec::SetProperty(AudioCodecPropertyID inPropertyID, UInt32 inProper
 		case kAudioCodecPropertyAvailableOutputChannelLayouts:
 		case kAudioCodecPropertyPacketFrameSize:
 		case kAudioCodecPropertyMaximumPacketByteSize:
+		case kFLACCodecPropertyMemoryFootprint:
 			CODEC_THROW(kAudioCodecIllegalOperationError);
 			break;
 		default:
@@ -89,6 +89,15 @@ enum
 	AudioChannelLayoutAID = 'chan'
 };
 
+//	Private properties shared by the encoder and decoder
+enum
+{
+	//	UInt32, read only. The bytes this instance has allocated right now -- the object
+	//	itself and the buffers it keeps, but not libFLAC's own state. The buffers are
+	//	only allocated while the codec is initialized.
+	kFLACCodecPropertyMemoryFootprint = 'fmem'
+};
+
 //=============================================================================
 //	ACFLACCodec
 //
@@ -102,7 +111,7 @@ class ACFLACCodec
 
 //	Construction/Destruction
 public:
-						ACFLACCodec(UInt32 inInputBufferByteSize, OSType theSubType);
+						ACFLACCodec(UInt32 inInputBufferPackets, OSType theSubType);
 	virtual				~ACFLACCodec();
 
 //	Data Handling
@@ -121,26 +130,31 @@ public:
 
 //	Implementation
 protected:
+	virtual UInt32		GetMemoryFootprint() const;
 
 //	Implementation Constants
 protected:
 	enum
 	{
-		kFramesPerPacket = 4608, // can also be 1152
+		kFramesPerPacket = 4608, // the default, mFramesPerPacket is what's used
+		kMinFramesPerPacket = 192,
+		kMaxFramesPerPacket = 16384,
 		kBytesPerChannelPerPacket = 0, // no way of knowing
 		kHeaderBytes = 12, // will need to check this
-		kInputBufferPackets = kFramesPerPacket,
+		kInputBufferPackets = 4, // the encoder's default, so that each call can encode several packets
 		kLosslessPacketBytes = kHeaderBytes + kBytesPerChannelPerPacket
 	};
 	SInt16					mBitDepth;
 	UInt32					mAvgBitRate;
 	UInt32					mMaxFrameBytes;
+	UInt32					mFramesPerPacket; // the FLAC block size
+	UInt32					mInputBufferPackets; // for each libFLAC instance, unless kAudioCodecPropertyInputBufferSize asks for more
 	
 	Byte					mMagicCookie[256];
 	UInt32					mMagicCookieLength;
 	UInt32					mCookieSet;
-	static FLAC__StreamMetadata_StreamInfo mStreamInfo;
-	static UInt32 mCookieDefined;
+	FLAC__StreamMetadata_StreamInfo mStreamInfo;
+	UInt32					mCookieDefined;
 
 };
 
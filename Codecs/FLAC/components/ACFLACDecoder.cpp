@@ -53,6 +53,9 @@
 #include "CASampleTools.h"
 #include "CADebugMacros.h"
 #include "CABundleLocker.h"
+#include "ACWorkerPool.h"
+#include "ACFLACSampleInterleaving.h"
+#include "private/crc.h"
 
 #if TARGET_OS_WIN32
 	#include "CAWin32StringResources.h"
@@ -67,7 +70,7 @@
 #define RequireAction(condition, action)			if (!(condition)) { action }
 #define kAudioFormatCDLinearPCM (kLinearPCMFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked)
 
-static unsigned num_expected_;
+static const unsigned num_expected_ = 0;
 
 #define VERBOSE 0 // It is often useful only enable some of what this enables
 
@@ -82,17 +85,10 @@ static FLAC__bool die_(const char *msg)
 //=============================================================================
 //	ACFLACDecoder
 //=============================================================================
-// Static variable
-
-Byte * ACFLACDecoder::mOutputBufferPtr = NULL;
-Byte * ACFLACDecoder::mInputBufferPtr = NULL;
-UInt32 ACFLACDecoder::mInputBufferBytesUsed = 0;
-UInt32 ACFLACDecoder::mFramesDecoded = 0;
-UInt32 ACFLACDecoder::mInputBufferBytesRead = 0;
 
 ACFLACDecoder::ACFLACDecoder(OSType theSubType)
 :
-	ACFLACCodec(kInputBufferPackets * kMaxChannels * sizeof(SInt32), theSubType)
+	ACFLACCodec(1, theSubType) // decoders are held open by the thousand, so just the one packet
 {
 	//	This decoder only takes an FLAC stream as it's input
 	CAStreamBasicDescription theInputFormat1(kAudioStreamAnyRate, kAudioFormatFLAC, 0, kFramesPerPacket, 0, 0, 0, kFLACFormatFlag_16BitSourceData);
@@ -117,7 +113,8 @@ ACFLACDecoder::ACFLACDecoder(OSType theSubType)
 	mInputFormat.mChannelsPerFrame = 2;
 	mInputFormat.mBitsPerChannel = 0;
 	
-	//	This decoder produces 16 or 32 bit native endian signed integer as it's output,
+	//	This decoder produces 16, 20, 24 or 32 bit native endian signed integer or
+	//	32 bit native endian Core Audio floats as it's output,
 	//	but can handle any sample rate and any number of channels
 	CAStreamBasicDescription theOutputFormat1(kAudioStreamAnyRate, kAudioFormatLinearPCM, 0, 1, 0, 0, 16, kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked);
 	AddOutputFormat(theOutputFormat1);
@@ -131,6 +128,9 @@ ACFLACDecoder::ACFLACDecoder(OSType theSubType)
 	AddOutputFormat(theOutputFormat3);
 
 	//CAStreamBasicDescription theOutputFormat4(kAudioStreamAnyRate, kAudioFormatLinearPCM, 0, 1, 0, 0, 20, kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsAlignedHigh);
+
+	CAStreamBasicDescription theOutputFormat5(kAudioStreamAnyRate, kAudioFormatLinearPCM, 0, 1, 0, 0, 32, kAudioFormatFlagsNativeFloatPacked);
+	AddOutputFormat(theOutputFormat5);
 	//AddOutputFormat(theOutputFormat4);
 
 	//	set our intial output format to stereo 16 bit native endian signed integers at a 44100 sample rate
@@ -143,10 +143,31 @@ ACFLACDecoder::ACFLACDecoder(OSType theSubType)
 	mOutputFormat.mChannelsPerFrame = 2;
 	mOutputFormat.mBitsPerChannel = 16;
 
+	mInputBuffer = NULL;
+	mInputBufferByteSize = 0;
+	mRequestedInputBufferByteSize = 0;
+	mOutputBufferPtr = NULL;
+	mInputBufferPtr = NULL;
 	mInputBufferBytesUsed = 0;
-	mPacketInInputBuffer = false;
+	mFramesDecoded = 0;
+	mMaxFramesDecoded = 0;
+	mInputBufferBytesRead = 0;
+	mInputPacketEnd = 0;
+	memset(&mClientDataStruct, 0, sizeof(stream_decoder_client_data_struct));
 	mDecoder = FLAC__stream_decoder_new();
 	mDecoderState = FLAC__stream_decoder_get_state(mDecoder);
+	
+	mFloatOutput = false;
+	mTrustedSource = false;
+	mBorrowInput = false;
+	mStreamInput = false;
+	mPacketDesynced = false;
+	mDesyncCount = 0;
+	mFailurePending = false;
+	memset(&mSeekPosition, 0, sizeof(FLACSeekPosition));
+	ResetStreamFrames();
+	mDecodeThreadCount = 1;
+	mWorkerPool = NULL;
 }
 
 ACFLACDecoder::~ACFLACDecoder()
@@ -155,6 +176,12 @@ ACFLACDecoder::~ACFLACDecoder()
 	{
 		FLAC__stream_decoder_delete(mDecoder);
 	}
+	delete mWorkerPool;
+	for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+	{
+		FLAC__stream_decoder_delete(mParallelRanges[i].mDecoder);
+	}
+	delete[] mInputBuffer;
 }
 
 void	ACFLACDecoder::GetPropertyInfo(AudioCodecPropertyID inPropertyID, UInt32& outPropertyDataSize, Boolean& outWritable)
@@ -166,6 +193,30 @@ void	ACFLACDecoder::GetPropertyInfo(AudioCodecPropertyID inPropertyID, UInt32& o
 			outWritable = false;
 			break;
 
+		case kFLACDecoderPropertyDecodeThreadCount:
+		case kFLACDecoderPropertyTrustedSource:
+		case kFLACDecoderPropertyBorrowInput:
+		case kFLACDecoderPropertyStreamInput:
+			outPropertyDataSize = sizeof(UInt32);
+			outWritable = !mIsInitialized;
+			break;
+		case kFLACDecoderPropertyDesyncCount:
+			outPropertyDataSize = sizeof(UInt32);
+			outWritable = false;
+			break;
+		case kFLACDecoderPropertySeekIndex:
+			outPropertyDataSize = mSeekIndex.size() * sizeof(FLAC__StreamMetadata_SeekPoint);
+			outWritable = true;
+			break;
+		case kFLACDecoderPropertySeekToSample:
+			outPropertyDataSize = sizeof(UInt64);
+			outWritable = mIsInitialized;
+			break;
+		case kFLACDecoderPropertySeekPosition:
+			outPropertyDataSize = sizeof(FLACSeekPosition);
+			outWritable = false;
+			break;
+
 		default:
 			ACFLACCodec::GetPropertyInfo(inPropertyID, outPropertyDataSize, outWritable);
 			break;
@@ -191,9 +242,9 @@ void	ACFLACDecoder::GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPro
 			if(ioPropertyDataSize == sizeof(UInt32))
 			{
 			#if VERBOSE	
-				printf("Max packet size == %lu\n", kInputBufferPackets * mInputFormat.mChannelsPerFrame * ((mOutputFormat.mBitsPerChannel) >> 3) + kMaxEscapeHeaderBytes);
+				printf("Max packet size == %lu\n", mFramesPerPacket * mInputFormat.mChannelsPerFrame * ((mOutputFormat.mBitsPerChannel) >> 3) + kMaxEscapeHeaderBytes);
 			#endif
-				*reinterpret_cast<UInt32*>(outPropertyData) = kInputBufferPackets * mInputFormat.mChannelsPerFrame * ((mOutputFormat.mBitsPerChannel) >> 3) + kMaxEscapeHeaderBytes;
+				*reinterpret_cast<UInt32*>(outPropertyData) = mFramesPerPacket * mInputFormat.mChannelsPerFrame * ((mOutputFormat.mBitsPerChannel) >> 3) + kMaxEscapeHeaderBytes;
 			}
 			else
 			{
@@ -329,6 +380,92 @@ void	ACFLACDecoder::GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPro
 			}
 			break;
 			
+		case kFLACDecoderPropertyDecodeThreadCount:
+			if(ioPropertyDataSize == sizeof(UInt32))
+			{
+				*reinterpret_cast<UInt32*>(outPropertyData) = mDecodeThreadCount;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertyTrustedSource:
+			if(ioPropertyDataSize == sizeof(UInt32))
+			{
+				*reinterpret_cast<UInt32*>(outPropertyData) = mTrustedSource ? 1 : 0;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertyBorrowInput:
+			if(ioPropertyDataSize == sizeof(UInt32))
+			{
+				*reinterpret_cast<UInt32*>(outPropertyData) = mBorrowInput ? 1 : 0;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertyStreamInput:
+			if(ioPropertyDataSize == sizeof(UInt32))
+			{
+				*reinterpret_cast<UInt32*>(outPropertyData) = mStreamInput ? 1 : 0;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertyDesyncCount:
+			if(ioPropertyDataSize == sizeof(UInt32))
+			{
+				*reinterpret_cast<UInt32*>(outPropertyData) = mDesyncCount;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertySeekIndex:
+		{
+			// as many whole seek points as fit
+			UInt32 theNumberPoints = ioPropertyDataSize / sizeof(FLAC__StreamMetadata_SeekPoint);
+			if (theNumberPoints > mSeekIndex.size())
+			{
+				theNumberPoints = mSeekIndex.size();
+			}
+			ioPropertyDataSize = theNumberPoints * sizeof(FLAC__StreamMetadata_SeekPoint);
+			if (theNumberPoints > 0)
+			{
+				memcpy(outPropertyData, &mSeekIndex[0], ioPropertyDataSize);
+			}
+			break;
+		}
+		case kFLACDecoderPropertySeekToSample:
+			if(ioPropertyDataSize == sizeof(UInt64))
+			{
+				*reinterpret_cast<UInt64*>(outPropertyData) = mSeekPosition.mSampleNumber;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertySeekPosition:
+			if(ioPropertyDataSize == sizeof(FLACSeekPosition))
+			{
+				memcpy(outPropertyData, &mSeekPosition, sizeof(FLACSeekPosition));
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+			
 		default:
 			ACFLACCodec::GetProperty(inPropertyID, ioPropertyDataSize, outPropertyData);
 	}
@@ -336,7 +473,8 @@ void	ACFLACDecoder::GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPro
 
 void ACFLACDecoder::SetProperty(AudioCodecPropertyID inPropertyID, UInt32 inPropertyDataSize, const void* inPropertyData)
 {
-	if(mIsInitialized)
+	// seeking is the only thing that can change once we're initialized
+	if(mIsInitialized && (inPropertyID != kFLACDecoderPropertySeekIndex) && (inPropertyID != kFLACDecoderPropertySeekToSample))
 	{
 		CODEC_THROW(kAudioCodecIllegalOperationError);
 	}
@@ -345,6 +483,75 @@ void ACFLACDecoder::SetProperty(AudioCodecPropertyID inPropertyID, UInt32 inProp
 		case kAudioCodecPropertyFormatList:
 			CODEC_THROW(kAudioCodecIllegalOperationError);
 			break;
+		case kFLACDecoderPropertyDecodeThreadCount:
+			if(inPropertyDataSize == sizeof(UInt32))
+			{
+				mDecodeThreadCount = *reinterpret_cast<const UInt32*>(inPropertyData);
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertyTrustedSource:
+			if(inPropertyDataSize == sizeof(UInt32))
+			{
+				mTrustedSource = *reinterpret_cast<const UInt32*>(inPropertyData) != 0;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertyBorrowInput:
+			if(inPropertyDataSize == sizeof(UInt32))
+			{
+				mBorrowInput = *reinterpret_cast<const UInt32*>(inPropertyData) != 0;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertyStreamInput:
+			if(inPropertyDataSize == sizeof(UInt32))
+			{
+				mStreamInput = *reinterpret_cast<const UInt32*>(inPropertyData) != 0;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertyDesyncCount:
+		case kFLACDecoderPropertySeekPosition:
+			CODEC_THROW(kAudioCodecIllegalOperationError);
+			break;
+		case kFLACDecoderPropertySeekIndex:
+			if(inPropertyDataSize % sizeof(FLAC__StreamMetadata_SeekPoint) == 0)
+			{
+				const FLAC__StreamMetadata_SeekPoint * theSeekPoints = reinterpret_cast<const FLAC__StreamMetadata_SeekPoint*>(inPropertyData);
+				mSeekIndex.assign(theSeekPoints, theSeekPoints + inPropertyDataSize / sizeof(FLAC__StreamMetadata_SeekPoint));
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+		case kFLACDecoderPropertySeekToSample:
+			if(!mIsInitialized)
+			{
+				CODEC_THROW(kAudioCodecStateError);
+			}
+			if(inPropertyDataSize == sizeof(UInt64))
+			{
+				SeekToSample(*reinterpret_cast<const UInt64*>(inPropertyData));
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
 		default:
             ACFLACCodec::SetProperty(inPropertyID, inPropertyDataSize, inPropertyData);
             break;            
@@ -386,27 +593,33 @@ void	ACFLACDecoder::SetCurrentInputFormat(const AudioStreamBasicDescription& inI
 		{
 			mOutputFormat.mSampleRate = mInputFormat.mSampleRate;
 		}
+		// the stream's block size, until a cookie says otherwise
+		mFramesPerPacket = (mInputFormat.mFramesPerPacket > 0) ? mInputFormat.mFramesPerPacket : kFramesPerPacket;
 		bitDepthFlag = mInputFormat.mFormatFlags & 0x00000007;
 	#if VERBOSE
 		printf("mInputFormat.mFormatFlags == %lu\n", mInputFormat.mFormatFlags);
 	#endif
-		switch (bitDepthFlag)
+		// float output is 32 bits whatever the source
+		if (!(mOutputFormat.mFormatFlags & kAudioFormatFlagIsFloat))
 		{
-			case kFLACFormatFlag_16BitSourceData:
-				mOutputFormat.mBitsPerChannel = 16;
-				break;
-			case kFLACFormatFlag_20BitSourceData:
-				mOutputFormat.mBitsPerChannel = 20; // 20 bits high aligned
-				mOutputFormat.mFormatFlags = (kLinearPCMFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsAlignedHigh);
-				break;
-			case kFLACFormatFlag_24BitSourceData:
-				mOutputFormat.mBitsPerChannel = 24;
-				break;
-			case kFLACFormatFlag_32BitSourceData:
-				mOutputFormat.mBitsPerChannel = 32;
-				break;
-			default: // do nothing -- it's dangerous to guess
-				break;
+			switch (bitDepthFlag)
+			{
+				case kFLACFormatFlag_16BitSourceData:
+					mOutputFormat.mBitsPerChannel = 16;
+					break;
+				case kFLACFormatFlag_20BitSourceData:
+					mOutputFormat.mBitsPerChannel = 20; // 20 bits high aligned
+					mOutputFormat.mFormatFlags = (kLinearPCMFormatFlagIsSignedInteger | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsAlignedHigh);
+					break;
+				case kFLACFormatFlag_24BitSourceData:
+					mOutputFormat.mBitsPerChannel = 24;
+					break;
+				case kFLACFormatFlag_32BitSourceData:
+					mOutputFormat.mBitsPerChannel = 32;
+					break;
+				default: // do nothing -- it's dangerous to guess
+					break;
+			}
 		}
 		// Zero out everything that has to be zero
 		mInputFormat.mBytesPerFrame = 0;
@@ -436,6 +649,14 @@ void	ACFLACDecoder::SetCurrentOutputFormat(const AudioStreamBasicDescription& in
 #endif
 			CODEC_THROW(kAudioCodecUnsupportedFormatError);
 		}
+		if ( (inOutputFormat.mFormatFlags & kAudioFormatFlagIsFloat) &&
+			 ( (inOutputFormat.mFormatFlags != kAudioFormatFlagsNativeFloatPacked) || (inOutputFormat.mBitsPerChannel != 32) ) )
+		{
+#if VERBOSE
+			DebugMessage("ACFLACDecoder::SetCurrentOutputFormat: floats have to be 32 bit native endian Core Audio floats");
+#endif
+			CODEC_THROW(kAudioCodecUnsupportedFormatError);
+		}
 		
 		//	tell our base class about the new format
 		ACFLACCodec::SetCurrentOutputFormat(inOutputFormat);
@@ -469,6 +690,8 @@ void	ACFLACDecoder::Initialize(const AudioStreamBasicDescription* inInputFormat,
 		// We might only get a cookie! We have to make sure the formats are in sync
 		if (mCookieSet == 1 && inInputFormat == NULL && inOutputFormat == NULL)
 		{
+			bool theFloatOutput = (mOutputFormat.mFormatFlags & kAudioFormatFlagIsFloat) != 0;
+			
 			mOutputFormat.mSampleRate = mInputFormat.mSampleRate = (Float64)mStreamInfo.sample_rate;
 			mOutputFormat.mChannelsPerFrame = mInputFormat.mChannelsPerFrame = mStreamInfo.channels;
 			mInputFormat.mFormatFlags &= 0xfffffff8;
@@ -492,11 +715,22 @@ void	ACFLACDecoder::Initialize(const AudioStreamBasicDescription* inInputFormat,
 					break;
 			}
 			mOutputFormat.mBitsPerChannel = mStreamInfo.bits_per_sample;
+			if (theFloatOutput)
+			{
+				mOutputFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
+				mOutputFormat.mBitsPerChannel = 32;
+			}
 			mInputFormat.mFramesPerPacket = mStreamInfo.max_blocksize;
 		}
+		mFloatOutput = (mOutputFormat.mFormatFlags & kAudioFormatFlagIsFloat) != 0;
+		if (mStreamInfo.max_blocksize > 0)
+		{
+			mFramesPerPacket = mStreamInfo.max_blocksize;
+		}
 
-		// Set the callbacks
+		// Set the callbacks -- they get back to us through the client data
 		// Initialize the decoder
+		ConfigureDecoder(mDecoder);
 		if(FLAC__stream_decoder_init_stream(mDecoder,
 											stream_decoder_read_callback,
 											NULL,
@@ -504,16 +738,46 @@ void	ACFLACDecoder::Initialize(const AudioStreamBasicDescription* inInputFormat,
 											NULL,
 											NULL,
 											stream_decoder_write_callback,
-											stream_decoder_metadata_callback,
+											mTrustedSource ? NULL : stream_decoder_metadata_callback,
 											stream_decoder_error_callback,
-											&mClientDataStruct)
+											this)
 			!= FLAC__STREAM_DECODER_INIT_STATUS_OK)
 		{
 			ACFLACCodec::Uninitialize();
 			CODEC_THROW(kAudioCodecStateError);
 		}
 		mDecoderState = FLAC__stream_decoder_get_state(mDecoder);
-		mInputBufferPtr = mInputBuffer;
+		
+		// the pool's threads and the run decoders live as long as we're initialized
+		if (mDecodeThreadCount > 1)
+		{
+			mWorkerPool = new ACWorkerPool(mDecodeThreadCount);
+			mParallelRanges.resize(mWorkerPool->GetNumberThreads());
+			for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+			{
+				mParallelRanges[i].mDecoder = FLAC__stream_decoder_new();
+				ConfigureDecoder(mParallelRanges[i].mDecoder);
+				FLAC__stream_decoder_init_stream(mParallelRanges[i].mDecoder,
+												 parallel_decoder_read_callback,
+												 NULL,
+												 NULL,
+												 NULL,
+												 NULL,
+												 parallel_decoder_write_callback,
+												 NULL,
+												 parallel_decoder_error_callback,
+												 &mParallelRanges[i]);
+			}
+		}
+		// stream input is gathered up in the input buffer to find the frames, so none of it is borrowed
+		if (mStreamInput)
+		{
+			mBorrowInput = false;
+		}
+		AllocateInputBuffer();
+		mDesyncCount = 0;
+		mFailurePending = false;
+		memset(&mSeekPosition, 0, sizeof(FLACSeekPosition));
 	}
 	else
 	{
@@ -521,77 +785,143 @@ void	ACFLACDecoder::Initialize(const AudioStreamBasicDescription* inInputFormat,
 	}
 }
 
-// We handle one packet at a time -- no more!
-// get the AU from inInputData, store it in mBitBuffer
+// Every packet but the last has mFramesPerPacket frames, so the packet a sample is in can be
+// worked out straight off. The seek index is checked anyway in case the block size varies.
+void ACFLACDecoder::SeekToSample(UInt64 inSampleNumber)
+{
+	if (mSeekIndex.empty())
+	{
+		CODEC_THROW(kAudioCodecStateError);
+	}
+	
+	UInt64 thePacket = inSampleNumber / mFramesPerPacket;
+	if (thePacket >= mSeekIndex.size())
+	{
+		thePacket = mSeekIndex.size() - 1;
+	}
+	while ( (thePacket > 0) && (mSeekIndex[thePacket].sample_number > inSampleNumber) )
+	{
+		--thePacket;
+	}
+	while ( (thePacket + 1 < mSeekIndex.size()) && (mSeekIndex[thePacket + 1].sample_number <= inSampleNumber) )
+	{
+		++thePacket;
+	}
+	
+	const FLAC__StreamMetadata_SeekPoint & theSeekPoint = mSeekIndex[thePacket];
+	if ( (inSampleNumber < theSeekPoint.sample_number) || (inSampleNumber >= theSeekPoint.sample_number + theSeekPoint.frame_samples) )
+	{
+		// past the end, or the index doesn't cover it
+		CODEC_THROW(kAudioCodecIllegalOperationError);
+	}
+	
+	// whatever was waiting is from before the seek -- the decoders only need to look for the next frame
+	mInputBufferPtr = mInputBuffer;
+	mInputBufferBytesUsed = 0;
+	mInputBufferBytesRead = 0;
+	mInputPacketEnd = 0;
+	mPacketSizes.clear();
+	mFramesDecoded = 0;
+	mFailurePending = false;
+	ResetStreamFrames();
+	FLAC__stream_decoder_flush(mDecoder);
+	for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+	{
+		FLAC__stream_decoder_flush(mParallelRanges[i].mDecoder);
+	}
+	
+	mSeekPosition.mSampleNumber = inSampleNumber;
+	mSeekPosition.mPacketNumber = thePacket;
+	mSeekPosition.mByteOffset = theSeekPoint.stream_offset;
+	mSeekPosition.mFramesToDiscard = (UInt32)(inSampleNumber - theSeekPoint.sample_number);
+}
+
+// libFLAC forgets all of this on finish, so it's done before every init
+void ACFLACDecoder::ConfigureDecoder(FLAC__StreamDecoder * inDecoder)
+{
+	if (mTrustedSource)
+	{
+		// there's nothing the metadata or the MD5 could tell us that we don't already know
+		FLAC__stream_decoder_set_md5_checking(inDecoder, false);
+		FLAC__stream_decoder_set_metadata_ignore_all(inDecoder);
+	}
+}
+
+// We take as many whole packets as fit in the input buffer -- no partial packets, unless it's stream input
+// get the AUs from inInputData, store them in mInputBuffer
 void ACFLACDecoder::AppendInputData(const void* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets, const AudioStreamPacketDescription* inPacketDescription)
 {
+	if (mStreamInput)
+	{
+		AppendStreamData(inInputData, ioInputDataByteSize, ioNumberPackets);
+		return;
+	}
+	if (mBorrowInput)
+	{
+		BorrowInputData(inInputData, ioInputDataByteSize, ioNumberPackets, inPacketDescription);
+		return;
+	}
 
 	UInt8 * tempInput = (UInt8 *)inInputData;
+	UInt32 theAvailableByteSize = GetInputBufferByteSize() - mInputBufferBytesUsed;
 	
-	if (ioNumberPackets > 0 && ioInputDataByteSize > 0 && !mPacketInInputBuffer)
+	if (ioNumberPackets > 0 && ioInputDataByteSize > 0)
     {
 		// See if we actually got an AudioStreamPacketDescription*
 		if (inPacketDescription != NULL)
 		{
-			// and if it's filled out and passes a basic sanity check
-			if ( (inPacketDescription[0]).mDataByteSize && (inPacketDescription[0]).mDataByteSize + (inPacketDescription[0]).mStartOffset <= ioInputDataByteSize )
+			UInt32 thePacketsTaken = 0;
+			UInt32 theInputDataEnd = 0;
+			
+			for ( ; thePacketsTaken < ioNumberPackets; ++thePacketsTaken)
 			{
-				// use it ...
-				ioInputDataByteSize = (inPacketDescription[0]).mDataByteSize;
-				// if we have enough space.
-				if(GetInputBufferByteSize() - mInputBufferBytesUsed >= ioInputDataByteSize) // We have enough space
+				const AudioStreamPacketDescription & thePacket = inPacketDescription[thePacketsTaken];
+				
+				// make sure it's filled out and passes a basic sanity check
+				if ( (thePacket.mDataByteSize == 0) || (thePacket.mDataByteSize + thePacket.mStartOffset > ioInputDataByteSize) )
 				{
-					// increment past the offset
-					tempInput += (inPacketDescription[0]).mStartOffset;
-					memcpy(mInputBuffer + mInputBufferBytesUsed, (const unsigned char *)tempInput, (inPacketDescription[0]).mDataByteSize);
-					mInputBufferBytesUsed = (inPacketDescription[0]).mDataByteSize;
-					ioInputDataByteSize += (inPacketDescription[0]).mStartOffset;
 				#if VERBOSE
-					printf("Appending data: ioInputDataByteSize == %lu, mInputBufferBytesUsed == %lu, mStartOffset == %lu\n", ioInputDataByteSize, mInputBufferBytesUsed, (inPacketDescription[0]).mStartOffset);
+					printf("We have no data\n");
 				#endif
-					// we may have received more than 1 packet, but we're only taking 1.
-					ioNumberPackets = 1;
-					mPacketInInputBuffer = true;
+					break;
 				}
-				else
+				// No partial packets
+				if (thePacket.mDataByteSize > theAvailableByteSize)
 				{
 				#if VERBOSE
 					printf ("We think we have a partial packet\n");
 				#endif
-					// No partial packets
-					ioInputDataByteSize = 0;
-					ioNumberPackets = 0;
-					mInputBufferBytesUsed = 0;
+					break;
 				}
+				memcpy(mInputBuffer + mInputBufferBytesUsed, (const unsigned char *)(tempInput + thePacket.mStartOffset), thePacket.mDataByteSize);
+				mInputBufferBytesUsed += thePacket.mDataByteSize;
+				theAvailableByteSize -= thePacket.mDataByteSize;
+				mPacketSizes.push_back(thePacket.mDataByteSize);
+				theInputDataEnd = thePacket.mStartOffset + thePacket.mDataByteSize;
 			}
-			else
-			{
-			#if VERBOSE
-				printf("We have no data\n");
-			#endif
-				// We're either screwed or have no data
-				ioNumberPackets = 0;
-				ioInputDataByteSize = 0;
-				mInputBufferBytesUsed = 0;
-			}
+		#if VERBOSE
+			printf("Appending data: %lu packets, ioInputDataByteSize == %lu, mInputBufferBytesUsed == %lu\n", thePacketsTaken, theInputDataEnd, mInputBufferBytesUsed);
+		#endif
+			ioInputDataByteSize = theInputDataEnd;
+			ioNumberPackets = thePacketsTaken;
 		}
 		else // we'd better have one packet
 		{
 		#if VERBOSE
 			printf ("No Packet descriptions\n");
 		#endif
-			if(GetInputBufferByteSize() - mInputBufferBytesUsed >= ioInputDataByteSize) // We have enough space
+			if(theAvailableByteSize >= ioInputDataByteSize) // We have enough space
 			{
 				memcpy(mInputBuffer + mInputBufferBytesUsed, (const unsigned char *)tempInput, ioInputDataByteSize);
-				mInputBufferBytesUsed = ioInputDataByteSize;
-				mPacketInInputBuffer = true;
+				mInputBufferBytesUsed += ioInputDataByteSize;
+				mPacketSizes.push_back(ioInputDataByteSize);
+				ioNumberPackets = 1;
 			}
 			else
 			{
 				// No partial packets
 				ioInputDataByteSize = 0;
 				ioNumberPackets = 0;
-				mInputBufferBytesUsed = 0;
 			}
 		}
     }
@@ -603,6 +933,282 @@ void ACFLACDecoder::AppendInputData(const void* inInputData, UInt32& ioInputData
 
 }
 
+// Borrowed input is read where it is, so the packets taken have to follow one another in the
+// caller's memory. Nothing more is taken until what was borrowed last time has been decoded.
+void ACFLACDecoder::BorrowInputData(const void* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets, const AudioStreamPacketDescription* inPacketDescription)
+{
+	UInt32 thePacketsTaken = 0;
+	UInt32 theInputDataStart = 0;
+	UInt32 theInputDataEnd = 0;
+	
+	if ( (mInputBufferBytesUsed == 0) && (ioNumberPackets > 0) && (ioInputDataByteSize > 0) )
+	{
+		if (inPacketDescription != NULL)
+		{
+			for ( ; thePacketsTaken < ioNumberPackets; ++thePacketsTaken)
+			{
+				const AudioStreamPacketDescription & thePacket = inPacketDescription[thePacketsTaken];
+				
+				// make sure it's filled out and passes a basic sanity check
+				if ( (thePacket.mDataByteSize == 0) || (thePacket.mDataByteSize + thePacket.mStartOffset > ioInputDataByteSize) )
+				{
+					break;
+				}
+				if (thePacketsTaken == 0)
+				{
+					theInputDataStart = theInputDataEnd = thePacket.mStartOffset;
+				}
+				else if (thePacket.mStartOffset != theInputDataEnd)
+				{
+					// there's a gap, the rest have to wait
+					break;
+				}
+				mPacketSizes.push_back(thePacket.mDataByteSize);
+				theInputDataEnd += thePacket.mDataByteSize;
+			}
+		}
+		else // we'd better have one packet
+		{
+			mPacketSizes.push_back(ioInputDataByteSize);
+			theInputDataEnd = ioInputDataByteSize;
+			thePacketsTaken = 1;
+		}
+		
+		if (thePacketsTaken > 0)
+		{
+			mInputBufferPtr = static_cast<const Byte *>(inInputData) + theInputDataStart;
+			mInputBufferBytesUsed = theInputDataEnd - theInputDataStart;
+			mInputBufferBytesRead = 0;
+		}
+	}
+	
+	ioInputDataByteSize = theInputDataEnd;
+	ioNumberPackets = thePacketsTaken;
+}
+
+// Stream input is taken a byte at a time if that's how it comes, as much as there's room for. What
+// comes back in ioNumberPackets is the number of frames the new bytes finished.
+void ACFLACDecoder::AppendStreamData(const void* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets)
+{
+	UInt32 thePacketsFound = mPacketSizes.size();
+	
+	if (ioInputDataByteSize == 0)
+	{
+		// the end of the stream -- there's no next header coming to tell us where the last frame ends
+		FindStreamFrames(true);
+	}
+	else
+	{
+		UInt32 theAvailableByteSize = mInputBufferByteSize - mInputBufferBytesUsed;
+		
+		if (ioInputDataByteSize > theAvailableByteSize)
+		{
+			ioInputDataByteSize = theAvailableByteSize;
+		}
+		memcpy(mInputBuffer + mInputBufferBytesUsed, inInputData, ioInputDataByteSize);
+		mInputBufferBytesUsed += ioInputDataByteSize;
+		FindStreamFrames(false);
+	}
+	ioNumberPackets = mPacketSizes.size() - thePacketsFound;
+}
+
+// A frame runs from one frame header to the next, but a frame's data can hold what looks like a header
+// too, so the frame's CRC-16 has to check out as well. The header's own CRC-8 has already weeded out
+// most of those, and the CRC-16 is carried on from one candidate to the next, so a frame costs the
+// same to look through however many false sync codes it holds. Frames found go on mPacketSizes to
+// be decoded like any other packet.
+void ACFLACDecoder::FindStreamFrames(bool inEndOfStream)
+{
+	UInt32 theMaxFrameByteSize = GetMaxPacketByteSize();
+	
+	// a full input buffer can leave us past the end of what there is, but the frame still has to be given up on
+	while ( (mStreamScanPosition < mInputBufferBytesUsed) || (mStreamInFrame && (mStreamScanPosition - mStreamFrameStart > theMaxFrameByteSize)) )
+	{
+		if (mStreamInFrame && (mStreamScanPosition - mStreamFrameStart > theMaxFrameByteSize))
+		{
+			// no frame gets this big, so the one we thought we were in is bad -- look again from just past its sync code
+			mStreamInFrame = false;
+			mStreamScanPosition = mStreamFrameStart + 1;
+		}
+		
+		bool theComplete = true;
+		UInt32 theHeaderByteSize = GetFrameHeaderByteSize(mInputBuffer + mStreamScanPosition, mInputBufferBytesUsed - mStreamScanPosition, theComplete);
+		
+		if (!theComplete && !inEndOfStream)
+		{
+			// it could still be a header, we'll know when more comes
+			break;
+		}
+		if (theHeaderByteSize == 0)
+		{
+			// on to the next byte that could start a sync code
+			const void * theNextSync = memchr(mInputBuffer + mStreamScanPosition + 1, 0xFF, mInputBufferBytesUsed - mStreamScanPosition - 1);
+			mStreamScanPosition = (theNextSync != NULL) ? static_cast<const Byte *>(theNextSync) - mInputBuffer : mInputBufferBytesUsed;
+		}
+		else if (!mStreamInFrame)
+		{
+			// the first frame after a gap -- anything before it can't be decoded
+			if (mStreamScanPosition > mStreamFrameStart)
+			{
+				memmove(mInputBuffer + mStreamFrameStart, mInputBuffer + mStreamScanPosition, mInputBufferBytesUsed - mStreamScanPosition);
+				mInputBufferBytesUsed -= mStreamScanPosition - mStreamFrameStart;
+				mStreamSkipping = true;
+			}
+			if (mStreamSkipping)
+			{
+				++mDesyncCount;
+				mStreamSkipping = false;
+			}
+			mStreamInFrame = true;
+			mStreamScanPosition = mStreamFrameStart + theHeaderByteSize;
+			mStreamFrameCRC = 0;
+			mStreamFrameCRCByteSize = 0;
+		}
+		else if (StreamFrameCRCMatches(mStreamScanPosition - mStreamFrameStart))
+		{
+			mPacketSizes.push_back(mStreamScanPosition - mStreamFrameStart);
+			mStreamFrameStart = mStreamScanPosition;
+			mStreamScanPosition += theHeaderByteSize;
+			mStreamFrameCRC = 0;
+			mStreamFrameCRCByteSize = 0;
+		}
+		else
+		{
+			// a sync code in the middle of the frame's data
+			++mStreamScanPosition;
+		}
+	}
+	
+	if (!mStreamInFrame && (mStreamScanPosition > mStreamFrameStart))
+	{
+		// none of what's been looked through is part of a frame, so there's no need to keep it around
+		memmove(mInputBuffer + mStreamFrameStart, mInputBuffer + mStreamScanPosition, mInputBufferBytesUsed - mStreamScanPosition);
+		mInputBufferBytesUsed -= mStreamScanPosition - mStreamFrameStart;
+		mStreamScanPosition = mStreamFrameStart;
+		mStreamSkipping = true;
+	}
+	
+	if (inEndOfStream)
+	{
+		// the last frame ends where the stream does, if it's all there
+		UInt32 theFrameByteSize = mInputBufferBytesUsed - mStreamFrameStart;
+		
+		if (mStreamInFrame && StreamFrameCRCMatches(theFrameByteSize))
+		{
+			mPacketSizes.push_back(theFrameByteSize);
+		}
+		else if (mStreamInFrame || mStreamSkipping)
+		{
+			mInputBufferBytesUsed = mStreamFrameStart;
+			++mDesyncCount;
+		}
+		mStreamFrameStart = mStreamScanPosition = mInputBufferBytesUsed;
+		mStreamInFrame = false;
+		mStreamSkipping = false;
+	}
+}
+
+void ACFLACDecoder::ResetStreamFrames()
+{
+	mStreamFrameStart = 0;
+	mStreamScanPosition = 0;
+	mStreamInFrame = false;
+	mStreamFrameCRC = 0;
+	mStreamFrameCRCByteSize = 0;
+	mStreamSkipping = false;
+}
+
+// The size of a frame header at inData, the CRC-8 at its end included, or 0 if what's there isn't one.
+// outComplete is false when there aren't enough bytes to tell yet.
+UInt32 ACFLACDecoder::GetFrameHeaderByteSize(const Byte * inData, UInt32 inByteSize, bool & outComplete)
+{
+	outComplete = true;
+	
+	// the sync code, a reserved 0 bit and the blocking strategy
+	if ( (inByteSize > 0) && (inData[0] != 0xFF) )
+	{
+		return 0;
+	}
+	if ( (inByteSize > 1) && ((inData[1] & 0xFE) != 0xF8) )
+	{
+		return 0;
+	}
+	if (inByteSize < 5)
+	{
+		outComplete = false;
+		return 0;
+	}
+	
+	// block size, sample rate, channel assignment and sample size, leaving out the reserved values
+	UInt32 theBlockSizeCode = inData[2] >> 4;
+	UInt32 theSampleRateCode = inData[2] & 0x0F;
+	UInt32 theChannelAssignment = inData[3] >> 4;
+	UInt32 theSampleSizeCode = (inData[3] >> 1) & 0x07;
+	if ( (theBlockSizeCode == 0) || (theSampleRateCode == 15) || (theChannelAssignment > 10) ||
+		 (theSampleSizeCode == 3) || (theSampleSizeCode == 7) || ((inData[3] & 0x01) != 0) )
+	{
+		return 0;
+	}
+	
+	// the frame or sample number, UTF-8 style in 1 to 7 bytes
+	UInt32 theNumberByteSize = 1;
+	if ((inData[4] & 0x80) != 0)
+	{
+		if ( ((inData[4] & 0xC0) == 0x80) || (inData[4] == 0xFF) )
+		{
+			return 0;
+		}
+		while ((inData[4] & (0x80 >> theNumberByteSize)) != 0)
+		{
+			++theNumberByteSize;
+		}
+	}
+	
+	UInt32 theHeaderByteSize = 4 + theNumberByteSize;
+	theHeaderByteSize += (theBlockSizeCode == 6) ? 1 : (theBlockSizeCode == 7) ? 2 : 0;
+	theHeaderByteSize += (theSampleRateCode == 12) ? 1 : ((theSampleRateCode == 13) || (theSampleRateCode == 14)) ? 2 : 0;
+	if (inByteSize < theHeaderByteSize + 1)
+	{
+		outComplete = false;
+		return 0;
+	}
+	for (UInt32 i = 5; i < 4 + theNumberByteSize; ++i)
+	{
+		if ((inData[i] & 0xC0) != 0x80)
+		{
+			return 0;
+		}
+	}
+	if (FLAC__crc8(inData, theHeaderByteSize) != inData[theHeaderByteSize])
+	{
+		return 0;
+	}
+	return theHeaderByteSize + 1;
+}
+
+// The last 2 bytes of a frame are the CRC-16 of the rest of it. The frame at mStreamFrameStart only
+// ever gets longer while it's being looked through, so the CRC picks up where the last call left off.
+bool ACFLACDecoder::StreamFrameCRCMatches(UInt32 inFrameByteSize)
+{
+	const Byte * theFrame = mInputBuffer + mStreamFrameStart;
+	
+	if (inFrameByteSize < 2)
+	{
+		return false;
+	}
+	if (mStreamFrameCRCByteSize > inFrameByteSize - 2)
+	{
+		mStreamFrameCRC = 0;
+		mStreamFrameCRCByteSize = 0;
+	}
+	for ( ; mStreamFrameCRCByteSize < inFrameByteSize - 2; ++mStreamFrameCRCByteSize)
+	{
+		mStreamFrameCRC = FLAC__CRC16_UPDATE(theFrame[mStreamFrameCRCByteSize], mStreamFrameCRC);
+	}
+	return mStreamFrameCRC == ((static_cast<UInt32>(theFrame[inFrameByteSize - 2]) << 8) | theFrame[inFrameByteSize - 1]);
+}
+
+// We decode as many packets as there are in the input buffer and room for in the output buffer
 UInt32	ACFLACDecoder::ProduceOutputPackets(void* outOutputData, UInt32& ioOutputDataByteSize, UInt32& ioNumberPackets, AudioStreamPacketDescription* outPacketDescription)
 {
 
@@ -614,12 +1220,24 @@ UInt32	ACFLACDecoder::ProduceOutputPackets(void* outOutputData, UInt32& ioOutput
 		CODEC_THROW(kAudioCodecStateError);
 	}
 	
+	// the last call stopped at a packet that failed so it could hand back what came before it
+	if (mFailurePending)
+	{
+		mFailurePending = false;
+		ioOutputDataByteSize = 0;
+		ioNumberPackets = 0;
+		return kAudioCodecProduceOutputPacketFailure;
+	}
+	
 	//	Note that the decoder doesn't suffer from the same problem the encoder
 	//	does with not having enough data for a packet, since the encoded data
 	//	is always going to be in whole packets.
 	
-	if(ioNumberPackets > 0 && mPacketInInputBuffer)
+	if(ioNumberPackets > 0 && !mPacketSizes.empty())
 	{
+		// the most frames a packet can decode to -- a shorter one is the end of the stream
+		UInt32	theFramesPerPacket = mFramesPerPacket;
+		
 		//	make sure that there is enough space in the output buffer for the encoded data
 		//	it is an error to ask for more output than you pass in buffer space for
 		UInt32	theOutputByteSize = mStreamInfo.max_blocksize * mOutputFormat.mBytesPerFrame;
@@ -628,36 +1246,127 @@ UInt32	ACFLACDecoder::ProduceOutputPackets(void* outOutputData, UInt32& ioOutput
 	#endif
 		ThrowIf(ioOutputDataByteSize < theOutputByteSize, static_cast<ComponentResult>(kAudioCodecNotEnoughBufferSpaceError), "ACFLACDecoder::ProduceOutputPackets: not enough space in the output buffer");
 
-		// Process the packet
+		UInt32 theFramesRequested = ioNumberPackets;
+		UInt32 theFramesProduced = 0;
+		UInt32 theNumberPackets = mPacketSizes.size();
+		
+		// how many whole packets are sure to fit
+		if (theFramesRequested > ioOutputDataByteSize / mOutputFormat.mBytesPerFrame)
+		{
+			theFramesRequested = ioOutputDataByteSize / mOutputFormat.mBytesPerFrame;
+		}
+		if (theNumberPackets > theFramesRequested / theFramesPerPacket)
+		{
+			theNumberPackets = theFramesRequested / theFramesPerPacket;
+		}
+		// without a cookie there's no max_blocksize to check the buffer against above
+		ThrowIf(theNumberPackets == 0, static_cast<ComponentResult>(kAudioCodecNotEnoughBufferSpaceError), "ACFLACDecoder::ProduceOutputPackets: not enough space in the output buffer for a packet");
 		mOutputBufferPtr = reinterpret_cast<Byte*>(outOutputData);
-		mInputBufferBytesRead = 0; // reset this
-		if (FLAC__stream_decoder_process_single(mDecoder))
+		
+		if ( (mWorkerPool != NULL) && (theNumberPackets > 1) )
 		{
-			ioNumberPackets = mFramesDecoded;
-			ioOutputDataByteSize = mFramesDecoded * mOutputFormat.mBytesPerFrame;
-			mInputBufferBytesUsed = 0;
-			mPacketInInputBuffer = false;
-			if (mFramesDecoded != kFramesPerPacket)
+			theAnswer = DecodePacketsParallel(theNumberPackets, theFramesPerPacket, mOutputBufferPtr, theFramesProduced);
+		}
+		else
+		{
+			// Process the packets one at a time, as long as a whole one is sure to fit
+			while ( !mPacketSizes.empty() && (theFramesProduced + theFramesPerPacket <= theFramesRequested) )
 			{
-				FLAC__stream_decoder_flush(mDecoder); // may not be necessary
-				theAnswer = kAudioCodecProduceOutputPacketAtEOF;
+				mInputPacketEnd = mInputBufferBytesRead + mPacketSizes.front();
+				mFramesDecoded = 0;
+				mMaxFramesDecoded = theFramesRequested - theFramesProduced;
+				mPacketDesynced = false;
+				bool theStatus = FLAC__stream_decoder_process_single(mDecoder);
+				
+				// libFLAC has had this packet whether it used all of it or not
+				mInputBufferBytesRead = mInputPacketEnd;
+				mPacketSizes.pop_front();
+				if (!theStatus || mPacketDesynced || (mFramesDecoded == 0))
+				{
+					++mDesyncCount;
+				}
+				if (!theStatus && mTrustedSource)
+				{
+					// drop the packet and pick up again at the next one
+					FLAC__stream_decoder_flush(mDecoder);
+					continue;
+				}
+				if (!theStatus)
+				{
+					mDecoderState = FLAC__stream_decoder_get_state(mDecoder); // we'll do something with this eventually;
+					// so the decoder is ready for the packets after this one
+					FLAC__stream_decoder_flush(mDecoder);
+					// the packets decoded before this one go out now, and the failure with the next call
+					if (theFramesProduced > 0)
+					{
+						mFailurePending = true;
+					}
+					else
+					{
+						theAnswer = kAudioCodecProduceOutputPacketFailure;
+					}
+					break;
+				}
+				
+				theFramesProduced += mFramesDecoded;
+				mOutputBufferPtr += mFramesDecoded * mOutputFormat.mBytesPerFrame;
+				if (mFramesDecoded > 0 && mFramesDecoded < theFramesPerPacket)
+				{
+					FLAC__stream_decoder_flush(mDecoder); // may not be necessary
+					theAnswer = kAudioCodecProduceOutputPacketAtEOF;
+					break;
+				}
 			}
 		}
+		
+		mOutputBufferPtr = NULL;
+		
+		// after a seek, the frames of the first packet that come before the sample sought are dropped
+		if ( (mSeekPosition.mFramesToDiscard > 0) && (theFramesProduced > 0) )
+		{
+			UInt32 theFramesDiscarded = (theFramesProduced < mSeekPosition.mFramesToDiscard) ? theFramesProduced : mSeekPosition.mFramesToDiscard;
+			
+			theFramesProduced -= theFramesDiscarded;
+			memmove(outOutputData, reinterpret_cast<Byte*>(outOutputData) + theFramesDiscarded * mOutputFormat.mBytesPerFrame, theFramesProduced * mOutputFormat.mBytesPerFrame);
+			mSeekPosition.mFramesToDiscard -= theFramesDiscarded;
+		}
+		
+		// move what's left to the front of the input buffer, or when it's borrowed just move past what's been read
+		mInputBufferBytesUsed -= mInputBufferBytesRead;
+		if (mBorrowInput)
+		{
+			// and once it's all been read, the caller has it back
+			mInputBufferPtr = (mInputBufferBytesUsed > 0) ? mInputBufferPtr + mInputBufferBytesRead : NULL;
+		}
 		else
 		{
-			mDecoderState = FLAC__stream_decoder_get_state(mDecoder); // we'll do something with this eventually;
+			memmove(mInputBuffer, mInputBuffer + mInputBufferBytesRead, mInputBufferBytesUsed);
+			if (mStreamInput)
+			{
+				mStreamFrameStart -= mInputBufferBytesRead;
+				mStreamScanPosition -= mInputBufferBytesRead;
+			}
+		}
+		mInputBufferBytesRead = 0;
+		mInputPacketEnd = 0;
+		
+		if (theAnswer == kAudioCodecProduceOutputPacketFailure)
+		{
 			ioNumberPackets = 0;
-			theAnswer = kAudioCodecProduceOutputPacketFailure;
 			ioOutputDataByteSize = 0;
 		}
+		else
+		{
+			ioNumberPackets = theFramesProduced;
+			ioOutputDataByteSize = theFramesProduced * mOutputFormat.mBytesPerFrame;
+			if (theAnswer == kAudioCodecProduceOutputPacketSuccess && !mPacketSizes.empty())
+			{
+				theAnswer = kAudioCodecProduceOutputPacketSuccessHasMore;
+			}
+		}
 	#if VERBOSE	
-		printf("producing packet, ioOutputDataByteSize == %lu\n", ioOutputDataByteSize);
+		printf("producing packets, ioOutputDataByteSize == %lu\n", ioOutputDataByteSize);
 	#endif
-			//for (int i = 0; i < 32; ++i)
-			//{
-			//	printf ("%li ", ((SInt16 *)(outOutputData))[i]);
-			//}
-			//printf ("\n");
 	}
 	else
 	{
@@ -671,6 +1380,135 @@ UInt32	ACFLACDecoder::ProduceOutputPackets(void* outOutputData, UInt32& ioOutput
 
 }
 
+// Decodes inNumberPackets packets from the front of the input buffer across the worker pool. The PCM
+// ends up packed together at outOutputData, just as if the packets had been decoded one after another.
+UInt32 ACFLACDecoder::DecodePacketsParallel(UInt32 inNumberPackets, UInt32 inFramesPerPacket, Byte * outOutputData, UInt32 & outFramesProduced)
+{
+	UInt32 theAnswer = kAudioCodecProduceOutputPacketSuccess;
+	UInt32 thePacketByteSize = inFramesPerPacket * mOutputFormat.mBytesPerFrame;
+	UInt32 theNumberRanges = (inNumberPackets < mParallelRanges.size()) ? inNumberPackets : mParallelRanges.size();
+	UInt32 theFirstPacket = 0;
+	const Byte * theInputData = mInputBufferPtr + mInputBufferBytesRead;
+	
+	// the packets are dealt out as evenly as they go
+	for (UInt32 i = 0; i < theNumberRanges; ++i)
+	{
+		ParallelDecodeRange & theRange = mParallelRanges[i];
+		
+		theRange.mInputData = theInputData;
+		theRange.mFirstPacket = theFirstPacket;
+		theRange.mNumberPackets = inNumberPackets / theNumberRanges + ((i < inNumberPackets % theNumberRanges) ? 1 : 0);
+		theRange.mMaxFramesDecoded = inFramesPerPacket;
+		theRange.mFloatOutput = mFloatOutput;
+		for (UInt32 j = 0; j < theRange.mNumberPackets; ++j)
+		{
+			theInputData += mPacketSizes[theFirstPacket + j];
+		}
+		theFirstPacket += theRange.mNumberPackets;
+	}
+	
+	ParallelDecodeContext theContext;
+	theContext.mDecoder = this;
+	theContext.mOutputData = outOutputData;
+	theContext.mPacketByteSize = thePacketByteSize;
+	mWorkerPool->Run(ParallelDecodeTask, &theContext, theNumberRanges);
+	
+	// Each packet was decoded into a whole packet's worth of space. Only the last one of the stream can be
+	// short, but a packet that didn't decode at all leaves a gap, so the PCM gets moved down over any gaps.
+	UInt32 thePacketsDone = 0;
+	bool theDone = false;
+	
+	outFramesProduced = 0;
+	for (UInt32 i = 0; (i < theNumberRanges) && !theDone; ++i)
+	{
+		const ParallelDecodeRange & theRange = mParallelRanges[i];
+		
+		mDesyncCount += theRange.mDesyncCount;
+		for (UInt32 j = 0; (j < theRange.mPacketFrames.size()) && !theDone; ++j)
+		{
+			UInt32 theFramesDecoded = theRange.mPacketFrames[j];
+			Byte * thePacketData = outOutputData + (theRange.mFirstPacket + j) * thePacketByteSize;
+			Byte * theOutputData = outOutputData + outFramesProduced * mOutputFormat.mBytesPerFrame;
+			
+			if ( (theFramesDecoded > 0) && (thePacketData != theOutputData) )
+			{
+				memmove(theOutputData, thePacketData, theFramesDecoded * mOutputFormat.mBytesPerFrame);
+			}
+			outFramesProduced += theFramesDecoded;
+			++thePacketsDone;
+			if (theFramesDecoded > 0 && theFramesDecoded < inFramesPerPacket)
+			{
+				theAnswer = kAudioCodecProduceOutputPacketAtEOF;
+				theDone = true;
+			}
+		}
+		if (!theDone && !theRange.mSucceeded)
+		{
+			// the packet that failed is used up like any other, and as in the serial
+			// loop the packets decoded before it go out now and the failure with the next call
+			++thePacketsDone;
+			if (outFramesProduced > 0)
+			{
+				mFailurePending = true;
+			}
+			else
+			{
+				theAnswer = kAudioCodecProduceOutputPacketFailure;
+			}
+			theDone = true;
+		}
+	}
+	
+	// the packets after the end of the stream or a failure stay where they are
+	for (UInt32 i = 0; i < thePacketsDone; ++i)
+	{
+		mInputBufferBytesRead += mPacketSizes.front();
+		mPacketSizes.pop_front();
+	}
+	return theAnswer;
+}
+
+// Runs on the worker pool -- none of this may touch anything but its own range
+void ACFLACDecoder::ParallelDecodeTask(void* inContext, UInt32 inTaskIndex)
+{
+	ParallelDecodeContext * theContext = static_cast<ParallelDecodeContext *>(inContext);
+	ACFLACDecoder * theDecoder = theContext->mDecoder;
+	ParallelDecodeRange & theRange = theDecoder->mParallelRanges[inTaskIndex];
+	
+	theRange.mInputBytesRead = 0;
+	theRange.mInputPacketEnd = 0;
+	theRange.mPacketFrames.clear();
+	theRange.mDesyncCount = 0;
+	theRange.mSucceeded = true;
+	for (UInt32 i = 0; i < theRange.mNumberPackets; ++i)
+	{
+		theRange.mInputPacketEnd += theDecoder->mPacketSizes[theRange.mFirstPacket + i];
+		theRange.mOutputData = theContext->mOutputData + (theRange.mFirstPacket + i) * theContext->mPacketByteSize;
+		theRange.mFramesDecoded = 0;
+		theRange.mPacketDesynced = false;
+		bool theStatus = FLAC__stream_decoder_process_single(theRange.mDecoder);
+		
+		theRange.mInputBytesRead = theRange.mInputPacketEnd;
+		if (!theStatus || theRange.mPacketDesynced || (theRange.mFramesDecoded == 0))
+		{
+			++theRange.mDesyncCount;
+		}
+		if (!theStatus)
+		{
+			// so the decoder is ready for the next call
+			FLAC__stream_decoder_flush(theRange.mDecoder);
+			if (!theDecoder->mTrustedSource)
+			{
+				theRange.mSucceeded = false;
+				break;
+			}
+			// from a trusted source it's dropped, like a packet that decoded to nothing
+			theRange.mFramesDecoded = 0;
+		}
+		theRange.mPacketFrames.push_back(theRange.mFramesDecoded);
+	}
+}
+
 UInt32	ACFLACDecoder::GetVersion() const
 {
 	return kFLACadecVersion;
@@ -678,7 +1516,8 @@ UInt32	ACFLACDecoder::GetVersion() const
 
 UInt32	ACFLACDecoder::GetInputBufferByteSize() const
 {
-	return kInputBufferPackets * kMaxChannels * sizeof(SInt32);
+	// until it's allocated, this is what Initialize would allocate for the current format
+	return (mInputBuffer != NULL) ? mInputBufferByteSize : CalculateInputBufferByteSize();
 }
 
 UInt32	ACFLACDecoder::GetUsedInputBufferByteSize() const
@@ -688,6 +1527,47 @@ UInt32	ACFLACDecoder::GetUsedInputBufferByteSize() const
 
 void ACFLACDecoder::ReallocateInputBuffer(UInt32 inInputBufferByteSize)
 {
+	// the format might not be settled yet, so the buffer waits for Initialize
+	mRequestedInputBufferByteSize = inInputBufferByteSize;
+	if (mIsInitialized)
+	{
+		AllocateInputBuffer();
+	}
+}
+
+// The largest packet the format allows for -- that's the samples stored verbatim, plus at most
+// 16 bytes of frame header, a byte of header for each subframe and the 2 byte CRC
+UInt32 ACFLACDecoder::GetMaxPacketByteSize() const
+{
+	return mFramesPerPacket * mInputFormat.mChannelsPerFrame * ((mOutputFormat.mBitsPerChannel + 7) >> 3) + 16 + mInputFormat.mChannelsPerFrame + 2;
+}
+
+// What the caller asked for, but never less than mInputBufferPackets of the largest packet for each
+// decoder. Stream input needs room for the header after a frame as well before it knows the frame is whole.
+UInt32 ACFLACDecoder::CalculateInputBufferByteSize() const
+{
+	UInt32 theNumberDecoders = mParallelRanges.empty() ? 1 : mParallelRanges.size();
+	UInt32 theMinimumByteSize = theNumberDecoders * mInputBufferPackets * GetMaxPacketByteSize() + (mStreamInput ? 16 : 0);
+	
+	return (mRequestedInputBufferByteSize > theMinimumByteSize) ? mRequestedInputBufferByteSize : theMinimumByteSize;
+}
+
+void ACFLACDecoder::AllocateInputBuffer()
+{
+	delete[] mInputBuffer;
+	mInputBuffer = NULL;
+	mInputBufferByteSize = 0;
+	if (!mBorrowInput)
+	{
+		mInputBufferByteSize = CalculateInputBufferByteSize();
+		mInputBuffer = new Byte[mInputBufferByteSize];
+	}
+	mInputBufferPtr = mInputBuffer;
+	mInputBufferBytesUsed = 0;
+	mInputBufferBytesRead = 0;
+	mInputPacketEnd = 0;
+	mPacketSizes.clear();
+	ResetStreamFrames();
 }
 
 void ACFLACDecoder::Uninitialize()
@@ -698,37 +1578,80 @@ void ACFLACDecoder::Uninitialize()
 	}
 	mDecoderState = FLAC__stream_decoder_get_state(mDecoder);
 	mInputBufferBytesUsed = 0;
-	mPacketInInputBuffer = false;
+	mInputBufferBytesRead = 0;
+	mInputPacketEnd = 0;
+	mPacketSizes.clear();
 	mFramesDecoded = 0;
+	// the buffers go until the next Initialize
+	delete[] mInputBuffer;
+	mInputBuffer = NULL;
+	mInputBufferByteSize = 0;
+	mInputBufferPtr = NULL;
+	if (mWorkerPool != NULL)
+	{
+		delete mWorkerPool;
+		mWorkerPool = NULL;
+		for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+		{
+			FLAC__stream_decoder_delete(mParallelRanges[i].mDecoder);
+		}
+		std::vector<ParallelDecodeRange>().swap(mParallelRanges);
+	}
 	ACFLACCodec::Uninitialize();
 }
 
+UInt32 ACFLACDecoder::GetMemoryFootprint() const
+{
+	UInt32 theByteSize = sizeof(*this) + mInputBufferByteSize;
+	
+	theByteSize += mPacketSizes.size() * sizeof(UInt32);
+	theByteSize += mSeekIndex.capacity() * sizeof(FLAC__StreamMetadata_SeekPoint);
+	theByteSize += mParallelRanges.capacity() * sizeof(ParallelDecodeRange);
+	for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+	{
+		theByteSize += mParallelRanges[i].mPacketFrames.capacity() * sizeof(UInt32);
+	}
+	return theByteSize;
+}
+
 void ACFLACDecoder::Reset()
 {
+	mInputBufferPtr = mInputBuffer;
 	mInputBufferBytesUsed = 0;
-	mPacketInInputBuffer = false;
+	mInputBufferBytesRead = 0;
+	mInputPacketEnd = 0;
+	mPacketSizes.clear();
 	mFramesDecoded = 0;
+	ResetStreamFrames();
+	mDesyncCount = 0;
+	mFailurePending = false;
+	mSeekPosition.mFramesToDiscard = 0;
 	FLAC__stream_decoder_reset(mDecoder);
 	mDecoderState = FLAC__stream_decoder_get_state(mDecoder);
+	for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+	{
+		FLAC__stream_decoder_reset(mParallelRanges[i].mDecoder);
+	}
 	ACFLACCodec::Reset();
 }
 
 FLAC__StreamDecoderReadStatus ACFLACDecoder::stream_decoder_read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
 {
+	ACFLACDecoder * theDecoder = static_cast<ACFLACDecoder *>(client_data);
 	const unsigned requested_bytes = *bytes;
 
-	(void)decoder, (void)client_data;
+	(void)decoder;
 
 	if(requested_bytes > 0)
 	{
-		if (requested_bytes <= mInputBufferBytesUsed - mInputBufferBytesRead)
+		if (requested_bytes <= theDecoder->mInputPacketEnd - theDecoder->mInputBufferBytesRead)
 		{
-			memcpy(buffer, mInputBufferPtr + mInputBufferBytesRead, requested_bytes);
+			memcpy(buffer, theDecoder->mInputBufferPtr + theDecoder->mInputBufferBytesRead, requested_bytes);
 		}
 		else
 		{
-			*bytes = mInputBufferBytesUsed - mInputBufferBytesRead;
-			memcpy(buffer, mInputBufferPtr + mInputBufferBytesRead, mInputBufferBytesUsed);
+			*bytes = theDecoder->mInputPacketEnd - theDecoder->mInputBufferBytesRead;
+			memcpy(buffer, theDecoder->mInputBufferPtr + theDecoder->mInputBufferBytesRead, *bytes);
 		}
 		if(*bytes == 0)
 		{
@@ -742,7 +1665,7 @@ FLAC__StreamDecoderReadStatus ACFLACDecoder::stream_decoder_read_callback(const
 		#if VERBOSE
 			printf("Read: FLAC__STREAM_DECODER_READ_STATUS_CONTINUE\n");
 		#endif
-			mInputBufferBytesRead += *bytes;
+			theDecoder->mInputBufferBytesRead += *bytes;
 			return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
 		}
 	}
@@ -757,43 +1680,103 @@ FLAC__StreamDecoderReadStatus ACFLACDecoder::stream_decoder_read_callback(const
 
 FLAC__StreamDecoderWriteStatus ACFLACDecoder::stream_decoder_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
-	(void)decoder, (void)client_data;
+	ACFLACDecoder * theDecoder = static_cast<ACFLACDecoder *>(client_data);
+
+	(void)decoder;
+
+	// the frame has to fit in what's left of the output buffer
+	if (frame->header.blocksize > theDecoder->mMaxFramesDecoded)
+	{
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+	WriteFrame(frame, buffer, theDecoder->mFloatOutput, theDecoder->mOutputBufferPtr);
+	theDecoder->mFramesDecoded = frame->header.blocksize;
 
-	// deinterleave and convert 32-bit ints to 16-bit ints
-	SInt16 * tempBuffer = (SInt16 *)mOutputBufferPtr;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+// Interleaves a decoded frame into the output buffer at the output bit depth, or as floats
+void ACFLACDecoder::WriteFrame(const FLAC__Frame *frame, const FLAC__int32 * const buffer[], bool inFloat, Byte * outOutputData)
+{
 #if VERBOSE
 	printf ("frame->header.channels * frame->header.blocksize == %lu\n", frame->header.channels * frame->header.blocksize);
 #endif
-	if(frame->header.bits_per_sample == 16)
+	switch (frame->header.channels)
 	{
-		for (unsigned int i = 0; i < frame->header.blocksize; ++i)
-		{
-			for (unsigned int j = 0; j < frame->header.channels; ++j)
-			{
-				tempBuffer[i * frame->header.channels + j] = (SInt16)((buffer[j])[i]);
-			}
-		}
+		case 1:
+			InterleaveFrame<1>(buffer, frame->header.blocksize, frame->header.bits_per_sample, inFloat, outOutputData);
+			break;
+		case 2:
+			InterleaveFrame<2>(buffer, frame->header.blocksize, frame->header.bits_per_sample, inFloat, outOutputData);
+			break;
+		case 3:
+			InterleaveFrame<3>(buffer, frame->header.blocksize, frame->header.bits_per_sample, inFloat, outOutputData);
+			break;
+		case 4:
+			InterleaveFrame<4>(buffer, frame->header.blocksize, frame->header.bits_per_sample, inFloat, outOutputData);
+			break;
+		case 5:
+			InterleaveFrame<5>(buffer, frame->header.blocksize, frame->header.bits_per_sample, inFloat, outOutputData);
+			break;
+		case 6:
+			InterleaveFrame<6>(buffer, frame->header.blocksize, frame->header.bits_per_sample, inFloat, outOutputData);
+			break;
+		case 7:
+			InterleaveFrame<7>(buffer, frame->header.blocksize, frame->header.bits_per_sample, inFloat, outOutputData);
+			break;
+		default: // FLAC tops out at 8
+			InterleaveFrame<8>(buffer, frame->header.blocksize, frame->header.bits_per_sample, inFloat, outOutputData);
+			break;
 	}
-	else // 24
+}
+
+FLAC__StreamDecoderReadStatus ACFLACDecoder::parallel_decoder_read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	ParallelDecodeRange * theRange = static_cast<ParallelDecodeRange *>(client_data);
+
+	(void)decoder;
+
+	// like stream_decoder_read_callback, but never past the end of the packet being decoded
+	if (*bytes > theRange->mInputPacketEnd - theRange->mInputBytesRead)
 	{
-		for (unsigned int i = 0; i < frame->header.blocksize; ++i)
-		{
-			for (unsigned int j = 0; j < frame->header.channels; ++j)
-			{
-				mOutputBufferPtr[3 * (i * frame->header.channels + j)] = ((buffer[j][i]) >> 16) & 0xff ;
-				mOutputBufferPtr[3 * (i * frame->header.channels + j) + 1] = ((buffer[j][i]) >> 8) & 0xff ;
-				mOutputBufferPtr[3 * (i * frame->header.channels + j) + 2] = (buffer[j][i]) & 0xff ;
-			}
-		}
+		*bytes = theRange->mInputPacketEnd - theRange->mInputBytesRead;
+	}
+	if (*bytes == 0)
+	{
+		return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
 	}
-	mFramesDecoded = frame->header.blocksize;
+	memcpy(buffer, theRange->mInputData + theRange->mInputBytesRead, *bytes);
+	theRange->mInputBytesRead += *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderWriteStatus ACFLACDecoder::parallel_decoder_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	ParallelDecodeRange * theRange = static_cast<ParallelDecodeRange *>(client_data);
+
+	(void)decoder;
+
+	// a packet only has room for so many frames
+	if (frame->header.blocksize > theRange->mMaxFramesDecoded)
+	{
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+	WriteFrame(frame, buffer, theRange->mFloatOutput, theRange->mOutputData);
+	theRange->mFramesDecoded = frame->header.blocksize;
 
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
+// A frame with an error doesn't get written, which shows up as a packet with no frames
+void ACFLACDecoder::parallel_decoder_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	(void)decoder, (void)status;
+	static_cast<ParallelDecodeRange *>(client_data)->mPacketDesynced = true;
+}
+
 void ACFLACDecoder::stream_decoder_metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data)
 {
-	stream_decoder_client_data_struct *dcd = (stream_decoder_client_data_struct*)client_data;
+	stream_decoder_client_data_struct *dcd = (0 != client_data) ? &(static_cast<ACFLACDecoder *>(client_data)->mClientDataStruct) : 0;
 
 	(void)decoder;
 
@@ -832,7 +1815,7 @@ void ACFLACDecoder::stream_decoder_metadata_callback(const FLAC__StreamDecoder *
 
 void ACFLACDecoder::stream_decoder_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
 {
-	stream_decoder_client_data_struct *dcd = (stream_decoder_client_data_struct*)client_data;
+	stream_decoder_client_data_struct *dcd = (0 != client_data) ? &(static_cast<ACFLACDecoder *>(client_data)->mClientDataStruct) : 0;
 
 	(void)decoder;
 
@@ -843,6 +1826,7 @@ void ACFLACDecoder::stream_decoder_error_callback(const FLAC__StreamDecoder *dec
 	#endif
 			return;
 	}
+	static_cast<ACFLACDecoder *>(client_data)->mPacketDesynced = true;
 
 	if(!dcd->ignore_errors)
 	{
@@ -51,6 +51,10 @@
 
 #include "ACFLACCodec.h"
 #include "stream_decoder.h"
+#include <deque>
+#include <vector>
+
+class ACWorkerPool;
 
 typedef struct {
 	FILE *file;
@@ -62,10 +66,68 @@ typedef struct {
 typedef stream_decoder_client_data_struct seekable_stream_decoder_client_data_struct;
 typedef stream_decoder_client_data_struct file_decoder_client_data_struct;
 
+//	Private properties
+enum
+{
+	//	UInt32, the number of threads used to decode. 0 or 1 (the default) decodes
+	//	everything on the calling thread with one libFLAC decoder. Otherwise, when
+	//	there are several packets to decode in one call, each thread gets a run of
+	//	them and a decoder of its own. The input buffer is grown to hold a packet
+	//	for every thread, but callers will want to grow it further with
+	//	kAudioCodecPropertyInputBufferSize. Only settable while uninitialized.
+	kFLACDecoderPropertyDecodeThreadCount = 'dthr',
+	
+	//	UInt32, non-zero when the packets come from a source that already vouches for them, like
+	//	an archive that keeps checksums of its own. Metadata blocks are skipped over rather than
+	//	handed to us, the MD5 isn't checked, and a packet that won't decode is counted in
+	//	kFLACDecoderPropertyDesyncCount and dropped instead of failing ProduceOutputPackets.
+	//	Only settable while uninitialized.
+	kFLACDecoderPropertyTrustedSource = 'dtru',
+	
+	//	UInt32, read only. The packets since Initialize or Reset that lost sync, failed a check
+	//	or didn't decode to any frames.
+	kFLACDecoderPropertyDesyncCount = 'ddsc',
+	
+	//	An array of FLAC__StreamMetadata_SeekPoint, one for each packet of the stream in order, such as
+	//	kFLACEncoderPropertySeekIndex produces. It's what kFLACDecoderPropertySeekToSample goes by.
+	kFLACDecoderPropertySeekIndex = 'sidx',
+	
+	//	UInt64, only settable while initialized. Drops whatever input is waiting and looks up the
+	//	packet holding the sample in the seek index. The caller then appends packets starting with
+	//	the one kFLACDecoderPropertySeekPosition gives, and the output starts at the sample.
+	kFLACDecoderPropertySeekToSample = 'seek',
+	
+	//	A FLACSeekPosition, read only -- where the last seek landed
+	kFLACDecoderPropertySeekPosition = 'spos',
+	
+	//	UInt32, non-zero to have libFLAC read the packets straight out of the caller's memory rather
+	//	than out of a copy in the input buffer. What's given to AppendInputData has to stay put until
+	//	ProduceOutputPackets has used all of it (GetUsedInputBufferByteSize is back to 0), and until
+	//	then AppendInputData takes nothing more. Packets are only taken as long as each starts where
+	//	the last one ended. Only settable while uninitialized.
+	kFLACDecoderPropertyBorrowInput = 'dbrw',
+	
+	//	UInt32, non-zero to have AppendInputData take the stream as plain bytes in chunks of any size,
+	//	packet descriptions or not. The decoder finds the frames itself: a frame is ready to decode once
+	//	the next frame's header has arrived and the frame's CRC checks out. An append of 0 bytes marks
+	//	the end of the stream and lets the last frame go. Bytes that aren't part of a frame are skipped
+	//	and counted in kFLACDecoderPropertyDesyncCount. Stream input is always copied, so it overrides
+	//	kFLACDecoderPropertyBorrowInput. Only settable while uninitialized.
+	kFLACDecoderPropertyStreamInput = 'dstr'
+};
+
+struct FLACSeekPosition
+{
+	UInt64	mSampleNumber;		// the sample sought
+	UInt64	mPacketNumber;		// the packet to append first
+	UInt64	mByteOffset;		// where that packet starts, from the seek index
+	UInt32	mFramesToDiscard;	// the frames of it that come before the sample and still have to be dropped
+};
+
 //=============================================================================
 //	ACFLACDecoder
 //
-//	This class decodes Apples Lossless data into 16 bit signed integer.
+//	This class decodes FLAC data into signed integers or Core Audio floats.
 //=============================================================================
 
 class ACFLACDecoder
@@ -105,27 +167,102 @@ public:
 
 //	Implementation
 private:
+	UInt32			CalculateInputBufferByteSize() const;
+	void			AllocateInputBuffer();
+	virtual UInt32	GetMemoryFootprint() const;
+	static void		WriteFrame(const FLAC__Frame *frame, const FLAC__int32 * const buffer[], bool inFloat, Byte * outOutputData);
 
-	// decoding buffers
-#if TARGET_CPU_PPC || TARGET_CPU_PPC64
-	Byte mInputBuffer[kInputBufferPackets * kMaxChannels * sizeof(SInt32)] __attribute__ ((aligned (16)));
-#else
-	Byte mInputBuffer[kInputBufferPackets * kMaxChannels * sizeof(SInt32)];
-#endif
+	// Parallel decoding
+	//
+	// FLAC frames decode independently of each other, so when a call has several packets to decode they are
+	// split into runs, each decoded by a libFLAC decoder of its own. Every packet but the last of the stream
+	// decodes to the same number of frames, which tells each packet where its PCM goes in the output buffer.
+	struct ParallelDecodeRange
+	{
+		FLAC__StreamDecoder *	mDecoder;
+		const Byte *			mInputData;
+		UInt32					mInputBytesRead;
+		UInt32					mInputPacketEnd;
+		UInt32					mFirstPacket;
+		UInt32					mNumberPackets;
+		Byte *					mOutputData;
+		UInt32					mMaxFramesDecoded;
+		bool					mFloatOutput;
+		UInt32					mFramesDecoded;
+		std::vector<UInt32>		mPacketFrames; // the frames each packet decoded to, up to the first one that failed
+		bool					mPacketDesynced;
+		UInt32					mDesyncCount;
+		bool					mSucceeded;
+	};
+	
+	struct ParallelDecodeContext
+	{
+		ACFLACDecoder *			mDecoder;
+		Byte *					mOutputData;
+		UInt32					mPacketByteSize;
+	};
+	
+	UInt32			DecodePacketsParallel(UInt32 inNumberPackets, UInt32 inFramesPerPacket, Byte * outOutputData, UInt32 & outFramesProduced);
+	static void		ParallelDecodeTask(void* inContext, UInt32 inTaskIndex);
+	static FLAC__StreamDecoderReadStatus parallel_decoder_read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
+	static FLAC__StreamDecoderWriteStatus parallel_decoder_write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
+	static void parallel_decoder_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+	void			ConfigureDecoder(FLAC__StreamDecoder * inDecoder);
+	void			SeekToSample(UInt64 inSampleNumber);
+	void			BorrowInputData(const void* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets, const AudioStreamPacketDescription* inPacketDescription);
+	void			AppendStreamData(const void* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets);
+	void			FindStreamFrames(bool inEndOfStream);
+	void			ResetStreamFrames();
+	UInt32			GetMaxPacketByteSize() const;
+	static UInt32	GetFrameHeaderByteSize(const Byte * inData, UInt32 inByteSize, bool & outComplete);
+	bool			StreamFrameCRCMatches(UInt32 inFrameByteSize);
 
-	// We need a "global" pointer for the both the input and the output data callback
-	static Byte * mOutputBufferPtr;
-	static Byte * mInputBufferPtr;
-	static UInt32 mInputBufferBytesUsed;
-	static UInt32 mFramesDecoded;
-	static UInt32 mInputBufferBytesRead;
+	// decoding buffers -- sized for the format in Initialize and freed in Uninitialize, there's
+	// no input buffer when the input is borrowed
+	Byte * mInputBuffer;
+	UInt32 mInputBufferByteSize;
+	UInt32 mRequestedInputBufferByteSize; // 0 for the smallest that works
+
+	// The input and output data callbacks find these through their client data
+	Byte * mOutputBufferPtr;
+	const Byte * mInputBufferPtr; // mInputBuffer, or the caller's packets when they're borrowed
+	UInt32 mInputBufferBytesUsed;
+	UInt32 mFramesDecoded;
+	UInt32 mMaxFramesDecoded; // the room left in the output buffer, a frame that doesn't fit is an error
+	UInt32 mInputBufferBytesRead;
+	UInt32 mInputPacketEnd; // the read call back doesn't go past the end of the packet being decoded
+	bool mFloatOutput; // Core Audio floats rather than ints at the source's bit depth
+	bool mTrustedSource;
+	bool mBorrowInput;
+	bool mStreamInput;
+	bool mPacketDesynced; // the error call back saw something wrong with the packet being decoded
+	UInt32 mDesyncCount;
+	bool mFailurePending; // a packet failed after others in the same call had decoded, the next call reports it
+	
+	// seeking
+	std::vector<FLAC__StreamMetadata_SeekPoint> mSeekIndex;
+	FLACSeekPosition mSeekPosition;
+	
+	// finding the frames in stream input -- mPacketSizes has the frames found so far, and what
+	// comes after them, from mStreamFrameStart on, is still being looked through
+	UInt32 mStreamFrameStart;
+	UInt32 mStreamScanPosition; // where to look for the next frame header
+	bool mStreamInFrame; // mStreamFrameStart is the start of a frame header
+	UInt32 mStreamFrameCRC; // the CRC-16 of the frame's first mStreamFrameCRCByteSize bytes
+	UInt32 mStreamFrameCRCByteSize;
+	bool mStreamSkipping; // bytes that aren't part of any frame have been dropped since the last frame
 
 	FLAC__StreamDecoder * mDecoder;
 	FLAC__StreamDecoderState mDecoderState;
 
 	// decoding parameters
-	bool mPacketInInputBuffer;
+	std::deque<UInt32> mPacketSizes; // the packets in mInputBuffer that haven't been decoded yet, oldest first
 	stream_decoder_client_data_struct mClientDataStruct;
+	
+	// parallel decoding state
+	UInt32					mDecodeThreadCount;
+	ACWorkerPool *			mWorkerPool;
+	std::vector<ParallelDecodeRange>	mParallelRanges;
 };
 
 #endif
@@ -54,6 +54,10 @@
 #include "CASampleTools.h"
 #include "CADebugMacros.h"
 #include "CABundleLocker.h"
+#include "ACWorkerPool.h"
+#include "private/crc.h"
+#include "ACFLACSampleConversion.h"
+#include <sys/time.h>
 
 #if TARGET_OS_WIN32
 	#include "CAWin32StringResources.h"
@@ -97,18 +101,21 @@ static const UInt32	sChannelMaps[kFLACMaxChannels] =
 
 #define kFLACMaxCompressionQuality 8
 
+// the block sizes offered in the settings dictionary
+static const UInt32 kFLACBlockSizes[] = { 192, 576, 1152, 2304, 4608, 8192, 16384 };
+
+// how many packets the offloaded MD5 can fall behind by
+#define kFLACMD5QueuePackets 4
+
 #define VERBOSE 0 // This will spit out an amazing amout of stuff -- it wouldn't hurt to split this up a bit
+
 //=============================================================================
 //	ACFLACEncoder
 //=============================================================================
 
-// static data members
-UInt32	ACFLACEncoder::mOutputBytes = 0;
-Byte * ACFLACEncoder::mOutputBuffer = NULL;
-
 ACFLACEncoder::ACFLACEncoder(OSType theSubType)
 :
-	ACFLACCodec(kInputBufferPackets * kFramesPerPacket * sizeof(SInt16), theSubType)
+	ACFLACCodec(kInputBufferPackets, theSubType)
 {	
 	//	This encoder only accepts (16- or 24-bit) native endian signed integers as it's input,
 	//	but can handle any sample rate and any number of channels
@@ -158,20 +165,40 @@ ACFLACEncoder::ACFLACEncoder(OSType theSubType)
 	mSupportedChannelTotals[6] = 7;
 	mSupportedChannelTotals[7] = 8;
 	
-	mPacketInInputBuffer = false;
-
 	mFormat = 0;
 
 	mTotalBytesGenerated = 0;
+	mOutputBytes = 0;
+	mOutputBuffer = NULL;
+	mOutputBufferByteSize = 0;
+	mOutputPacketDescriptions = NULL;
+	mMaxOutputPackets = 0;
+	mNumberOutputPackets = 0;
 	
 	mQuality = 0; // Compression Quality
+	mCompressionLevel = 0;
+	mAdaptiveCPUBudget = 0.0;
+	mMD5Mode = kFLACMD5Inline;
+	mMD5Pipeline = NULL;
+	mInputBuffer = NULL;
+	mInputBufferByteSize = 0;
 	mInputBufferBytesUsed = 0;
+	mRequestedInputBufferByteSize = 0;
 	mFlushPacket = false;
 	mFinished = false;
 	mTrailingFrames = 0;
 	mBitDepth = 16;
 	mEncoder = FLAC__stream_encoder_new();
 	mEncoderState = FLAC__stream_encoder_get_state(mEncoder);
+	
+	mEncodeThreadCount = 1;
+	mWorkerPool = NULL;
+	memset(&mMD5Context, 0, sizeof(FLAC__MD5Context));
+	mNextFrameNumber = 0;
+	mNextFrameOut = 0;
+	mSamplesEncoded = 0;
+	mMinFrameBytesEncoded = 0;
+	mMaxFrameBytesEncoded = 0;
 }
 
 ACFLACEncoder::~ACFLACEncoder()
@@ -181,6 +208,13 @@ ACFLACEncoder::~ACFLACEncoder()
 		FLAC__stream_encoder_delete(mEncoder);
 		mEncoder = NULL;
 	}
+	delete mWorkerPool;
+	for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+	{
+		FLAC__stream_encoder_delete(mParallelRanges[i].mEncoder);
+	}
+	delete mMD5Pipeline;
+	delete[] mInputBuffer;
 }
 
 void	ACFLACEncoder::GetPropertyInfo(AudioCodecPropertyID inPropertyID, UInt32& outPropertyDataSize, Boolean& outWritable)
@@ -211,12 +245,37 @@ void	ACFLACEncoder::GetPropertyInfo(AudioCodecPropertyID inPropertyID, UInt32& o
 			outPropertyDataSize = sizeof(UInt32);
 			outWritable = false;
 			break;
+
+		case kAudioCodecPropertyPacketFrameSize:
+			outPropertyDataSize = sizeof(UInt32);
+			outWritable = !mIsInitialized;
+			break;
 		
 		case kAudioCodecPropertySettings:
 			outPropertyDataSize = sizeof(CFDictionaryRef *);
 			outWritable = true;
 			break;
 		
+		case kFLACEncoderPropertyEncodeThreadCount:
+			outPropertyDataSize = sizeof(UInt32);
+			outWritable = true;
+			break;
+		
+		case kFLACEncoderPropertyAdaptiveCPUBudget:
+			outPropertyDataSize = sizeof(Float64);
+			outWritable = !mIsInitialized;
+			break;
+		
+		case kFLACEncoderPropertyCompressionLevelHistory:
+			outPropertyDataSize = mCompressionLevelHistory.size() * sizeof(FLACCompressionLevelChange);
+			outWritable = false;
+			break;
+		
+		case kFLACEncoderPropertySeekIndex:
+			outPropertyDataSize = mSeekIndex.size() * sizeof(FLAC__StreamMetadata_SeekPoint);
+			outWritable = false;
+			break;
+		
 		default:
 			ACFLACCodec::GetPropertyInfo(inPropertyID, outPropertyDataSize, outWritable);
 			break;
@@ -318,7 +377,7 @@ void	ACFLACEncoder::GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPro
 				}
 				else // default case
 				{
-					*reinterpret_cast<UInt32*>(outPropertyData) = mMaxFrameBytes = kInputBufferPackets * mOutputFormat.mChannelsPerFrame * (mBitDepth >> 3) + kMaxEscapeHeaderBytes;
+					*reinterpret_cast<UInt32*>(outPropertyData) = mMaxFrameBytes = mFramesPerPacket * mOutputFormat.mChannelsPerFrame * (mBitDepth >> 3) + kMaxEscapeHeaderBytes;
 				}
 			#if VERBOSE
 				printf("Max packet size == %lu, mBitDepth == %lu\n", mMaxFrameBytes, mBitDepth);
@@ -403,6 +462,60 @@ void	ACFLACEncoder::GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPro
 			}
 			break;
 
+		case kFLACEncoderPropertyEncodeThreadCount:
+  			if(ioPropertyDataSize == sizeof(UInt32))
+			{
+				*reinterpret_cast<UInt32*>(outPropertyData) = mEncodeThreadCount;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+
+		case kFLACEncoderPropertyAdaptiveCPUBudget:
+  			if(ioPropertyDataSize == sizeof(Float64))
+			{
+				*reinterpret_cast<Float64*>(outPropertyData) = mAdaptiveCPUBudget;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+
+		case kFLACEncoderPropertyCompressionLevelHistory:
+		{
+			// as many whole entries as fit
+			UInt32 theNumberEntries = ioPropertyDataSize / sizeof(FLACCompressionLevelChange);
+			if (theNumberEntries > mCompressionLevelHistory.size())
+			{
+				theNumberEntries = mCompressionLevelHistory.size();
+			}
+			ioPropertyDataSize = theNumberEntries * sizeof(FLACCompressionLevelChange);
+			if (theNumberEntries > 0)
+			{
+				memcpy(outPropertyData, &mCompressionLevelHistory[0], ioPropertyDataSize);
+			}
+			break;
+		}
+
+		case kFLACEncoderPropertySeekIndex:
+		{
+			// as many whole seek points as fit
+			UInt32 theNumberPoints = ioPropertyDataSize / sizeof(FLAC__StreamMetadata_SeekPoint);
+			if (theNumberPoints > mSeekIndex.size())
+			{
+				theNumberPoints = mSeekIndex.size();
+			}
+			ioPropertyDataSize = theNumberPoints * sizeof(FLAC__StreamMetadata_SeekPoint);
+			if (theNumberPoints > 0)
+			{
+				memcpy(outPropertyData, &mSeekIndex[0], ioPropertyDataSize);
+			}
+			break;
+		}
+
 		default:
 			ACFLACCodec::GetProperty(inPropertyID, ioPropertyDataSize, outPropertyData);
 	}
@@ -455,9 +568,61 @@ void ACFLACEncoder::SetProperty(AudioCodecPropertyID inPropertyID, UInt32 inProp
 			}
 			break;
 
+		case kFLACEncoderPropertyEncodeThreadCount:
+			if(mIsInitialized)
+			{
+				CODEC_THROW(kAudioCodecIllegalOperationError);
+			}
+			if(inPropertyDataSize == sizeof(UInt32))
+			{
+				mEncodeThreadCount = *reinterpret_cast<const UInt32*>(inPropertyData);
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+
+		case kFLACEncoderPropertyAdaptiveCPUBudget:
+			if(mIsInitialized)
+			{
+				CODEC_THROW(kAudioCodecIllegalOperationError);
+			}
+			if(inPropertyDataSize == sizeof(Float64))
+			{
+				Float64 theBudget = *reinterpret_cast<const Float64*>(inPropertyData);
+				if (!(theBudget >= 0.0))
+				{
+					CODEC_THROW(kAudioCodecIllegalOperationError);
+				}
+				mAdaptiveCPUBudget = theBudget;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+
+		case kAudioCodecPropertyPacketFrameSize:
+			if(mIsInitialized)
+			{
+				CODEC_THROW(kAudioCodecIllegalOperationError);
+			}
+			if(inPropertyDataSize == sizeof(UInt32))
+			{
+				SetFramesPerPacket(*reinterpret_cast<const UInt32*>(inPropertyData));
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
+
 		case kAudioCodecPropertyZeroFramesPadded:
 		case kAudioCodecPropertyAvailableInputSampleRates:
 		case kAudioCodecPropertyAvailableOutputSampleRates:
+		case kFLACEncoderPropertyCompressionLevelHistory:
+		case kFLACEncoderPropertySeekIndex:
 			CODEC_THROW(kAudioCodecIllegalOperationError);
 			break;
 		default:
@@ -541,7 +706,16 @@ void ACFLACEncoder::SetCurrentOutputFormat(const AudioStreamBasicDescription& in
 		ACFLACCodec::SetCurrentOutputFormat(inOutputFormat);
 		if (mOutputFormat.mFramesPerPacket == 0 && inOutputFormat.mFormatID == 'flac') // make sure this field is still valid
 		{
-			mOutputFormat.mFramesPerPacket = kFramesPerPacket;
+			mOutputFormat.mFramesPerPacket = mFramesPerPacket;
+		}
+		else if ( (mOutputFormat.mFramesPerPacket >= kMinFramesPerPacket) && (mOutputFormat.mFramesPerPacket <= kMaxFramesPerPacket) )
+		{
+			// a block size we can do is taken from the format
+			mFramesPerPacket = mOutputFormat.mFramesPerPacket;
+		}
+		else
+		{
+			mOutputFormat.mFramesPerPacket = mFramesPerPacket;
 		}
 		if (mOutputFormat.mSampleRate == 0.0)
 		{
@@ -612,7 +786,7 @@ void ACFLACEncoder::Initialize(const AudioStreamBasicDescription* inInputFormat,
 		{
 			mBitDepth = mInputFormat.mBitsPerChannel;
 		}
-		mMaxFrameBytes = kInputBufferPackets * mOutputFormat.mChannelsPerFrame * ((mBitDepth) >> 3) + kMaxEscapeHeaderBytes;
+		mMaxFrameBytes = mFramesPerPacket * mOutputFormat.mChannelsPerFrame * ((mBitDepth) >> 3) + kMaxEscapeHeaderBytes;
 		
 		// Fill out the output format flags so if someone needs to see them
 		if(mOutputFormat.mFormatFlags == 0) // fill out the flags if they aren't filled out already.
@@ -638,26 +812,16 @@ void ACFLACEncoder::Initialize(const AudioStreamBasicDescription* inInputFormat,
 			mEncoderState = FLAC__stream_encoder_get_state(mEncoder);
 		}
 		// Now set up the encoder
-		FLAC__stream_encoder_set_streamable_subset(mEncoder, false);
-		FLAC__stream_encoder_set_channels(mEncoder, mInputFormat.mChannelsPerFrame);
-		
-		FLAC__stream_encoder_set_bits_per_sample(mEncoder, mBitDepth);
-		FLAC__stream_encoder_set_sample_rate(mEncoder, (UInt32)mInputFormat.mSampleRate);
-		FLAC__stream_encoder_set_blocksize(mEncoder, kFramesPerPacket);
-
-		// Now, we set the compression level. We used the kAudioCodecPropertyQualitySetting to determine this. Min 0, max 8
-		SetCompressionLevel(mQuality);	
+		mCompressionLevel = mQuality;
+		ConfigureEncoder(mEncoder);
 
-		// we're going to toss this anyway -- this is only for the initialization writes
-		mOutputBuffer = mInputBuffer;
-
-		// Finally, initialize the encoder
+		// Finally, initialize the encoder -- the callbacks get back to us through the client data
 		FLAC__stream_encoder_init_stream(mEncoder,
 										 stream_encoder_write_callback,
 										 NULL,
 										 NULL,
 										 stream_encoder_metadata_callback,
-										 NULL);
+										 this);
 										 
 		mEncoderState = FLAC__stream_encoder_get_state(mEncoder);
 		if (mEncoderState != FLAC__STREAM_ENCODER_OK)
@@ -669,6 +833,43 @@ void ACFLACEncoder::Initialize(const AudioStreamBasicDescription* inInputFormat,
 			ACFLACCodec::Uninitialize();
 			CODEC_THROW(kAudioCodecUnsupportedFormatError);
 		}
+		
+		// the pool's threads and the frame encoders live as long as we're initialized
+		if (mEncodeThreadCount > 1)
+		{
+			mWorkerPool = new ACWorkerPool(mEncodeThreadCount);
+			mParallelRanges.resize(mWorkerPool->GetNumberThreads());
+			for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+			{
+				// started with the first packet that comes their way
+				mParallelRanges[i].mEncoder = FLAC__stream_encoder_new();
+				mParallelRanges[i].mCompressionLevel = mCompressionLevel;
+				mParallelRanges[i].mNextFrameNumber = i;
+				mParallelRanges[i].mFrameNumberStep = mParallelRanges.size();
+			}
+		}
+		// the frame encoders don't see all of the samples, and in adaptive mode libFLAC's MD5 would start
+		// over with the encoder, so then the MD5 is worked out alongside
+		if ( (mWorkerPool != NULL) || (mAdaptiveCPUBudget > 0.0) )
+		{
+			if (mMD5Mode == kFLACMD5Inline)
+			{
+				mMD5Signal.resize(mFramesPerPacket * mInputFormat.mChannelsPerFrame);
+			}
+			FLAC__MD5Init(&mMD5Context);
+		}
+		if (mMD5Mode == kFLACMD5Offloaded)
+		{
+			mMD5Pipeline = new MD5Pipeline(mInputFormat.mChannelsPerFrame, (mBitDepth + 7) / 8, mFramesPerPacket);
+		}
+		AllocateInputBuffer();
+		StartCompressionLevelHistory();
+		mSeekIndex.clear();
+		mNextFrameNumber = 0;
+		mNextFrameOut = 0;
+		mSamplesEncoded = 0;
+		mMinFrameBytesEncoded = 0;
+		mMaxFrameBytesEncoded = 0;
 	}
 	else
 	{
@@ -676,8 +877,8 @@ void ACFLACEncoder::Initialize(const AudioStreamBasicDescription* inInputFormat,
 	}
 }
 
-// We take one flac "packet" at a time of PCM data
-// We will need 4608 frames at a time but we could very well get more.
+// We take as many whole frames of PCM data as fit in the input buffer, they don't
+// need to add up to whole packets. An empty append marks the end of the stream.
 void ACFLACEncoder::AppendInputData(const void* inInputData, UInt32& ioInputDataByteSize, UInt32& ioNumberPackets, const AudioStreamPacketDescription* inPacketDescription)
 {
 	if(!mIsInitialized)
@@ -685,134 +886,39 @@ void ACFLACEncoder::AppendInputData(const void* inInputData, UInt32& ioInputData
 		CODEC_THROW(kAudioCodecStateError);
 	}
 
-	Boolean packetAdded = false;
-	UInt32 requiredNumberOfBytes, currentlyNeededNumberOfBytes;
-
-	requiredNumberOfBytes = kInputBufferPackets * mInputFormat.mChannelsPerFrame * ((mInputFormat.mBitsPerChannel) >> 3);
-	
-	// We may be getting partial packets.
-	currentlyNeededNumberOfBytes = requiredNumberOfBytes - mInputBufferBytesUsed;
-#if VERBOSE
-	printf("currentlyNeededNumberOfBytes == %lu, mInputFormat.mBitsPerChannel == %lu, mInputFormat.mBytesPerFrame == %lu\n", currentlyNeededNumberOfBytes, mInputFormat.mBitsPerChannel, mInputFormat.mBytesPerFrame);
-#endif
-	// For some reason we're getting called more than once before a call to ProduceOutputPackets
-	if (currentlyNeededNumberOfBytes == 0) // there's a packet already there
+	if (ioInputDataByteSize == 0 || mFinished)
 	{
-		mPacketInInputBuffer = true; // mark that we have a packet in the buffer
-	#if VERBOSE
-		printf("we have a packet in the buffer and copy ioInputDataByteSize = %d to the mLeftoverBuffer \n", ioInputDataByteSize);
-	#endif
-	}
-	else if (!mPacketInInputBuffer) // we don't have a packet
-	{
-
-		if ( (ioInputDataByteSize >= currentlyNeededNumberOfBytes) && ( currentlyNeededNumberOfBytes <= GetInputBufferByteSize() - GetUsedInputBufferByteSize() ) ) // we will have a full packet
+		if (ioInputDataByteSize == 0)
 		{
-			mPacketInInputBuffer = true;
-		#if VERBOSE
-			printf("mInputBufferBytesUsed == %lu\n", mInputBufferBytesUsed);
-		#endif
-			memcpy( (Byte *)mInputBuffer + mInputBufferBytesUsed, (Byte *)inInputData, currentlyNeededNumberOfBytes );
-			mInputBufferBytesUsed += currentlyNeededNumberOfBytes;
-			// Now, this part is not fun -- we need to blit the input into a low aligned 32-bit buffer
-			if (mInputFormat.mBitsPerChannel == 16)
-			{
-				for (unsigned int i = 0; i < kInputBufferPackets * mInputFormat.mChannelsPerFrame; ++i)
-				{
-					mConvertedBuffer[i] = ((SInt16 *)mInputBuffer)[i];
-				}
-			}
-			else // 24
-			{
-				for (unsigned int i = 0; i < kInputBufferPackets * mInputFormat.mChannelsPerFrame; ++i)
-				{
-					mConvertedBuffer[i] = (((UInt32)(mInputBuffer[3 * i])) << 16) | (((UInt32)(mInputBuffer[3 * i + 1])) << 8) | ((UInt32)(mInputBuffer[3 * i + 2]));
-				}
-			}
+			// whatever is left in the input buffer goes out as a short last packet
+			mFlushPacket = true;
 		#if VERBOSE
-			printf("Append mInputBufferBytesUsed == %lu\n", mInputBufferBytesUsed);
+			printf("Flushing last packet, mInputBufferBytesUsed == %lu\n", mInputBufferBytesUsed);
 		#endif
-			// Useful for dealing with some input issues
-			//printf ("The first 32 SInt32's == \n");
-			//for (int i = 0; i < 32; ++i)
-			//{
-			//	printf ("%li ", ((SInt32 *)(mInputBuffer))[i]);
-			//}
-			//printf ("\n");
-		}
-		else // we won't have a full packet
-		{
-			if (ioInputDataByteSize == 0)
-			{
-				mFlushPacket = true;
-			#if VERBOSE
-				printf("Flushing last packet, mInputBufferBytesUsed == %lu\n", mInputBufferBytesUsed);
-			#endif
-				// We still have stuff in the input buffer that needs to be blitted in to the converted buffer
-				if (mInputFormat.mBitsPerChannel == 16)
-				{
-					for (unsigned int i = 0; i < mInputBufferBytesUsed/((mInputFormat.mBitsPerChannel) >> 3); ++i)
-					{
-						mConvertedBuffer[i] = ((SInt16 *)mInputBuffer)[i];
-					}
-				}
-				else // 24
-				{
-					for (unsigned int i = 0; i < mInputBufferBytesUsed/((mInputFormat.mBitsPerChannel) >> 3); ++i)
-					{
-						mConvertedBuffer[i] = (((UInt32)(mInputBuffer[3 * i])) << 16) | (((UInt32)(mInputBuffer[3 * i + 1])) << 8) | ((UInt32)(mInputBuffer[3 * i + 2]));
-					}
-				}
-			}
-			else
-			{
-				if (ioInputDataByteSize <= GetInputBufferByteSize() - GetUsedInputBufferByteSize())
-				{
-					memcpy( (Byte *)mInputBuffer + mInputBufferBytesUsed, (Byte *)inInputData, ioInputDataByteSize );
-					mInputBufferBytesUsed += ioInputDataByteSize;
-				#if VERBOSE
-					printf("reading what we can\n");
-				#endif
-				}
-				else
-				{
-					// We're screwed -- our buffer is too small
-					CODEC_THROW(kAudioCodecStateError);
-				}
-			}
 		}
-		packetAdded = true;
-	}
-	// We should never get here, but if for some reason we do, things are bad --
-	// we think we have a packet in the inputBuffer but not enough data.
-	else 
-	{
-		CODEC_THROW(kAudioCodecStateError);
-	}
-    
-	if (!packetAdded)
-	{
-		ioNumberPackets = 0;
 		ioInputDataByteSize = 0;
-	#if VERBOSE
-		printf("no packetAdded -- ioInputDataByteSize == %lu, mInputBufferBytesUsed == %lu\n", ioInputDataByteSize, mInputBufferBytesUsed);
-	#endif
+		ioNumberPackets = 0;
+		return;
 	}
-	else
-	{
-		if (mPacketInInputBuffer)
-		{
-			ioInputDataByteSize = currentlyNeededNumberOfBytes;
-		}
-		ioNumberPackets = ioInputDataByteSize / mInputFormat.mBytesPerFrame;
-	#if VERBOSE
-		printf("packetAdded -- ioInputDataByteSize == %lu, mInputBufferBytesUsed == %lu, ioNumberPackets == %lu\n", ioInputDataByteSize, mInputBufferBytesUsed, ioNumberPackets);
-	#endif
-    }
 
+	UInt32 theAvailableByteSize = GetInputBufferByteSize() - GetUsedInputBufferByteSize();
+	UInt32 theByteSize = (ioInputDataByteSize < theAvailableByteSize) ? ioInputDataByteSize : theAvailableByteSize;
+	
+	// only whole frames
+	theByteSize -= theByteSize % mInputFormat.mBytesPerFrame;
+	
+	// widen straight out of the caller's buffer, so the encoders can work on it in place
+	ConvertInputFrames((const Byte *)inInputData, theByteSize / mInputFormat.mBytesPerFrame, mInputBuffer + (mInputBufferBytesUsed / mInputFormat.mBytesPerFrame) * mInputFormat.mChannelsPerFrame);
+	mInputBufferBytesUsed += theByteSize;
+#if VERBOSE
+	printf("Append mInputBufferBytesUsed == %lu\n", mInputBufferBytesUsed);
+#endif
+
+	ioInputDataByteSize = theByteSize;
+	ioNumberPackets = theByteSize / mInputFormat.mBytesPerFrame;
 }
 
-// We can only do 1 packet at a time
+// We encode as many packets as there is input for and room in the output buffer
 UInt32	ACFLACEncoder::ProduceOutputPackets(
 				void* 							outOutputData, 
 				UInt32& 						ioOutputDataByteSize, 
@@ -823,151 +929,869 @@ UInt32	ACFLACEncoder::ProduceOutputPackets(
 	//	setup the return value, by assuming that everything is going to work
 	UInt32 theAnswer = kAudioCodecProduceOutputPacketSuccess;
 
-	UInt32				numFrames = kInputBufferPackets;
-	
 	if(!mIsInitialized)
 	{
 		CODEC_THROW(kAudioCodecStateError);
 	}
-		
-	//	clamp the number of packets to produce based on what is available in the input buffer
+	
 	// mBytesPerFrame had better be 2 or 4 -- not sure if anything else works
-	UInt32 inputPacketSize = mInputFormat.mBytesPerFrame * kFramesPerPacket;  
-	UInt32 numberOfInputPackets = GetUsedInputBufferByteSize() / inputPacketSize;
-	if (numberOfInputPackets > 1)
-	{
-		numberOfInputPackets = 1;
-	}
-	if (ioNumberPackets < numberOfInputPackets) // only if ioNumberPackets == 0
-	{
-		numberOfInputPackets = ioNumberPackets;
-	}
-	else if (ioNumberPackets > numberOfInputPackets)
+	UInt32 inputPacketSize = mInputFormat.mBytesPerFrame * mFramesPerPacket;
+	UInt32 theInputBytesConsumed = 0;
+	UInt32 theNumberPacketsRequested = ioNumberPackets;
+	UInt32 theMaxPacketByteSize = (mMaxFrameBytes > 0) ? mMaxFrameBytes : mFramesPerPacket * mInputFormat.mChannelsPerFrame * ((mBitDepth) >> 3) + kMaxEscapeHeaderBytes;
+	
+	// point the write call back at the caller's buffer
+	mOutputBuffer = reinterpret_cast<Byte*>(outOutputData);
+	mOutputBufferByteSize = ioOutputDataByteSize;
+	mOutputPacketDescriptions = outPacketDescription;
+	mMaxOutputPackets = ioNumberPackets;
+	mOutputBytes = 0;
+	mNumberOutputPackets = 0;
+	
+	// packets that didn't fit last time go out first
+	DeliverPendingOutput();
+	
+	if (mWorkerPool != NULL)
 	{
-		ioNumberPackets = numberOfInputPackets;
+		// the frame encoders do all of the encoding, the short last packet included, so that the frames are all numbered in one place
+		UInt32 theNumberPackets = mInputBufferBytesUsed / inputPacketSize;
+		UInt32 theRoomForPackets = (mOutputBufferByteSize - mOutputBytes) / theMaxPacketByteSize;
+		UInt32 theLeftoverFrames = (mInputBufferBytesUsed % inputPacketSize) / mInputFormat.mBytesPerFrame;
 		
-		//	this also means we need more input to satisfy the request so set the return value
-		theAnswer = kAudioCodecProduceOutputPacketNeedsMoreInputData;
-	}
-	if (mFlushPacket && !mPacketInInputBuffer && !mFinished) 
-	{
-		numFrames = GetUsedInputBufferByteSize()/(mInputFormat.mBytesPerFrame);
-		mPacketInInputBuffer = true;
-		theAnswer = kAudioCodecProduceOutputPacketAtEOF;
-		ioNumberPackets = 1;
-		inputPacketSize = GetUsedInputBufferByteSize();
-	#if VERBOSE
-		printf("inputPacketSize == %lu, numFrames = %lu\n", inputPacketSize, numFrames);
-	#endif
-	}
-	else
-	{
-		numFrames = kFramesPerPacket;
+		if (theRoomForPackets > mMaxOutputPackets - mNumberOutputPackets)
+		{
+			theRoomForPackets = mMaxOutputPackets - mNumberOutputPackets;
+		}
+		if (theRoomForPackets == 0 && mNumberOutputPackets == 0)
+		{
+			// if the worst case won't fit, take our chances on one packet -- if it doesn't fit it waits for the next call
+			theRoomForPackets = 1;
+		}
+		if (mPendingPacketDescriptions.empty() && !mFinished && (theRoomForPackets > 0))
+		{
+			UInt32 theNumberFrames = ((theNumberPackets < theRoomForPackets) ? theNumberPackets : theRoomForPackets) * mFramesPerPacket;
+			
+			// at the end of the stream, what's left goes out too if there's room for it -- and the frames
+			// the encoders are holding on to come out with it, which may have to wait for the next call
+			bool theLastPackets = mFlushPacket && (theNumberPackets + ((theLeftoverFrames > 0) ? 1 : 0) <= theRoomForPackets);
+			if (theLastPackets)
+			{
+				theNumberFrames += theLeftoverFrames;
+			}
+			if ( ((theNumberFrames > 0) || theLastPackets) && !EncodeFramesParallel(mInputBuffer, theNumberFrames, theLastPackets) )
+			{
+				theAnswer = kAudioCodecProduceOutputPacketFailure;
+			}
+			else
+			{
+				theInputBytesConsumed = theNumberFrames * mInputFormat.mBytesPerFrame;
+				if (theLastPackets)
+				{
+				#if VERBOSE
+					printf("Flushing the last %lu frames\n", theLeftoverFrames);
+				#endif
+					if (theLeftoverFrames > 0)
+					{
+						mTrailingFrames = mFramesPerPacket - theLeftoverFrames;
+					}
+					FinishStreamInfo();
+					mFinished = true;
+				}
+			}
+		}
 	}
-	if(ioNumberPackets > 0 && mPacketInInputBuffer && !mFinished) // ioNumberPackets == 1
+	
+	// libFLAC hangs on to the last packet it was given until it sees the next one, so each
+	// packet in produces at most one packet out -- we can budget the output buffer by input packets
+	while ((mWorkerPool == NULL) && mPendingPacketDescriptions.empty() && !mFinished && (mNumberOutputPackets < mMaxOutputPackets))
 	{
-		// Process a packet!
+		UInt32 theNumberPackets = (mInputBufferBytesUsed - theInputBytesConsumed) / inputPacketSize;
+		UInt32 theRoomForPackets = (mOutputBufferByteSize - mOutputBytes) / theMaxPacketByteSize;
 		
-		mOutputBuffer = reinterpret_cast<Byte*>(outOutputData);
-		// The call back sets mOutputBytes and mOutputBuffer
-		mOutputBytes = 0; // set this value to 0 now. It may get incremented more than once by the write call back
-		if (!FLAC__stream_encoder_process_interleaved(mEncoder, (const FLAC__int32 *)mConvertedBuffer, numFrames))
+		if (theNumberPackets == 0)
 		{
-			mEncoderState = FLAC__stream_encoder_get_state(mEncoder);
-		#if VERBOSE
-			printf ("mEncoderState == %i\n", mEncoderState);
-		#endif
-			return kAudioCodecProduceOutputPacketFailure;
-		}			
-		if (theAnswer == kAudioCodecProduceOutputPacketAtEOF)
+			break;
+		}
+		if (theRoomForPackets > mMaxOutputPackets - mNumberOutputPackets)
 		{
-			FLAC__stream_encoder_finish(mEncoder); // flushes the last packet
+			theRoomForPackets = mMaxOutputPackets - mNumberOutputPackets;
 		}
-		// gather encoding stats
-		mTotalBytesGenerated += mOutputBytes;
-		mMaxFrameBytes = MAX( mMaxFrameBytes, mOutputBytes );
-
-		//	make sure that there is enough space in the output buffer for the encoded data
-		//	it is an error to ask for more output than you pass in buffer space for
-	#if VERBOSE
-		printf ("ioOutputDataByteSize == %lu, mOutputBytes == %lu\n", ioOutputDataByteSize, mOutputBytes);	
-	#endif
-		ThrowIf(ioOutputDataByteSize < mOutputBytes, static_cast<ComponentResult>(kAudioCodecNotEnoughBufferSpaceError), "ACFLACEncoder::ProduceOutputPackets: not enough space in the output buffer");
-		
-		//	set the return value
-		ioOutputDataByteSize = mOutputBytes;
-		if (mOutputBytes == 0)
+		if (theRoomForPackets == 0)
 		{
-			ioNumberPackets = 0;
-			if (outPacketDescription != NULL)
+			// if the worst case won't fit, take our chances on one packet -- if it doesn't fit it waits for the next call
+			if (mNumberOutputPackets > 0)
 			{
-				outPacketDescription->mStartOffset = 0;
-				outPacketDescription->mVariableFramesInPacket = 0; // 4608 except for last packet
-				outPacketDescription->mDataByteSize = ioOutputDataByteSize;
-			#if VERBOSE
-				printf("inputPacketSize / mInputFormat.mBytesPerFrame == %lu, ioOutputDataByteSize == %lu\n", inputPacketSize / mInputFormat.mBytesPerFrame, ioOutputDataByteSize);
-			#endif
-				mTrailingFrames = kFramesPerPacket - numFrames;
+				break;
 			}
+			theRoomForPackets = 1;
 		}
-		else
+		if (theNumberPackets > theRoomForPackets)
 		{
-			if (outPacketDescription != NULL)
-			{
-				outPacketDescription->mStartOffset = 0;
-				outPacketDescription->mVariableFramesInPacket = numFrames; // 4608 except for last packet
-				outPacketDescription->mDataByteSize = ioOutputDataByteSize;
-			#if VERBOSE
-				printf("inputPacketSize / mInputFormat.mBytesPerFrame == %lu, ioOutputDataByteSize == %lu\n", inputPacketSize / mInputFormat.mBytesPerFrame, ioOutputDataByteSize);
-			#endif
-				mTrailingFrames = kFramesPerPacket - numFrames;
-			}
+			theNumberPackets = theRoomForPackets;
 		}
 		
-		//	encode the input data for each channel
-	#if VERBOSE
-		printf("Consuming %lu bytes\n", inputPacketSize);
-	#endif
-		mInputBufferBytesUsed -= inputPacketSize;
-	#if VERBOSE
-		printf("Produce mInputBufferBytesUsed == %lu\n", mInputBufferBytesUsed);
-	#endif
-		mPacketInInputBuffer = false;
-		if (mFlushPacket && !mFinished) // there's only one last packet
+		const SInt32 * theInputData = mInputBuffer + (theInputBytesConsumed / mInputFormat.mBytesPerFrame) * mInputFormat.mChannelsPerFrame;
+		bool theSucceeded;
+		if (mAdaptiveCPUBudget > 0.0)
 		{
-			mFinished = true;
+			// a packet at a time, so the level can change before the next one
+			theNumberPackets = 1;
+			theSucceeded = EncodeTimedPacket(theInputData, mFramesPerPacket);
 		}
-	}
-	else
-	{
-		//	set the return value since we're not actually doing any work
-		ioNumberPackets = 0;
-		ioOutputDataByteSize = 0;
-		theAnswer = kAudioCodecProduceOutputPacketNeedsMoreInputData;
-	#if VERBOSE
-		printf("Encoder needs more data\n");
-	#endif
-		if (outPacketDescription != NULL)
+		else
+		{
+			if (mMD5Pipeline != NULL)
+			{
+				mMD5Pipeline->Append(theInputData, theNumberPackets * mFramesPerPacket);
+			}
+			theSucceeded = FLAC__stream_encoder_process_interleaved(mEncoder, (const FLAC__int32 *)theInputData, theNumberPackets * mFramesPerPacket);
+		}
+		if (!theSucceeded)
 		{
-			outPacketDescription->mStartOffset = 0;
-			outPacketDescription->mVariableFramesInPacket = 0; 
-			outPacketDescription->mDataByteSize = 0;
+			mEncoderState = FLAC__stream_encoder_get_state(mEncoder);
 		#if VERBOSE
-			printf("inputPacketSize / mInputFormat.mBytesPerFrame = %lu, ioOutputDataByteSize == %lu\n", inputPacketSize / mInputFormat.mBytesPerFrame, ioOutputDataByteSize);
+			printf ("mEncoderState == %i\n", mEncoderState);
 		#endif
+			theAnswer = kAudioCodecProduceOutputPacketFailure;
+			break;
 		}
+		theInputBytesConsumed += theNumberPackets * inputPacketSize;
 	}
 	
-	if((theAnswer == kAudioCodecProduceOutputPacketSuccess) && (GetUsedInputBufferByteSize() >= inputPacketSize) && (inputPacketSize > 0) )
+	// at the end of the stream, what's left is a short packet and libFLAC has to be told to let go of it
+	if ( (mWorkerPool == NULL) && (theAnswer != kAudioCodecProduceOutputPacketFailure) && mFlushPacket && !mFinished && mPendingPacketDescriptions.empty() &&
+		 (mNumberOutputPackets < mMaxOutputPackets) && (mInputBufferBytesUsed - theInputBytesConsumed < inputPacketSize) )
 	{
-		//	we satisfied the request, and there's at least one more full packet of data we can encode
-		//	so set the return value
-		theAnswer = kAudioCodecProduceOutputPacketSuccessHasMore;
-	}
-	
+		UInt32 numFrames = (mInputBufferBytesUsed - theInputBytesConsumed) / mInputFormat.mBytesPerFrame;
+	#if VERBOSE
+		printf("Flushing the last %lu frames\n", numFrames);
+	#endif
+		if (numFrames > 0)
+		{
+			const SInt32 * theInputData = mInputBuffer + (theInputBytesConsumed / mInputFormat.mBytesPerFrame) * mInputFormat.mChannelsPerFrame;
+			if (mMD5Pipeline != NULL)
+			{
+				mMD5Pipeline->Append(theInputData, numFrames);
+			}
+			else if ( (mAdaptiveCPUBudget > 0.0) && (mMD5Mode == kFLACMD5Inline) )
+			{
+				AccumulateMD5(theInputData, numFrames);
+			}
+			FLAC__stream_encoder_process_interleaved(mEncoder, (const FLAC__int32 *)theInputData, numFrames);
+			theInputBytesConsumed += numFrames * mInputFormat.mBytesPerFrame;
+			mTrailingFrames = mFramesPerPacket - numFrames;
+			mSamplesEncoded += numFrames;
+		}
+		if (mAdaptiveCPUBudget > 0.0)
+		{
+			// finishes mEncoder too, which flushes the last packet(s)
+			FinishStreamInfo();
+		}
+		else
+		{
+			FLAC__stream_encoder_finish(mEncoder); // flushes the last packet(s)
+			if (mMD5Pipeline != NULL)
+			{
+				// the metadata callback has been, with the zeros libFLAC has for a signature
+				mMD5Pipeline->Finish(mStreamInfo.md5sum);
+			}
+		}
+		mFinished = true;
+	}
+	
+	// move what's left to the front of the input buffer
+	if (theInputBytesConsumed > 0)
+	{
+	#if VERBOSE
+		printf("Consuming %lu bytes\n", theInputBytesConsumed);
+	#endif
+		mInputBufferBytesUsed -= theInputBytesConsumed;
+		memmove(mInputBuffer, mInputBuffer + (theInputBytesConsumed / mInputFormat.mBytesPerFrame) * mInputFormat.mChannelsPerFrame, (mInputBufferBytesUsed / mInputFormat.mBytesPerFrame) * mInputFormat.mChannelsPerFrame * sizeof(SInt32));
+	}
+	
+	//	set the return values
+	ioOutputDataByteSize = mOutputBytes;
+	ioNumberPackets = mNumberOutputPackets;
+	
+	// nothing should get written to the caller's buffer outside of this call
+	mOutputBuffer = NULL;
+	mOutputBufferByteSize = 0;
+	mOutputPacketDescriptions = NULL;
+	mMaxOutputPackets = 0;
+	
+	//	it is an error to ask for more output than you pass in buffer space for
+	ThrowIf((ioNumberPackets == 0) && (theNumberPacketsRequested > 0) && !mPendingPacketDescriptions.empty(), static_cast<ComponentResult>(kAudioCodecNotEnoughBufferSpaceError), "ACFLACEncoder::ProduceOutputPackets: not enough space in the output buffer");
+	
+	if (theAnswer != kAudioCodecProduceOutputPacketFailure)
+	{
+		bool hasMore = !mPendingPacketDescriptions.empty() || (!mFinished && GetUsedInputBufferByteSize() >= inputPacketSize);
+		
+		if (mFinished && mPendingPacketDescriptions.empty())
+		{
+			theAnswer = kAudioCodecProduceOutputPacketAtEOF;
+		}
+		else if (hasMore)
+		{
+			//	there's at least one more packet we can hand out
+			theAnswer = kAudioCodecProduceOutputPacketSuccessHasMore;
+		}
+		else if (ioNumberPackets < theNumberPacketsRequested)
+		{
+			//	we need more input to satisfy the request
+			theAnswer = kAudioCodecProduceOutputPacketNeedsMoreInputData;
+		#if VERBOSE
+			printf("Encoder needs more data\n");
+		#endif
+		}
+	}
+	
 	return theAnswer;
 }
 
+// Blits the input into the low aligned 32-bit buffer that libFLAC takes
+void ACFLACEncoder::ConvertInputFrames(const Byte * inInputData, UInt32 inNumberFrames, SInt32 * outConvertedData) const
+{
+	UInt32 theNumberSamples = inNumberFrames * mInputFormat.mChannelsPerFrame;
+	
+	if (mInputFormat.mBitsPerChannel == 16)
+	{
+		ConvertSInt16ToSInt32((const SInt16 *)inInputData, outConvertedData, theNumberSamples);
+	}
+	else // 24
+	{
+		ConvertSInt24ToSInt32(inInputData, outConvertedData, theNumberSamples);
+	}
+}
+
+// Moves as many of the packets left over from the last call into the caller's buffer as fit
+void ACFLACEncoder::DeliverPendingOutput()
+{
+	UInt32 theNumberDelivered = 0;
+	UInt32 theByteSize = 0;
+	
+	while ( (theNumberDelivered < mPendingPacketDescriptions.size()) && (mNumberOutputPackets < mMaxOutputPackets) &&
+			(mOutputBytes + mPendingPacketDescriptions[theNumberDelivered].mDataByteSize <= mOutputBufferByteSize) )
+	{
+		const AudioStreamPacketDescription & thePacket = mPendingPacketDescriptions[theNumberDelivered];
+		
+		memcpy(mOutputBuffer + mOutputBytes, &mPendingOutput[thePacket.mStartOffset], thePacket.mDataByteSize);
+		if (mOutputPacketDescriptions != NULL)
+		{
+			mOutputPacketDescriptions[mNumberOutputPackets].mStartOffset = mOutputBytes;
+			mOutputPacketDescriptions[mNumberOutputPackets].mVariableFramesInPacket = thePacket.mVariableFramesInPacket;
+			mOutputPacketDescriptions[mNumberOutputPackets].mDataByteSize = thePacket.mDataByteSize;
+		}
+		mOutputBytes += thePacket.mDataByteSize;
+		theByteSize += thePacket.mDataByteSize;
+		++mNumberOutputPackets;
+		++theNumberDelivered;
+	}
+	
+	if (theNumberDelivered > 0)
+	{
+		mPendingOutput.erase(mPendingOutput.begin(), mPendingOutput.begin() + theByteSize);
+		mPendingPacketDescriptions.erase(mPendingPacketDescriptions.begin(), mPendingPacketDescriptions.begin() + theNumberDelivered);
+		for (UInt32 i = 0; i < mPendingPacketDescriptions.size(); ++i)
+		{
+			mPendingPacketDescriptions[i].mStartOffset -= theByteSize;
+		}
+	}
+}
+
+// Hands one encoded frame to the caller, or holds on to it if there's no room
+void ACFLACEncoder::WritePacket(const Byte * inPacketData, UInt32 inPacketByteSize, UInt32 inNumberFrames)
+{
+#if VERBOSE	
+	printf("Writing %lu bytes at offset %lu\n", inPacketByteSize, mOutputBytes);
+#endif
+	// every packet goes in the seek index, starting where the last one left off
+	FLAC__StreamMetadata_SeekPoint theSeekPoint;
+	theSeekPoint.sample_number = mSeekIndex.empty() ? 0 : mSeekIndex.back().sample_number + mSeekIndex.back().frame_samples;
+	theSeekPoint.stream_offset = mTotalBytesGenerated;
+	theSeekPoint.frame_samples = inNumberFrames;
+	mSeekIndex.push_back(theSeekPoint);
+	
+	// gather encoding stats
+	mTotalBytesGenerated += inPacketByteSize;
+	mMaxFrameBytes = MAX( mMaxFrameBytes, inPacketByteSize );
+	if ( (mMinFrameBytesEncoded == 0) || (inPacketByteSize < mMinFrameBytesEncoded) )
+	{
+		mMinFrameBytesEncoded = inPacketByteSize;
+	}
+	mMaxFrameBytesEncoded = MAX( mMaxFrameBytesEncoded, inPacketByteSize );
+	++mNextFrameOut;
+	
+	// each write is one frame, which is one packet
+	if ( mPendingPacketDescriptions.empty() && (mNumberOutputPackets < mMaxOutputPackets) &&
+		 (mOutputBytes + inPacketByteSize <= mOutputBufferByteSize) )
+	{
+		memcpy (mOutputBuffer + mOutputBytes, inPacketData, inPacketByteSize);
+		if (mOutputPacketDescriptions != NULL)
+		{
+			AudioStreamPacketDescription & thePacket = mOutputPacketDescriptions[mNumberOutputPackets];
+			thePacket.mStartOffset = mOutputBytes;
+			thePacket.mVariableFramesInPacket = inNumberFrames; // 4608 except for last packet
+			thePacket.mDataByteSize = inPacketByteSize;
+		}
+		mOutputBytes += inPacketByteSize;
+		++mNumberOutputPackets;
+	}
+	else
+	{
+		// no room, so it waits for the next call
+		AudioStreamPacketDescription thePacket;
+		thePacket.mStartOffset = mPendingOutput.size();
+		thePacket.mVariableFramesInPacket = inNumberFrames;
+		thePacket.mDataByteSize = inPacketByteSize;
+		mPendingOutput.insert(mPendingOutput.end(), inPacketData, inPacketData + inPacketByteSize);
+		mPendingPacketDescriptions.push_back(thePacket);
+	}
+}
+
+// Adaptive mode on one thread -- encodes a packet with mEncoder, times it and moves the level if it has to.
+// The MD5 is worked out here, outside of the timing, since libFLAC's would start over with the encoder.
+bool ACFLACEncoder::EncodeTimedPacket(const SInt32 * inInputData, UInt32 inNumberFrames)
+{
+	UInt32 theFrameOut = mNextFrameOut;
+	UInt32 theCompressionLevel = mCompressionLevel;
+	struct timeval theStartTime, theEndTime;
+	
+	if (mMD5Pipeline != NULL)
+	{
+		mMD5Pipeline->Append(inInputData, inNumberFrames);
+	}
+	else if (mMD5Mode == kFLACMD5Inline)
+	{
+		AccumulateMD5(inInputData, inNumberFrames);
+	}
+	gettimeofday(&theStartTime, NULL);
+	if (!FLAC__stream_encoder_process_interleaved(mEncoder, (const FLAC__int32 *)inInputData, inNumberFrames))
+	{
+		return false;
+	}
+	gettimeofday(&theEndTime, NULL);
+	++mNextFrameNumber;
+	mSamplesEncoded += inNumberFrames;
+	
+	// libFLAC only encodes a packet once it has the next one, so the time goes to the frame that came out, if any
+	if (mNextFrameOut != theFrameOut)
+	{
+		AdaptCompressionLevel(mFramesPerPacket, (theEndTime.tv_sec - theStartTime.tv_sec) + (theEndTime.tv_usec - theStartTime.tv_usec) * 1.0e-6);
+	}
+	if (mCompressionLevel != theCompressionLevel)
+	{
+		// finishing gets out the packet mEncoder was holding on to, at the level it was started with
+		FLAC__stream_encoder_finish(mEncoder);
+		ConfigureEncoder(mEncoder);
+		return FLAC__stream_encoder_init_stream(mEncoder, stream_encoder_write_callback, NULL, NULL, stream_encoder_metadata_callback, this) == FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+	}
+	return true;
+}
+
+// Encodes inNumberFrames frames (whole packets except at the end of the stream) across the worker
+// pool and writes out the frames that are ready, in order and numbered as if one encoder had done them all
+bool ACFLACEncoder::EncodeFramesParallel(const SInt32 * inInputData, UInt32 inNumberFrames, bool inLastPackets)
+{
+	UInt32 theNumberPackets = (inNumberFrames + mFramesPerPacket - 1) / mFramesPerPacket;
+	
+	// one task per range, plus one for the MD5 unless it's done elsewhere or not at all
+	UInt32 theNumberTasks = mParallelRanges.size() + ((mMD5Mode == kFLACMD5Inline) ? 1 : 0);
+	if (mMD5Pipeline != NULL)
+	{
+		mMD5Pipeline->Append(inInputData, inNumberFrames);
+	}
+	ParallelEncodeContext theContext;
+	theContext.mEncoder = this;
+	theContext.mInputData = inInputData;
+	theContext.mNumberFrames = inNumberFrames;
+	theContext.mFirstFrameNumber = mNextFrameNumber;
+	theContext.mLastPackets = inLastPackets;
+	mWorkerPool->Run(ParallelEncodeTask, &theContext, theNumberTasks);
+	
+	Float64 theEncodeSeconds = 0.0;
+	UInt32 theFramesTimed = 0;
+	for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+	{
+		if (!mParallelRanges[i].mSucceeded)
+		{
+			return false;
+		}
+		theEncodeSeconds += mParallelRanges[i].mEncodeSeconds;
+		theFramesTimed += mParallelRanges[i].mFramesTimed;
+	}
+	mNextFrameNumber += theNumberPackets;
+	mSamplesEncoded += inNumberFrames;
+	WriteParallelOutput();
+	if ( (mAdaptiveCPUBudget > 0.0) && (theFramesTimed > 0) )
+	{
+		AdaptCompressionLevel(theFramesTimed, theEncodeSeconds);
+	}
+	return true;
+}
+
+// Writes the frames that have come out of the range encoders, for as long as the next one in the stream is
+// there -- range n has frame numbers n, n + the number of ranges and so on, in order
+void ACFLACEncoder::WriteParallelOutput()
+{
+	UInt32 theNumberRanges = mParallelRanges.size();
+	std::vector<UInt32> theNumbersWritten(theNumberRanges, 0);
+	
+	for (;;)
+	{
+		ParallelEncodeRange & theRange = mParallelRanges[mNextFrameOut % theNumberRanges];
+		UInt32 & theNumberWritten = theNumbersWritten[mNextFrameOut % theNumberRanges];
+		
+		if (theNumberWritten == theRange.mPacketDescriptions.size())
+		{
+			break;
+		}
+		const AudioStreamPacketDescription & thePacket = theRange.mPacketDescriptions[theNumberWritten];
+		WritePacket(&theRange.mOutput[thePacket.mStartOffset], thePacket.mDataByteSize, thePacket.mVariableFramesInPacket);
+		++theNumberWritten;
+	}
+	
+	// and what's left waits for the frames before it
+	for (UInt32 i = 0; i < theNumberRanges; ++i)
+	{
+		ParallelEncodeRange & theRange = mParallelRanges[i];
+		UInt32 theNumberWritten = theNumbersWritten[i];
+		
+		if (theNumberWritten > 0)
+		{
+			UInt32 theByteSize = (theNumberWritten < theRange.mPacketDescriptions.size()) ? theRange.mPacketDescriptions[theNumberWritten].mStartOffset : theRange.mOutput.size();
+			theRange.mOutput.erase(theRange.mOutput.begin(), theRange.mOutput.begin() + theByteSize);
+			theRange.mPacketDescriptions.erase(theRange.mPacketDescriptions.begin(), theRange.mPacketDescriptions.begin() + theNumberWritten);
+			for (UInt32 j = 0; j < theRange.mPacketDescriptions.size(); ++j)
+			{
+				theRange.mPacketDescriptions[j].mStartOffset -= theByteSize;
+			}
+		}
+	}
+}
+
+// Moves the level a step for the next packets if the last ones were over budget, or well
+// under it -- half, since each level up costs more than the last. inEncodeSeconds is the
+// time the packets took between them, so the load is per packet whatever the number of
+// threads. The encoders are started again at the new level before their next packet.
+void ACFLACEncoder::AdaptCompressionLevel(UInt32 inNumberFrames, Float64 inEncodeSeconds)
+{
+	Float64 theLoad = inEncodeSeconds * mInputFormat.mSampleRate / inNumberFrames;
+	UInt32 theCompressionLevel = mCompressionLevel;
+	
+	if ( (theLoad > mAdaptiveCPUBudget) && (theCompressionLevel > 0) )
+	{
+		--theCompressionLevel;
+	}
+	else if ( (theLoad < mAdaptiveCPUBudget * 0.5) && (theCompressionLevel < mQuality) )
+	{
+		++theCompressionLevel;
+	}
+	if (theCompressionLevel != mCompressionLevel)
+	{
+		FLACCompressionLevelChange theChange = { mNextFrameNumber, theCompressionLevel, (Float32)theLoad };
+		mCompressionLevelHistory.push_back(theChange);
+		mCompressionLevel = theCompressionLevel;
+	#if VERBOSE
+		printf("Compression level %lu from packet %lu, load %f\n", theCompressionLevel, mNextFrameNumber, theLoad);
+	#endif
+	}
+}
+
+void ACFLACEncoder::StartCompressionLevelHistory()
+{
+	FLACCompressionLevelChange theStart = { 0, mCompressionLevel, 0.0f };
+	mCompressionLevelHistory.clear();
+	mCompressionLevelHistory.push_back(theStart);
+}
+
+// Runs on the worker pool -- none of this may touch anything but its own range
+void ACFLACEncoder::ParallelEncodeTask(void* inContext, UInt32 inTaskIndex)
+{
+	ParallelEncodeContext * theContext = static_cast<ParallelEncodeContext *>(inContext);
+	ACFLACEncoder * theEncoder = theContext->mEncoder;
+	UInt32 theNumberRanges = theEncoder->mParallelRanges.size();
+	
+	if (inTaskIndex == theNumberRanges)
+	{
+		theEncoder->AccumulateMD5(theContext->mInputData, theContext->mNumberFrames);
+		return;
+	}
+	
+	ParallelEncodeRange & theRange = theEncoder->mParallelRanges[inTaskIndex];
+	FLAC__StreamEncoder * theFLACEncoder = theRange.mEncoder;
+	UInt32 theFramesPerPacket = theEncoder->mFramesPerPacket;
+	bool theStarted = (FLAC__stream_encoder_get_state(theFLACEncoder) == FLAC__STREAM_ENCODER_OK);
+	
+	theRange.mSucceeded = true;
+	theRange.mEncodeSeconds = 0.0;
+	theRange.mFramesTimed = 0;
+	
+	// the range's packets are the ones whose frame numbers come to its index
+	for (UInt32 thePacket = (inTaskIndex + theNumberRanges - theContext->mFirstFrameNumber % theNumberRanges) % theNumberRanges;
+		 thePacket * theFramesPerPacket < theContext->mNumberFrames; thePacket += theNumberRanges)
+	{
+		UInt32 theFirstFrame = thePacket * theFramesPerPacket;
+		UInt32 theNumberFrames = theContext->mNumberFrames - theFirstFrame;
+		
+		if (theNumberFrames > theFramesPerPacket)
+		{
+			theNumberFrames = theFramesPerPacket;
+		}
+		if ( (!theStarted || (theRange.mCompressionLevel != theEncoder->mCompressionLevel)) && !theEncoder->StartRangeEncoder(theRange) )
+		{
+			theRange.mSucceeded = false;
+			return;
+		}
+		theStarted = true;
+		
+		UInt32 theFramesOut = theRange.mPacketDescriptions.size();
+		struct timeval theStartTime, theEndTime;
+		gettimeofday(&theStartTime, NULL);
+		if (!FLAC__stream_encoder_process_interleaved(theFLACEncoder, (const FLAC__int32 *)theContext->mInputData + theFirstFrame * theEncoder->mInputFormat.mChannelsPerFrame, theNumberFrames))
+		{
+			theRange.mSucceeded = false;
+			return;
+		}
+		gettimeofday(&theEndTime, NULL);
+		
+		// libFLAC only encodes a packet once it has the next one, so the time goes to the frame that came out, if any
+		if (theRange.mPacketDescriptions.size() > theFramesOut)
+		{
+			theRange.mEncodeSeconds += (theEndTime.tv_sec - theStartTime.tv_sec) + (theEndTime.tv_usec - theStartTime.tv_usec) * 1.0e-6;
+			theRange.mFramesTimed += theFramesPerPacket;
+		}
+	}
+	
+	// finish gets out the frame the encoder is holding on to
+	if (theContext->mLastPackets && theStarted)
+	{
+		FLAC__stream_encoder_finish(theFLACEncoder);
+	}
+}
+
+// Starts a range's encoder at the current level, finishing it first if it's been started -- which gets
+// out the frame it was holding on to, encoded at the level it was started with
+bool ACFLACEncoder::StartRangeEncoder(ParallelEncodeRange & ioRange)
+{
+	if (FLAC__stream_encoder_get_state(ioRange.mEncoder) != FLAC__STREAM_ENCODER_UNINITIALIZED)
+	{
+		FLAC__stream_encoder_finish(ioRange.mEncoder);
+	}
+	ConfigureEncoder(ioRange.mEncoder);
+	FLAC__stream_encoder_set_do_md5(ioRange.mEncoder, false);
+	ioRange.mCompressionLevel = mCompressionLevel;
+	return FLAC__stream_encoder_init_stream(ioRange.mEncoder, parallel_encoder_write_callback, NULL, NULL, NULL, &ioRange) == FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+}
+
+// Rewrites the frame number in a frame's header, which means new CRCs for both the header and the frame
+void ACFLACEncoder::AppendRenumberedFrame(const Byte * inFrame, UInt32 inFrameByteSize, UInt32 inFrameNumber, std::vector<Byte> & ioOutput)
+{
+	// the coded number starts after the 4 fixed header bytes, its length is in the leading 1s of the first byte
+	UInt32 theNumberByteSize = 1;
+	if (inFrame[4] & 0x80)
+	{
+		theNumberByteSize = 0;
+		while ( (theNumberByteSize < 8) && (inFrame[4] & (0x80 >> theNumberByteSize)) )
+		{
+			++theNumberByteSize;
+		}
+	}
+	
+	// then an optional block size and sample rate
+	UInt32 theExtraByteSize = 0;
+	UInt32 theBlockSizeCode = inFrame[2] >> 4;
+	UInt32 theSampleRateCode = inFrame[2] & 0x0F;
+	if (theBlockSizeCode == 6)
+	{
+		theExtraByteSize += 1;
+	}
+	else if (theBlockSizeCode == 7)
+	{
+		theExtraByteSize += 2;
+	}
+	if (theSampleRateCode == 12)
+	{
+		theExtraByteSize += 1;
+	}
+	else if ( (theSampleRateCode == 13) || (theSampleRateCode == 14) )
+	{
+		theExtraByteSize += 2;
+	}
+	
+	UInt32 theFrameStart = ioOutput.size();
+	
+	ioOutput.insert(ioOutput.end(), inFrame, inFrame + 4);
+	
+	// the frame number, UTF-8 style
+	if (inFrameNumber < 0x80)
+	{
+		ioOutput.push_back((Byte)inFrameNumber);
+	}
+	else
+	{
+		UInt32 theCodedByteSize = 2;
+		if (inFrameNumber >= 0x4000000)
+		{
+			theCodedByteSize = 6;
+		}
+		else if (inFrameNumber >= 0x200000)
+		{
+			theCodedByteSize = 5;
+		}
+		else if (inFrameNumber >= 0x10000)
+		{
+			theCodedByteSize = 4;
+		}
+		else if (inFrameNumber >= 0x800)
+		{
+			theCodedByteSize = 3;
+		}
+		ioOutput.push_back((Byte)(0xFF00 >> theCodedByteSize) | (Byte)(inFrameNumber >> (6 * (theCodedByteSize - 1))));
+		for (SInt32 i = theCodedByteSize - 2; i >= 0; --i)
+		{
+			ioOutput.push_back((Byte)(0x80 | ((inFrameNumber >> (6 * i)) & 0x3F)));
+		}
+	}
+	
+	const Byte * theExtra = inFrame + 4 + theNumberByteSize;
+	ioOutput.insert(ioOutput.end(), theExtra, theExtra + theExtraByteSize);
+	ioOutput.push_back(FLAC__crc8(&ioOutput[theFrameStart], ioOutput.size() - theFrameStart));
+	
+	// the subframes are untouched, but the CRC-16 at the end covers everything before it
+	const Byte * theSubframes = theExtra + theExtraByteSize + 1;
+	ioOutput.insert(ioOutput.end(), theSubframes, inFrame + inFrameByteSize - 2);
+	UInt32 theCRC = FLAC__crc16(&ioOutput[theFrameStart], ioOutput.size() - theFrameStart);
+	ioOutput.push_back((Byte)(theCRC >> 8));
+	ioOutput.push_back((Byte)theCRC);
+}
+
+// The MD5 has to see the samples in order, so it can't be split up like the frames
+void ACFLACEncoder::AccumulateMD5(const SInt32 * inInputData, UInt32 inNumberFrames)
+{
+	UInt32 theNumberChannels = mInputFormat.mChannelsPerFrame;
+	const FLAC__int32 * theChannels[kFLACMaxChannels];
+	
+	for (UInt32 theChannel = 0; theChannel < theNumberChannels; ++theChannel)
+	{
+		theChannels[theChannel] = &mMD5Signal[theChannel * mFramesPerPacket];
+	}
+	
+	while (inNumberFrames > 0)
+	{
+		UInt32 theNumberFrames = (inNumberFrames < mFramesPerPacket) ? inNumberFrames : mFramesPerPacket;
+		
+		for (UInt32 i = 0; i < theNumberFrames; ++i)
+		{
+			for (UInt32 theChannel = 0; theChannel < theNumberChannels; ++theChannel)
+			{
+				mMD5Signal[theChannel * mFramesPerPacket + i] = inInputData[i * theNumberChannels + theChannel];
+			}
+		}
+		FLAC__MD5Accumulate(&mMD5Context, theChannels, theNumberChannels, theNumberFrames, (mBitDepth + 7) / 8);
+		
+		inInputData += theNumberFrames * theNumberChannels;
+		inNumberFrames -= theNumberFrames;
+	}
+}
+
+// mEncoder hasn't seen any of the audio, or in adaptive mode only what came since it was last started, so
+// its STREAMINFO only has the format right -- the rest we kept track of
+void ACFLACEncoder::FinishStreamInfo()
+{
+	FLAC__stream_encoder_finish(mEncoder);
+	mStreamInfo.min_framesize = mMinFrameBytesEncoded;
+	mStreamInfo.max_framesize = mMaxFrameBytesEncoded;
+	mStreamInfo.total_samples = mSamplesEncoded;
+	if (mMD5Pipeline != NULL)
+	{
+		mMD5Pipeline->Finish(mStreamInfo.md5sum);
+	}
+	else if (mMD5Mode == kFLACMD5Inline)
+	{
+		FLAC__MD5Final(mStreamInfo.md5sum, &mMD5Context);
+	}
+	// and when skipped, mEncoder wasn't asked for a signature so it left zeros
+}
+
+//=============================================================================
+//	ACFLACEncoder::MD5Pipeline
+//=============================================================================
+
+ACFLACEncoder::MD5Pipeline::MD5Pipeline(UInt32 inNumberChannels, UInt32 inBytesPerSample, UInt32 inFramesPerBlock)
+:
+	mNumberChannels(inNumberChannels),
+	mBytesPerSample(inBytesPerSample),
+	mFramesPerBlock(inFramesPerBlock),
+	mBlocks(kFLACMD5QueuePackets),
+	mBlockFrames(kFLACMD5QueuePackets, 0),
+	mNextBlockIn(0),
+	mNextBlockOut(0),
+	mNumberBlocksQueued(0),
+	mThreadRunning(false),
+	mQuit(false)
+{
+	for (UInt32 i = 0; i < mBlocks.size(); ++i)
+	{
+		mBlocks[i].resize(inFramesPerBlock * inNumberChannels);
+	}
+	FLAC__MD5Init(&mContext);
+	
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mWorkCondition, NULL);
+	pthread_cond_init(&mSpaceCondition, NULL);
+	
+	// without the thread, Append does the hashing itself
+	mThreadRunning = (pthread_create(&mThread, NULL, ThreadEntry, this) == 0);
+}
+
+ACFLACEncoder::MD5Pipeline::~MD5Pipeline()
+{
+	if (mThreadRunning)
+	{
+		pthread_mutex_lock(&mMutex);
+		mQuit = true;
+		pthread_cond_signal(&mWorkCondition);
+		pthread_mutex_unlock(&mMutex);
+		pthread_join(mThread, NULL);
+	}
+	
+	// frees the context's buffer
+	FLAC__byte theDigest[16];
+	FLAC__MD5Final(theDigest, &mContext);
+	
+	pthread_cond_destroy(&mSpaceCondition);
+	pthread_cond_destroy(&mWorkCondition);
+	pthread_mutex_destroy(&mMutex);
+}
+
+void ACFLACEncoder::MD5Pipeline::Append(const SInt32 * inInputData, UInt32 inNumberFrames)
+{
+	while (inNumberFrames > 0)
+	{
+		UInt32 theNumberFrames = (inNumberFrames < mFramesPerBlock) ? inNumberFrames : mFramesPerBlock;
+		
+		pthread_mutex_lock(&mMutex);
+		while (mNumberBlocksQueued == mBlocks.size())
+		{
+			pthread_cond_wait(&mSpaceCondition, &mMutex);
+		}
+		pthread_mutex_unlock(&mMutex);
+		
+		// the block at mNextBlockIn isn't the thread's until it's queued
+		std::vector<FLAC__int32> & theBlock = mBlocks[mNextBlockIn];
+		for (UInt32 i = 0; i < theNumberFrames; ++i)
+		{
+			for (UInt32 theChannel = 0; theChannel < mNumberChannels; ++theChannel)
+			{
+				theBlock[theChannel * mFramesPerBlock + i] = inInputData[i * mNumberChannels + theChannel];
+			}
+		}
+		mBlockFrames[mNextBlockIn] = theNumberFrames;
+		
+		if (mThreadRunning)
+		{
+			pthread_mutex_lock(&mMutex);
+			mNextBlockIn = (mNextBlockIn + 1) % mBlocks.size();
+			++mNumberBlocksQueued;
+			pthread_cond_signal(&mWorkCondition);
+			pthread_mutex_unlock(&mMutex);
+		}
+		else
+		{
+			HashBlock(mNextBlockIn);
+		}
+		
+		inInputData += theNumberFrames * mNumberChannels;
+		inNumberFrames -= theNumberFrames;
+	}
+}
+
+void ACFLACEncoder::MD5Pipeline::Finish(FLAC__byte outDigest[16])
+{
+	pthread_mutex_lock(&mMutex);
+	while (mNumberBlocksQueued > 0)
+	{
+		pthread_cond_wait(&mSpaceCondition, &mMutex);
+	}
+	pthread_mutex_unlock(&mMutex);
+	
+	// the thread is idle until the next Append
+	FLAC__MD5Final(outDigest, &mContext);
+	FLAC__MD5Init(&mContext);
+}
+
+UInt32 ACFLACEncoder::MD5Pipeline::GetByteSize() const
+{
+	return sizeof(*this) + mBlocks.size() * mFramesPerBlock * mNumberChannels * sizeof(FLAC__int32);
+}
+
+void * ACFLACEncoder::MD5Pipeline::ThreadEntry(void * inPipeline)
+{
+	static_cast<MD5Pipeline *>(inPipeline)->ThreadLoop();
+	return NULL;
+}
+
+void ACFLACEncoder::MD5Pipeline::ThreadLoop()
+{
+	pthread_mutex_lock(&mMutex);
+	while (true)
+	{
+		while ( (mNumberBlocksQueued == 0) && !mQuit )
+		{
+			pthread_cond_wait(&mWorkCondition, &mMutex);
+		}
+		if (mNumberBlocksQueued == 0)
+		{
+			break;
+		}
+		
+		// the lock is dropped while hashing so Append can fill the next block
+		UInt32 theBlock = mNextBlockOut;
+		pthread_mutex_unlock(&mMutex);
+		HashBlock(theBlock);
+		pthread_mutex_lock(&mMutex);
+		
+		mNextBlockOut = (mNextBlockOut + 1) % mBlocks.size();
+		--mNumberBlocksQueued;
+		pthread_cond_signal(&mSpaceCondition);
+	}
+	pthread_mutex_unlock(&mMutex);
+}
+
+void ACFLACEncoder::MD5Pipeline::HashBlock(UInt32 inBlock)
+{
+	const FLAC__int32 * theChannels[kFLACMaxChannels];
+	
+	for (UInt32 theChannel = 0; theChannel < mNumberChannels; ++theChannel)
+	{
+		theChannels[theChannel] = &mBlocks[inBlock][theChannel * mFramesPerBlock];
+	}
+	FLAC__MD5Accumulate(&mContext, theChannels, mNumberChannels, mBlockFrames[inBlock], mBytesPerSample);
+}
+
+FLAC__StreamEncoderWriteStatus ACFLACEncoder::parallel_encoder_write_callback(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	ParallelEncodeRange * theRange = static_cast<ParallelEncodeRange *>(client_data);
+	
+	(void)encoder, (void)current_frame;
+
+	// metadata writes have no samples, and the range encoders' metadata isn't wanted
+	if (samples == 0)
+	{
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+	}
+	
+	AudioStreamPacketDescription thePacket;
+	thePacket.mStartOffset = theRange->mOutput.size();
+	thePacket.mVariableFramesInPacket = samples;
+	AppendRenumberedFrame(buffer, bytes, theRange->mNextFrameNumber, theRange->mOutput);
+	thePacket.mDataByteSize = theRange->mOutput.size() - thePacket.mStartOffset;
+	theRange->mPacketDescriptions.push_back(thePacket);
+	// current_frame starts over whenever the encoder does
+	theRange->mNextFrameNumber += theRange->mFrameNumberStep;
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
 
 UInt32	ACFLACEncoder::GetVersion() const
 {
@@ -976,7 +1800,10 @@ UInt32	ACFLACEncoder::GetVersion() const
 
 UInt32	ACFLACEncoder::GetInputBufferByteSize() const
 {
-	return kInputBufferPackets * kFLACNumberSupportedChannelTotals * sizeof(SInt32);
+	// in the caller's bytes, the buffer itself holds the widened samples -- until it's
+	// allocated, this is what Initialize would allocate for the current format
+	UInt32 theByteSize = (mInputBuffer != NULL) ? mInputBufferByteSize : CalculateInputBufferByteSize();
+	return (theByteSize / (sizeof(SInt32) * mInputFormat.mChannelsPerFrame)) * mInputFormat.mBytesPerFrame;
 }
 
 UInt32	ACFLACEncoder::GetUsedInputBufferByteSize() const
@@ -986,6 +1813,58 @@ UInt32	ACFLACEncoder::GetUsedInputBufferByteSize() const
 
 void ACFLACEncoder::ReallocateInputBuffer(UInt32 inInputBufferByteSize)
 {
+	// the format might not be settled yet, so the buffer waits for Initialize
+	mRequestedInputBufferByteSize = inInputBufferByteSize;
+	if (mIsInitialized)
+	{
+		AllocateInputBuffer();
+	}
+}
+
+// The size of the SInt32 buffer for the current format: what the caller asked for, but never less
+// than a packet for each encoder. Without a request it's mInputBufferPackets for each encoder, so a
+// call still encodes several packets.
+UInt32 ACFLACEncoder::CalculateInputBufferByteSize() const
+{
+	UInt32 theNumberEncoders = mParallelRanges.empty() ? 1 : mParallelRanges.size();
+	UInt32 thePacketByteSize = mFramesPerPacket * mInputFormat.mChannelsPerFrame * sizeof(SInt32);
+	UInt32 theMinimumByteSize = theNumberEncoders * thePacketByteSize;
+	UInt32 theByteSize = (mRequestedInputBufferByteSize / mInputFormat.mBytesPerFrame) * mInputFormat.mChannelsPerFrame * sizeof(SInt32);
+	
+	if (mRequestedInputBufferByteSize == 0)
+	{
+		theByteSize = theNumberEncoders * mInputBufferPackets * thePacketByteSize;
+	}
+	return (theByteSize > theMinimumByteSize) ? theByteSize : theMinimumByteSize;
+}
+
+void ACFLACEncoder::AllocateInputBuffer()
+{
+	delete[] mInputBuffer;
+	mInputBufferByteSize = CalculateInputBufferByteSize();
+	mInputBuffer = new SInt32[mInputBufferByteSize / sizeof(SInt32)];
+	mInputBufferBytesUsed = 0;
+}
+
+UInt32 ACFLACEncoder::GetMemoryFootprint() const
+{
+	UInt32 theByteSize = sizeof(*this) + mInputBufferByteSize;
+	
+	theByteSize += mPendingOutput.capacity() + mPendingPacketDescriptions.capacity() * sizeof(AudioStreamPacketDescription);
+	theByteSize += mRenumberedFrame.capacity();
+	theByteSize += mMD5Signal.capacity() * sizeof(FLAC__int32);
+	theByteSize += mCompressionLevelHistory.capacity() * sizeof(FLACCompressionLevelChange);
+	theByteSize += mSeekIndex.capacity() * sizeof(FLAC__StreamMetadata_SeekPoint);
+	if (mMD5Pipeline != NULL)
+	{
+		theByteSize += mMD5Pipeline->GetByteSize();
+	}
+	theByteSize += mParallelRanges.capacity() * sizeof(ParallelEncodeRange);
+	for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+	{
+		theByteSize += mParallelRanges[i].mOutput.capacity() + mParallelRanges[i].mPacketDescriptions.capacity() * sizeof(AudioStreamPacketDescription);
+	}
+	return theByteSize;
 }
 
 void	ACFLACEncoder::Reset()
@@ -995,29 +1874,57 @@ void	ACFLACEncoder::Reset()
 	mFinished = false;
 	mTrailingFrames = 0;
 	mInputBufferBytesUsed = 0;
-	mTotalBytesGenerated = 0;
 	mOutputBytes = 0;
 	if (mIsInitialized)
 	{
 		// This call is safe since if it's already uninitialized it'll just return
 		FLAC__stream_encoder_finish(mEncoder);
+		// and anything it flushed is tossed
+		mPendingOutput.clear();
+		mPendingPacketDescriptions.clear();
+		mTotalBytesGenerated = 0;
 		// Now set up the encoder -- yes, we must do all of this again
-		FLAC__stream_encoder_set_streamable_subset(mEncoder, false);
-		FLAC__stream_encoder_set_channels(mEncoder, mInputFormat.mChannelsPerFrame);
-		
-		FLAC__stream_encoder_set_bits_per_sample(mEncoder, mBitDepth);
-		FLAC__stream_encoder_set_sample_rate(mEncoder, (UInt32)mInputFormat.mSampleRate);
-		FLAC__stream_encoder_set_blocksize(mEncoder, kFramesPerPacket);
-
-		// Now, we set the compression level. We used the kAudioCodecPropertyQualitySetting to determine this. Min 0, max 8
-		SetCompressionLevel(mQuality);	
+		mCompressionLevel = mQuality;
+		StartCompressionLevelHistory();
+		mSeekIndex.clear();
+		ConfigureEncoder(mEncoder);
 		// These must be set up again
 		FLAC__stream_encoder_init_stream(mEncoder,
 										 stream_encoder_write_callback,
 										 NULL,
 										 NULL,
 										 stream_encoder_metadata_callback,
-										 NULL);
+										 this);
+		if (mWorkerPool != NULL)
+		{
+			// the range encoders start over with the next packet, and whatever they were holding on to is tossed
+			for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+			{
+				ParallelEncodeRange & theRange = mParallelRanges[i];
+				
+				FLAC__stream_encoder_finish(theRange.mEncoder);
+				theRange.mOutput.clear();
+				theRange.mPacketDescriptions.clear();
+				theRange.mNextFrameNumber = i;
+			}
+		}
+		if ( (mWorkerPool != NULL) || (mAdaptiveCPUBudget > 0.0) )
+		{
+			// start the MD5 over
+			FLAC__byte theDigest[16];
+			FLAC__MD5Final(theDigest, &mMD5Context);
+			FLAC__MD5Init(&mMD5Context);
+		}
+		if (mMD5Pipeline != NULL)
+		{
+			FLAC__byte theDigest[16];
+			mMD5Pipeline->Finish(theDigest);
+		}
+		mNextFrameNumber = 0;
+		mNextFrameOut = 0;
+		mSamplesEncoded = 0;
+		mMinFrameBytesEncoded = 0;
+		mMaxFrameBytesEncoded = 0;
 	}
 	
 	//	let our base class clean up it's internal state
@@ -1031,7 +1938,6 @@ void ACFLACEncoder::Uninitialize()
 	mFinished = false;
 	mTrailingFrames = 0;
 	mInputBufferBytesUsed = 0;
-	mTotalBytesGenerated = 0;
 	mOutputBytes = 0;
 	mEncoderState = FLAC__stream_encoder_get_state(mEncoder);
 	if (mEncoderState != FLAC__STREAM_ENCODER_UNINITIALIZED)
@@ -1039,79 +1945,149 @@ void ACFLACEncoder::Uninitialize()
 		FLAC__stream_encoder_finish(mEncoder);
 		mEncoderState = FLAC__stream_encoder_get_state(mEncoder);
 	}
+	// anything the finish flushed is tossed, and the buffers go until the next Initialize
+	std::vector<Byte>().swap(mPendingOutput);
+	std::vector<AudioStreamPacketDescription>().swap(mPendingPacketDescriptions);
+	delete[] mInputBuffer;
+	mInputBuffer = NULL;
+	mInputBufferByteSize = 0;
+	mTotalBytesGenerated = 0;
+	std::vector<Byte>().swap(mRenumberedFrame);
+	if ( (mWorkerPool != NULL) || (mAdaptiveCPUBudget > 0.0) )
+	{
+		std::vector<FLAC__int32>().swap(mMD5Signal);
+		// frees the MD5's buffer
+		FLAC__byte theDigest[16];
+		FLAC__MD5Final(theDigest, &mMD5Context);
+	}
+	if (mWorkerPool != NULL)
+	{
+		delete mWorkerPool;
+		mWorkerPool = NULL;
+		for (UInt32 i = 0; i < mParallelRanges.size(); ++i)
+		{
+			FLAC__stream_encoder_delete(mParallelRanges[i].mEncoder);
+		}
+		std::vector<ParallelEncodeRange>().swap(mParallelRanges);
+	}
+	std::vector<FLACCompressionLevelChange>().swap(mCompressionLevelHistory);
+	std::vector<FLAC__StreamMetadata_SeekPoint>().swap(mSeekIndex);
+	delete mMD5Pipeline;
+	mMD5Pipeline = NULL;
+	mNextFrameNumber = 0;
+	mNextFrameOut = 0;
+	mSamplesEncoded = 0;
+	mMinFrameBytesEncoded = 0;
+	mMaxFrameBytesEncoded = 0;
 	ACFLACCodec::Uninitialize();
 }
 
+// The block size -- only while uninitialized, everything else is sized from it in Initialize
+void ACFLACEncoder::SetFramesPerPacket(UInt32 inFramesPerPacket)
+{
+	if ( (inFramesPerPacket < kMinFramesPerPacket) || (inFramesPerPacket > kMaxFramesPerPacket) )
+	{
+		CODEC_THROW(kAudioCodecUnsupportedFormatError);
+	}
+	mFramesPerPacket = inFramesPerPacket;
+	mOutputFormat.mFramesPerPacket = inFramesPerPacket;
+}
+
+// Everything but the callbacks -- libFLAC forgets all of this on finish
+void ACFLACEncoder::ConfigureEncoder(FLAC__StreamEncoder * inEncoder)
+{
+	FLAC__stream_encoder_set_streamable_subset(inEncoder, false);
+	FLAC__stream_encoder_set_channels(inEncoder, mInputFormat.mChannelsPerFrame);
+	
+	FLAC__stream_encoder_set_bits_per_sample(inEncoder, mBitDepth);
+	FLAC__stream_encoder_set_sample_rate(inEncoder, (UInt32)mInputFormat.mSampleRate);
+	FLAC__stream_encoder_set_blocksize(inEncoder, mFramesPerPacket);
+	// in adaptive mode the MD5 is worked out alongside, since the encoder is started over to change level
+	FLAC__stream_encoder_set_do_md5(inEncoder, (mMD5Mode == kFLACMD5Inline) && (mAdaptiveCPUBudget == 0.0));
+
+	// Now, we set the compression level. We used the kAudioCodecPropertyQualitySetting to determine this
+	// (adaptive mode can take it lower). Min 0, max 8
+	SetCompressionLevel(inEncoder, mCompressionLevel);	
+	
+	// Loose mid-side only tries every channel assignment now and then and keeps the last one in between,
+	// state that depends on which packets an encoder has seen, and each frame encoder only sees every so
+	// many. The frame encoders search every frame instead, so their output doesn't depend on the number of threads.
+	if (mWorkerPool != NULL)
+	{
+		FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, false);
+	}
+}
+
 // Implements FLAC__stream_encoder_set_compression_level()
 // FLAC__stream_encoder_set_apodization() is not set
-void ACFLACEncoder::SetCompressionLevel(UInt32 theCompressionLevel)
+void ACFLACEncoder::SetCompressionLevel(FLAC__StreamEncoder * inEncoder, UInt32 theCompressionLevel)
 {
 	Boolean theStatus1, theStatus2, theStatus3, theStatus4, theStatus5;
 
 	switch(theCompressionLevel)
 	{
 		case 0:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, false);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, false);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 0);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, false);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 3);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, false);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, false);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 0);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, false);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 3);
 			break;
 		case 1:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, true);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, true);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 0);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, false);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 3);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, true);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, true);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 0);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, false);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 3);
 			break;
 		case 2:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, true);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, false);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 0);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, false);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 3);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, true);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, false);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 0);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, false);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 3);
 			break;
 		case 3:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, false);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, false);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 6);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, false);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 4);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, false);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, false);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 6);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, false);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 4);
 			break;
 		case 4:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, true);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, true);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 8);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, false);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 4);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, true);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, true);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 8);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, false);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 4);
 			break;
 		case 5:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, true);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, false);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 8);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, false);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 5);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, true);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, false);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 8);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, false);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 5);
 			break;
 		case 6:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, true);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, false);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 8);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, false);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 6);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, true);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, false);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 8);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, false);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 6);
 			break;
 		case 7:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, true);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, false);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 8);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, true);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 6);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, true);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, false);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 8);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, true);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 6);
 			break;
 		case 8:
-			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(mEncoder, true);
-			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(mEncoder, false);
-			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(mEncoder, 12);
-			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(mEncoder, true);
-			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(mEncoder, 6);
+			theStatus1 = FLAC__stream_encoder_set_do_mid_side_stereo(inEncoder, true);
+			theStatus2 = FLAC__stream_encoder_set_loose_mid_side_stereo(inEncoder, false);
+			theStatus3 = FLAC__stream_encoder_set_max_lpc_order(inEncoder, 12);
+			theStatus4 = FLAC__stream_encoder_set_do_exhaustive_model_search(inEncoder, true);
+			theStatus5 = FLAC__stream_encoder_set_max_residual_partition_order(inEncoder, 6);
 			break;
 	}
 #if VERBOSE
@@ -1138,11 +2114,15 @@ OSStatus ACFLACEncoder::BuildSettingsDictionary(CFDictionaryRef * theSettingsRef
 
 	CACFArray theParameters(false);
 	CACFDictionary	theCompressionLevel(false),
+					theBlockSize(false),
+					theMD5Signature(false),
 					theSettings(false);
 	unsigned int i = 0;
 
 	// Build the parameter dictionaries
 	CACFArray theCompressionLevelValues(false);
+	CACFArray theBlockSizeValues(false);
+	CACFArray theMD5SignatureValues(false);
 
 
 	// Compression Level
@@ -1162,6 +2142,41 @@ OSStatus ACFLACEncoder::BuildSettingsDictionary(CFDictionaryRef * theSettingsRef
 	if (!theCompressionLevel.AddString(kSummary, CFCopyLocalizedStringFromTableInBundle( CFSTR("The compression level of the FLAC encoder"), CFSTR("CodecNames"), GetCodecBundle(), CFSTR("") ) ) ) goto cleanup;
 	if (!theCompressionLevel.AddString(kUnit, CFCopyLocalizedStringFromTableInBundle( CFSTR(""), CFSTR("CodecNames"), GetCodecBundle(), CFSTR("") ) ) ) goto cleanup;
 		
+	// Block Size -- the common sizes are offered, but anything from kMinFramesPerPacket
+	// to kMaxFramesPerPacket is taken here or with kAudioCodecPropertyPacketFrameSize
+	for (i = 0; i < sizeof(kFLACBlockSizes) / sizeof(UInt32); i++)
+	{
+		if (!theBlockSizeValues.AppendUInt32(kFLACBlockSizes[i]) ) goto cleanup;
+	}
+	
+	if (!theBlockSize.AddString(kSettingKey, CFSTR("Block Size") ) ) goto cleanup;
+	if (!theBlockSize.AddString(kSettingName, CFCopyLocalizedStringFromTableInBundle( CFSTR("Block Size"), CFSTR("CodecNames"), GetCodecBundle(), CFSTR("") ) ) ) goto cleanup;
+	if (!theBlockSize.AddUInt32(kValueType, CFNumberGetTypeID() ) ) goto cleanup;
+	if (!theBlockSize.AddArray(kAvailableValues, theBlockSizeValues.GetCFArray() ) ) goto cleanup;
+	theBlockSizeValues.ShouldRelease(true);
+
+	if (!theBlockSize.AddUInt32(kCurrentValue, mFramesPerPacket) ) goto cleanup;
+	if (!theBlockSize.AddSInt32(kHint, 0) ) goto cleanup;
+	if (!theBlockSize.AddString(kSummary, CFCopyLocalizedStringFromTableInBundle( CFSTR("The number of frames in each FLAC packet -- smaller packets have less latency, larger ones encode faster"), CFSTR("CodecNames"), GetCodecBundle(), CFSTR("") ) ) ) goto cleanup;
+	if (!theBlockSize.AddString(kUnit, CFCopyLocalizedStringFromTableInBundle( CFSTR("frames"), CFSTR("CodecNames"), GetCodecBundle(), CFSTR("") ) ) ) goto cleanup;
+	
+	// MD5 Signature -- kFLACMD5Inline, kFLACMD5Offloaded or kFLACMD5Skipped
+	for (i = kFLACMD5Inline; i <= kFLACMD5Skipped; i++)
+	{
+		if (!theMD5SignatureValues.AppendUInt32(i) ) goto cleanup;
+	}
+	
+	if (!theMD5Signature.AddString(kSettingKey, CFSTR("MD5 Signature") ) ) goto cleanup;
+	if (!theMD5Signature.AddString(kSettingName, CFCopyLocalizedStringFromTableInBundle( CFSTR("MD5 Signature"), CFSTR("CodecNames"), GetCodecBundle(), CFSTR("") ) ) ) goto cleanup;
+	if (!theMD5Signature.AddUInt32(kValueType, CFNumberGetTypeID() ) ) goto cleanup;
+	if (!theMD5Signature.AddArray(kAvailableValues, theMD5SignatureValues.GetCFArray() ) ) goto cleanup;
+	theMD5SignatureValues.ShouldRelease(true);
+
+	if (!theMD5Signature.AddUInt32(kCurrentValue, mMD5Mode) ) goto cleanup;
+	if (!theMD5Signature.AddSInt32(kHint, 0) ) goto cleanup;
+	if (!theMD5Signature.AddString(kSummary, CFCopyLocalizedStringFromTableInBundle( CFSTR("How the signature of the audio is worked out -- 0 while encoding, 1 on a separate thread, 2 not at all"), CFSTR("CodecNames"), GetCodecBundle(), CFSTR("") ) ) ) goto cleanup;
+	if (!theMD5Signature.AddString(kUnit, CFCopyLocalizedStringFromTableInBundle( CFSTR(""), CFSTR("CodecNames"), GetCodecBundle(), CFSTR("") ) ) ) goto cleanup;
+	
 	
 	// Now build the top level Settings dictionary
 	// Add the codec name
@@ -1170,6 +2185,10 @@ OSStatus ACFLACEncoder::BuildSettingsDictionary(CFDictionaryRef * theSettingsRef
 	// Build the parameters array 
 	if (!theParameters.AppendDictionary(theCompressionLevel.GetCFDictionary() ) ) goto cleanup;
 	theCompressionLevel.ShouldRelease(true);
+	if (!theParameters.AppendDictionary(theBlockSize.GetCFDictionary() ) ) goto cleanup;
+	theBlockSize.ShouldRelease(true);
+	if (!theParameters.AppendDictionary(theMD5Signature.GetCFDictionary() ) ) goto cleanup;
+	theMD5Signature.ShouldRelease(true);
 	
 	// Add the parameters to the dictionary
 	if (!theSettings.AddArray(kParameters, theParameters.GetCFArray() ) ) goto cleanup;	
@@ -1227,6 +2246,24 @@ OSStatus ACFLACEncoder::ParseSettingsDictionary(CFDictionaryRef theNewSettings)
 				if (!theCurrentSetting.GetUInt32(kCurrentValue, (UInt32&)theCurrentValue) ) return -1;
 				mQuality = theCurrentValue; // we're a 0-based index, makes this simple
 			}
+			else if (currentKey == CACFString(CFSTR("Block Size"), false ) )
+			{
+				// Get the current value of the Block Size setting -- it can only change while we're uninitialized
+				if (!theCurrentSetting.GetUInt32(kCurrentValue, (UInt32&)theCurrentValue) ) return -1;
+				if (!mIsInitialized && (theCurrentValue != mFramesPerPacket) )
+				{
+					SetFramesPerPacket(theCurrentValue);
+				}
+			}
+			else if (currentKey == CACFString(CFSTR("MD5 Signature"), false ) )
+			{
+				// Get the current value of the MD5 Signature setting -- it can only change while we're uninitialized
+				if (!theCurrentSetting.GetUInt32(kCurrentValue, (UInt32&)theCurrentValue) ) return -1;
+				if (!mIsInitialized && (theCurrentValue <= kFLACMD5Skipped) )
+				{
+					mMD5Mode = theCurrentValue;
+				}
+			}
 		}
 		
 		++theSettingIndex;
@@ -1238,22 +2275,36 @@ OSStatus ACFLACEncoder::ParseSettingsDictionary(CFDictionaryRef theNewSettings)
 // Call backs
 FLAC__StreamEncoderWriteStatus ACFLACEncoder::stream_encoder_write_callback(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
 {
-	(void)encoder, (void)samples, (void)current_frame, (void)client_data;
-#if VERBOSE	
-	printf("Writing %lu bytes at offset %lu\n", bytes, mOutputBytes);
-#endif
-	memcpy (mOutputBuffer + mOutputBytes, buffer, bytes);
-	mOutputBytes += bytes;
+	ACFLACEncoder * theEncoder = static_cast<ACFLACEncoder *>(client_data);
+
+	(void)encoder;
+	
+	// metadata writes have no samples -- the stream info goes out in the magic cookie instead
+	if (samples == 0)
+	{
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+	}
+	// adaptive mode starts the encoder over, and with it the frame numbers
+	if (current_frame != theEncoder->mNextFrameOut)
+	{
+		theEncoder->mRenumberedFrame.clear();
+		AppendRenumberedFrame(buffer, bytes, theEncoder->mNextFrameOut, theEncoder->mRenumberedFrame);
+		theEncoder->WritePacket(&theEncoder->mRenumberedFrame[0], theEncoder->mRenumberedFrame.size(), samples);
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+	}
+	theEncoder->WritePacket(buffer, bytes, samples);
 	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
 }
 
 void ACFLACEncoder::stream_encoder_metadata_callback(const FLAC__StreamEncoder *encoder, const FLAC__StreamMetadata *metadata, void *client_data)
 {
-	(void)encoder, (void)client_data;
+	ACFLACEncoder * theEncoder = static_cast<ACFLACEncoder *>(client_data);
+
+	(void)encoder;
 	if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
 	{
-		mCookieDefined = true;
-		memcpy(&mStreamInfo, &(metadata->data), sizeof(FLAC__StreamMetadata_StreamInfo));
+		theEncoder->mCookieDefined = true;
+		memcpy(&(theEncoder->mStreamInfo), &(metadata->data), sizeof(FLAC__StreamMetadata_StreamInfo));
 	}
 }
 
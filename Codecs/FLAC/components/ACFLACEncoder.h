@@ -56,12 +56,68 @@
 #include "CACFDictionary.h"
 #include "CACFString.h"
 #include "CACFArray.h"
+#include "private/md5.h"
+#include <pthread.h>
+
+class ACWorkerPool;
 
 enum
 {
 	kFLACMaxChannels	= 8
 };
 
+//	Private properties
+enum
+{
+	//	UInt32, the number of threads used to encode. 0 or 1 (the default) encodes
+	//	everything on the calling thread with one libFLAC encoder. Otherwise each
+	//	thread gets an encoder of its own for the whole stream and the whole packets
+	//	in the input buffer are dealt out between them. An encoder holds on to its
+	//	last packet until its next one comes along, so the packets out can run up to
+	//	one per thread behind the packets in. By default the input buffer holds a
+	//	few packets for every thread, but callers will want to grow it further with
+	//	kAudioCodecPropertyInputBufferSize. Only settable while uninitialized.
+	//	The frame encoders never use loose mid-side stereo, so the output is the same
+	//	whatever the number of threads, but at compression levels 1 and 4 it isn't
+	//	the same as the single encoder's.
+	kFLACEncoderPropertyEncodeThreadCount = 'ethr',
+	
+	//	Float64, the share of real time the encoder may spend on a packet, 0 (the default) for no limit.
+	//	With a budget the quality setting becomes a ceiling: encoding starts there and drops a level
+	//	whenever the packets took longer than the budget, climbing back once they take well under it.
+	//	Each packet is timed on the thread that encodes it, not counting the MD5. libFLAC only takes its
+	//	settings before it starts, so to change level between packets the encoder (or each of the frame
+	//	encoders described under kFLACEncoderPropertyEncodeThreadCount) is finished and started again,
+	//	and its frames are renumbered to carry on the stream. Until the level first changes the packets
+	//	are the same as they would be without a budget. Only settable while uninitialized.
+	kFLACEncoderPropertyAdaptiveCPUBudget = 'acpu',
+	
+	//	An array of FLACCompressionLevelChange, read only. One entry for the level the stream started
+	//	with and one for every change since, cleared by Reset.
+	kFLACEncoderPropertyCompressionLevelHistory = 'ahst',
+	
+	//	An array of FLAC__StreamMetadata_SeekPoint, read only. The first sample, byte offset and
+	//	number of frames of every packet produced since Initialize or Reset, in order. The offsets
+	//	count from the start of the first packet the way a FLAC SEEKTABLE does, and along with the
+	//	frame counts they make a CAF packet table. kFLACDecoderPropertySeekIndex takes it as is.
+	kFLACEncoderPropertySeekIndex = 'sidx'
+};
+
+//	Where the MD5 signature in STREAMINFO comes from, the "MD5 Signature" setting
+enum
+{
+	kFLACMD5Inline		= 0,	// worked out by the encoder as it goes (the default)
+	kFLACMD5Offloaded	= 1,	// worked out on a thread of its own behind the encoder
+	kFLACMD5Skipped		= 2		// not worked out -- an all zero signature means there isn't one
+};
+
+struct FLACCompressionLevelChange
+{
+	UInt32	mFirstPacket;		// the packet the level took effect at
+	UInt32	mCompressionLevel;
+	Float32	mLoad;				// encoding time over real time for the packets that caused the change, 0 for the first entry
+};
+
 //=============================================================================
 //	ACFLACEncoder
 //
@@ -102,37 +158,154 @@ public:
 	static void stream_encoder_metadata_callback(const FLAC__StreamEncoder *encoder, const FLAC__StreamMetadata *metadata, void *client_data);	
 //	Implementation
 private:
-	virtual	void	SetCompressionLevel(UInt32 theCompressionLevel);
+	virtual	void	SetCompressionLevel(FLAC__StreamEncoder * inEncoder, UInt32 theCompressionLevel);
+	void			SetFramesPerPacket(UInt32 inFramesPerPacket);
 	virtual OSStatus	BuildSettingsDictionary(CFDictionaryRef * theSettings);
 	virtual OSStatus	ParseSettingsDictionary(CFDictionaryRef theSettings);
+	void			ConfigureEncoder(FLAC__StreamEncoder * inEncoder);
+	void			ConvertInputFrames(const Byte * inInputData, UInt32 inNumberFrames, SInt32 * outConvertedData) const;
+	void			DeliverPendingOutput();
+	UInt32			CalculateInputBufferByteSize() const;
+	void			AllocateInputBuffer();
+	virtual UInt32	GetMemoryFootprint() const;
+	void			WritePacket(const Byte * inPacketData, UInt32 inPacketByteSize, UInt32 inNumberFrames);
+	bool			EncodeTimedPacket(const SInt32 * inInputData, UInt32 inNumberFrames);
+	void			FinishStreamInfo();
+	void			AdaptCompressionLevel(UInt32 inNumberFrames, Float64 inEncodeSeconds);
+	void			StartCompressionLevelHistory();
+
+	// Parallel encoding
+	//
+	// FLAC frames don't depend on each other, so packets can be encoded at the same time by separate
+	// libFLAC encoders -- packet n goes to encoder n modulo the number of them. The encoders stay started
+	// for the whole stream, and since libFLAC holds on to the last packet it was given until it sees the
+	// next one, each encoder's next packet is what gets its last one out. They number their frames from
+	// 0, so the frames are renumbered (which means new CRCs) and put back in order as they come out. The
+	// MD5 of the stream is worked out by one more task alongside them, and STREAMINFO is put together
+	// from the pieces at the end.
+	struct ParallelEncodeRange
+	{
+		FLAC__StreamEncoder *	mEncoder;
+		UInt32					mCompressionLevel;	// what mEncoder was started with
+		UInt32					mNextFrameNumber;	// what mEncoder's next frame goes out as
+		UInt32					mFrameNumberStep;	// the number of encoders, the range gets every one of that many packets
+		std::vector<Byte>		mOutput;			// frames that came out but haven't been written yet
+		std::vector<AudioStreamPacketDescription>	mPacketDescriptions;
+		Float64					mEncodeSeconds;		// what the frames that came out this time took to encode
+		UInt32					mFramesTimed;
+		bool					mSucceeded;
+	};
+	
+	struct ParallelEncodeContext
+	{
+		ACFLACEncoder *			mEncoder;
+		const SInt32 *			mInputData;
+		UInt32					mNumberFrames;
+		UInt32					mFirstFrameNumber;	// the frame number of the first packet in mInputData
+		bool					mLastPackets;		// the end of the stream, so the encoders are finished after
+	};
+	
+	bool			EncodeFramesParallel(const SInt32 * inInputData, UInt32 inNumberFrames, bool inLastPackets);
+	bool			StartRangeEncoder(ParallelEncodeRange & ioRange);
+	void			WriteParallelOutput();
+	static void		ParallelEncodeTask(void* inContext, UInt32 inTaskIndex);
+	void			AccumulateMD5(const SInt32 * inInputData, UInt32 inNumberFrames);
+	static void		AppendRenumberedFrame(const Byte * inFrame, UInt32 inFrameByteSize, UInt32 inFrameNumber, std::vector<Byte> & ioOutput);
+	static FLAC__StreamEncoderWriteStatus parallel_encoder_write_callback(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data);
+
+	// Offloaded MD5
+	//
+	// Copies of the samples are handed to a thread that hashes them behind the encoder. The queue
+	// holds a few packets -- if the thread falls that far behind, Append waits for it.
+	class MD5Pipeline
+	{
+	public:
+						MD5Pipeline(UInt32 inNumberChannels, UInt32 inBytesPerSample, UInt32 inFramesPerBlock);
+						~MD5Pipeline();
+		
+		void			Append(const SInt32 * inInputData, UInt32 inNumberFrames);
+		// waits for the queue to drain, the next Append starts a new signature
+		void			Finish(FLAC__byte outDigest[16]);
+		UInt32			GetByteSize() const;
+		
+	private:
+		static void *	ThreadEntry(void * inPipeline);
+		void			ThreadLoop();
+		void			HashBlock(UInt32 inBlock);
+		
+		UInt32			mNumberChannels;
+		UInt32			mBytesPerSample;
+		UInt32			mFramesPerBlock;
+		std::vector< std::vector<FLAC__int32> >	mBlocks;	// deinterleaved, the way FLAC__MD5Accumulate takes them
+		std::vector<UInt32>	mBlockFrames;
+		UInt32			mNextBlockIn;
+		UInt32			mNextBlockOut;
+		UInt32			mNumberBlocksQueued;
+		FLAC__MD5Context	mContext;
+		
+		pthread_t		mThread;
+		pthread_mutex_t	mMutex;
+		pthread_cond_t	mWorkCondition;
+		pthread_cond_t	mSpaceCondition;
+		bool			mThreadRunning;
+		bool			mQuit;
+		
+		//	not copyable
+						MD5Pipeline(const MD5Pipeline&);
+		MD5Pipeline&	operator=(const MD5Pipeline&);
+	};
+
 	UInt32 mSupportedChannelTotals[kFLACNumberSupportedChannelTotals];
 
+	// The input is widened to libFLAC's 32 bit samples as it's appended, so this holds interleaved
+	// SInt32s -- mInputBufferByteSize is the size of that, mInputBufferBytesUsed counts the caller's bytes.
+	// It's sized for the format in Initialize and freed in Uninitialize.
+	SInt32 * mInputBuffer;
+	UInt32 mInputBufferByteSize;
 	UInt32 mInputBufferBytesUsed;
-
-#if TARGET_CPU_PPC || TARGET_CPU_PPC64
-	Byte mInputBuffer[kInputBufferPackets * kFLACNumberSupportedChannelTotals * sizeof(SInt32)] __attribute__ ((aligned (16)));
-	SInt32 mConvertedBuffer[kInputBufferPackets * kFLACNumberSupportedChannelTotals] __attribute__ ((aligned (16)));
-#else
-	Byte mInputBuffer[kInputBufferPackets * kFLACNumberSupportedChannelTotals * sizeof(SInt32)];
-	SInt32 mConvertedBuffer[kInputBufferPackets * kFLACNumberSupportedChannelTotals];
-#endif
+	UInt32 mRequestedInputBufferByteSize; // in the caller's bytes, 0 for mInputBufferPackets per encoder
 
 	// FLAC encoder parameters
 	OSType					mFormat;
 
 	// encoding statistics
 	UInt32					mTotalBytesGenerated;	
-	static UInt32			mOutputBytes;
-	// We need a "global" pointer for the output data callback
-	static Byte * mOutputBuffer;
+	// The output data callback finds these through its client data
+	UInt32					mOutputBytes;
+	Byte *					mOutputBuffer;
+	UInt32					mOutputBufferByteSize;
+	AudioStreamPacketDescription *	mOutputPacketDescriptions;
+	UInt32					mMaxOutputPackets;
+	UInt32					mNumberOutputPackets;
+	// Packets that were encoded but didn't fit in the caller's buffer
+	std::vector<Byte>		mPendingOutput;
+	std::vector<AudioStreamPacketDescription>	mPendingPacketDescriptions;
 	
 	UInt32					mQuality;
+	UInt32					mCompressionLevel;	// what the encoders are set up with, only differs from mQuality in adaptive mode
+	Float64					mAdaptiveCPUBudget;
+	std::vector<FLACCompressionLevelChange>	mCompressionLevelHistory;
+	UInt32					mMD5Mode;
+	MD5Pipeline *			mMD5Pipeline;
+	std::vector<FLAC__StreamMetadata_SeekPoint>	mSeekIndex;
 	UInt32					mTrailingFrames;
-	bool mPacketInInputBuffer;
 	bool mFlushPacket;
 	bool mFinished;
 	FLAC__StreamEncoder * mEncoder;
 	FLAC__StreamEncoderState mEncoderState;
+	std::vector<Byte>		mRenumberedFrame;	// mEncoder's frames once adaptive mode has started it again
+	
+	// parallel encoding state -- the frame number and STREAMINFO that mEncoder would otherwise keep track of
+	UInt32					mEncodeThreadCount;
+	ACWorkerPool *			mWorkerPool;
+	std::vector<ParallelEncodeRange>	mParallelRanges;
+	std::vector<FLAC__int32>	mMD5Signal;
+	FLAC__MD5Context		mMD5Context;
+	UInt32					mNextFrameNumber;	// of the next packet to go to an encoder
+	UInt32					mNextFrameOut;		// of the next frame to be written, the range encoders can be holding on to a few before it
+	FLAC__uint64			mSamplesEncoded;
+	UInt32					mMinFrameBytesEncoded;
+	UInt32					mMaxFrameBytesEncoded;
 };
 
 #endif
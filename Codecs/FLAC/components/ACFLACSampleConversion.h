@@ -0,0 +1,163 @@
+/*	Copyright  2007 Apple Inc. All Rights Reserved.
+	
+	Disclaimer: IMPORTANT:  This Apple software is supplied to you by 
+			Apple Inc. ("Apple") in consideration of your agreement to the
+			following terms, and your use, installation, modification or
+			redistribution of this Apple software constitutes acceptance of these
+			terms.  If you do not agree with these terms, please do not use,
+			install, modify or redistribute this Apple software.
+			
+			In consideration of your agreement to abide by the following terms, and
+			subject to these terms, Apple grants you a personal, non-exclusive
+			license, under Apple's copyrights in this original Apple software (the
+			"Apple Software"), to use, reproduce, modify and redistribute the Apple
+			Software, with or without modifications, in source and/or binary forms;
+			provided that if you redistribute the Apple Software in its entirety and
+			without modifications, you must retain this notice and the following
+			text and disclaimers in all such redistributions of the Apple Software. 
+			Neither the name, trademarks, service marks or logos of Apple Inc. 
+			may be used to endorse or promote products derived from the Apple
+			Software without specific prior written permission from Apple.  Except
+			as expressly stated in this notice, no other rights or licenses, express
+			or implied, are granted by Apple herein, including but not limited to
+			any patent rights that may be infringed by your derivative works or by
+			other works in which the Apple Software may be incorporated.
+			
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+			MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+			THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+			FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+			OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+			
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+			OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+			SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+			INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+			MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+			AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+			STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+			POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACFLACSampleConversion.h
+
+=============================================================================*/
+#if !defined(__ACFLACSampleConversion_h__)
+#define __ACFLACSampleConversion_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACCodec.h"
+
+//=============================================================================
+//	Sample conversion
+//
+//	libFLAC takes its samples as sign extended 32 bit ints. The input is widened
+//	8 (AVX2) or 4 (SSE2/SSSE3, NEON) samples at a time where the compiler is
+//	allowed to use those instructions, and one at a time otherwise. The vector
+//	code only handles little endian input, which is all those targets produce.
+//	The scalar versions convert the samples the vector code leaves over, and are
+//	what ACFLACSampleConversionTest holds the vector code to.
+//=============================================================================
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSSE3__)
+	#include <tmmintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+	#include <arm_neon.h>
+	#define kFLACConvertNEON 1
+#endif
+
+static inline void	ConvertSInt16ToSInt32Scalar(const SInt16 * inInputData, SInt32 * outOutputData, UInt32 inNumberSamples)
+{
+	for (UInt32 i = 0; i < inNumberSamples; ++i)
+	{
+		outOutputData[i] = inInputData[i];
+	}
+}
+
+static inline void	ConvertSInt24ToSInt32Scalar(const Byte * inInputData, SInt32 * outOutputData, UInt32 inNumberSamples)
+{
+	for (UInt32 i = 0; i < inNumberSamples; ++i)
+	{
+		const Byte * theBytes = inInputData + 3 * i;
+	#if TARGET_RT_BIG_ENDIAN
+		outOutputData[i] = (SInt32)(((UInt32)theBytes[0] << 24) | ((UInt32)theBytes[1] << 16) | ((UInt32)theBytes[2] << 8)) >> 8;
+	#else
+		outOutputData[i] = (SInt32)(((UInt32)theBytes[2] << 24) | ((UInt32)theBytes[1] << 16) | ((UInt32)theBytes[0] << 8)) >> 8;
+	#endif
+	}
+}
+
+static inline void	ConvertSInt16ToSInt32(const SInt16 * inInputData, SInt32 * outOutputData, UInt32 inNumberSamples)
+{
+	UInt32 i = 0;
+
+#if defined(__AVX2__)
+	for ( ; i + 8 <= inNumberSamples; i += 8)
+	{
+		__m128i theSamples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inInputData + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(outOutputData + i), _mm256_cvtepi16_epi32(theSamples));
+	}
+#elif defined(__SSE2__)
+	for ( ; i + 8 <= inNumberSamples; i += 8)
+	{
+		// each sample goes in the top half of a lane, and the shift back down sign extends it
+		__m128i theSamples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inInputData + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outOutputData + i), _mm_srai_epi32(_mm_unpacklo_epi16(theSamples, theSamples), 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outOutputData + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(theSamples, theSamples), 16));
+	}
+#elif defined(kFLACConvertNEON)
+	for ( ; i + 8 <= inNumberSamples; i += 8)
+	{
+		int16x8_t theSamples = vld1q_s16(reinterpret_cast<const int16_t*>(inInputData + i));
+		vst1q_s32(reinterpret_cast<int32_t*>(outOutputData + i), vmovl_s16(vget_low_s16(theSamples)));
+		vst1q_s32(reinterpret_cast<int32_t*>(outOutputData + i + 4), vmovl_s16(vget_high_s16(theSamples)));
+	}
+#endif
+	ConvertSInt16ToSInt32Scalar(inInputData + i, outOutputData + i, inNumberSamples - i);
+}
+
+static inline void	ConvertSInt24ToSInt32(const Byte * inInputData, SInt32 * outOutputData, UInt32 inNumberSamples)
+{
+	UInt32 i = 0;
+
+#if defined(__AVX2__)
+	// the shuffle puts each sample's 3 bytes at the top of its lane, and the shift back down sign extends it
+	const __m256i theShuffle = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+												-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	// each 16 byte load only uses 12, so stop while there are still 4 to spare
+	for ( ; i + 10 <= inNumberSamples; i += 8)
+	{
+		const Byte * theBytes = inInputData + 3 * i;
+		__m256i theSamples = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(theBytes))),
+													 _mm_loadu_si128(reinterpret_cast<const __m128i*>(theBytes + 12)), 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(outOutputData + i), _mm256_srai_epi32(_mm256_shuffle_epi8(theSamples, theShuffle), 8));
+	}
+#elif defined(__SSSE3__)
+	const __m128i theShuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	for ( ; i + 6 <= inNumberSamples; i += 4)
+	{
+		__m128i theSamples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inInputData + 3 * i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outOutputData + i), _mm_srai_epi32(_mm_shuffle_epi8(theSamples, theShuffle), 8));
+	}
+#elif defined(kFLACConvertNEON)
+	for ( ; i + 8 <= inNumberSamples; i += 8)
+	{
+		// the load splits the low, middle and high bytes apart, only the high one carries the sign
+		uint8x8x3_t theBytes = vld3_u8(inInputData + 3 * i);
+		uint16x8_t theLow = vorrq_u16(vmovl_u8(theBytes.val[0]), vshlq_n_u16(vmovl_u8(theBytes.val[1]), 8));
+		int16x8_t theHigh = vmovl_s8(vreinterpret_s8_u8(theBytes.val[2]));
+		vst1q_s32(reinterpret_cast<int32_t*>(outOutputData + i), vorrq_s32(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(theLow))), vshlq_n_s32(vmovl_s16(vget_low_s16(theHigh)), 16)));
+		vst1q_s32(reinterpret_cast<int32_t*>(outOutputData + i + 4), vorrq_s32(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(theLow))), vshlq_n_s32(vmovl_s16(vget_high_s16(theHigh)), 16)));
+	}
+#endif
+	ConvertSInt24ToSInt32Scalar(inInputData + 3 * i, outOutputData + i, inNumberSamples - i);
+}
+
+#endif
@@ -0,0 +1,398 @@
+/*	Copyright  2007 Apple Inc. All Rights Reserved.
+	
+	Disclaimer: IMPORTANT:  This Apple software is supplied to you by 
+			Apple Inc. ("Apple") in consideration of your agreement to the
+			following terms, and your use, installation, modification or
+			redistribution of this Apple software constitutes acceptance of these
+			terms.  If you do not agree with these terms, please do not use,
+			install, modify or redistribute this Apple software.
+			
+			In consideration of your agreement to abide by the following terms, and
+			subject to these terms, Apple grants you a personal, non-exclusive
+			license, under Apple's copyrights in this original Apple software (the
+			"Apple Software"), to use, reproduce, modify and redistribute the Apple
+			Software, with or without modifications, in source and/or binary forms;
+			provided that if you redistribute the Apple Software in its entirety and
+			without modifications, you must retain this notice and the following
+			text and disclaimers in all such redistributions of the Apple Software. 
+			Neither the name, trademarks, service marks or logos of Apple Inc. 
+			may be used to endorse or promote products derived from the Apple
+			Software without specific prior written permission from Apple.  Except
+			as expressly stated in this notice, no other rights or licenses, express
+			or implied, are granted by Apple herein, including but not limited to
+			any patent rights that may be infringed by your derivative works or by
+			other works in which the Apple Software may be incorporated.
+			
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+			MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+			THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+			FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+			OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+			
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+			OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+			SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+			INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+			MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+			AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+			STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+			POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACFLACSampleInterleaving.h
+
+=============================================================================*/
+#if !defined(__ACFLACSampleInterleaving_h__)
+#define __ACFLACSampleInterleaving_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACCodec.h"
+#include "ordinals.h"
+#include <cstring>
+
+//=============================================================================
+//	Sample interleaving
+//
+//	libFLAC hands back each channel as its own array of 32 bit ints. They are
+//	interleaved and narrowed to the output bit depth (or converted to floats)
+//	by kernels specialized on the channel count. With SSE2 (SSSE3 for the 3
+//	byte formats) every channel count from 1 to 8 goes 4 frames at a time: a
+//	row of 4 samples is loaded from every channel and the rows are transposed
+//	into frame order, 4 channels at a time with the ones left over shifted in
+//	between. The frames left at the end are done one sample at a time, which
+//	the compiler unrolls across the channels. ACFLACSampleInterleavingTest holds
+//	all of it to a plain scalar interleave.
+//=============================================================================
+
+#if defined(__SSSE3__)
+	#include <tmmintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#if defined(__SSE2__)
+
+	//	Rows() leaves the samples of frames inFrame to inFrame + 3 in outRows[0..kChannels-1], in output order
+	template <UInt32 kChannels>
+	struct FLACInterleaver
+	{
+		enum { kVector = 0 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)	{ (void)inBuffer, (void)inFrame, (void)outRows; }
+	};
+
+	static inline __m128i	FLACLoadRow(const FLAC__int32 * inChannel, UInt32 inFrame)	{ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(inChannel + inFrame)); }
+
+	static inline void		FLACTranspose4(__m128i inA, __m128i inB, __m128i inC, __m128i inD, __m128i * outRows, UInt32 inStride)
+	{
+		__m128i theAB0 = _mm_unpacklo_epi32(inA, inB);
+		__m128i theCD0 = _mm_unpacklo_epi32(inC, inD);
+		__m128i theAB1 = _mm_unpackhi_epi32(inA, inB);
+		__m128i theCD1 = _mm_unpackhi_epi32(inC, inD);
+		outRows[0] = _mm_unpacklo_epi64(theAB0, theCD0);
+		outRows[inStride] = _mm_unpackhi_epi64(theAB0, theCD0);
+		outRows[2 * inStride] = _mm_unpacklo_epi64(theAB1, theCD1);
+		outRows[3 * inStride] = _mm_unpackhi_epi64(theAB1, theCD1);
+	}
+
+	template <>
+	struct FLACInterleaver<1>
+	{
+		enum { kVector = 1 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)
+		{
+			outRows[0] = FLACLoadRow(inBuffer[0], inFrame);
+		}
+	};
+
+	template <>
+	struct FLACInterleaver<2>
+	{
+		enum { kVector = 1 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)
+		{
+			__m128i theLeft = FLACLoadRow(inBuffer[0], inFrame);
+			__m128i theRight = FLACLoadRow(inBuffer[1], inFrame);
+			outRows[0] = _mm_unpacklo_epi32(theLeft, theRight);
+			outRows[1] = _mm_unpackhi_epi32(theLeft, theRight);
+		}
+	};
+
+	//	the 4 frames each take 3 samples, so each one's empty fourth lane is where the next one starts
+	template <>
+	struct FLACInterleaver<3>
+	{
+		enum { kVector = 1 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)
+		{
+			__m128i theFrames[4];
+			FLACTranspose4(FLACLoadRow(inBuffer[0], inFrame), FLACLoadRow(inBuffer[1], inFrame), FLACLoadRow(inBuffer[2], inFrame), _mm_setzero_si128(), theFrames, 1);
+			outRows[0] = _mm_or_si128(theFrames[0], _mm_slli_si128(theFrames[1], 12));
+			outRows[1] = _mm_or_si128(_mm_srli_si128(theFrames[1], 4), _mm_slli_si128(theFrames[2], 8));
+			outRows[2] = _mm_or_si128(_mm_srli_si128(theFrames[2], 8), _mm_slli_si128(theFrames[3], 4));
+		}
+	};
+	
+	template <>
+	struct FLACInterleaver<4>
+	{
+		enum { kVector = 1 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)
+		{
+			FLACTranspose4(FLACLoadRow(inBuffer[0], inFrame), FLACLoadRow(inBuffer[1], inFrame), FLACLoadRow(inBuffer[2], inFrame), FLACLoadRow(inBuffer[3], inFrame), outRows, 1);
+		}
+	};
+
+	//	For 5 to 7 channels each frame is the first 4 channels' row followed by what's left of the
+	//	frame, and the rows of frame order are shifted together out of those two pieces.
+	template <>
+	struct FLACInterleaver<5>
+	{
+		enum { kVector = 1 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)
+		{
+			__m128i theFrames[4];
+			__m128i theLastSamples[4];
+			const __m128i theZero = _mm_setzero_si128();
+			FLACTranspose4(FLACLoadRow(inBuffer[0], inFrame), FLACLoadRow(inBuffer[1], inFrame), FLACLoadRow(inBuffer[2], inFrame), FLACLoadRow(inBuffer[3], inFrame), theFrames, 1);
+			FLACTranspose4(FLACLoadRow(inBuffer[4], inFrame), theZero, theZero, theZero, theLastSamples, 1);
+			outRows[0] = theFrames[0];
+			outRows[1] = _mm_or_si128(theLastSamples[0], _mm_slli_si128(theFrames[1], 4));
+			outRows[2] = _mm_or_si128(_mm_or_si128(_mm_srli_si128(theFrames[1], 12), _mm_slli_si128(theLastSamples[1], 4)), _mm_slli_si128(theFrames[2], 8));
+			outRows[3] = _mm_or_si128(_mm_or_si128(_mm_srli_si128(theFrames[2], 8), _mm_slli_si128(theLastSamples[2], 8)), _mm_slli_si128(theFrames[3], 12));
+			outRows[4] = _mm_or_si128(_mm_srli_si128(theFrames[3], 4), _mm_slli_si128(theLastSamples[3], 12));
+		}
+	};
+	
+	template <>
+	struct FLACInterleaver<6>
+	{
+		enum { kVector = 1 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)
+		{
+			__m128i theFrames[4];
+			FLACTranspose4(FLACLoadRow(inBuffer[0], inFrame), FLACLoadRow(inBuffer[1], inFrame), FLACLoadRow(inBuffer[2], inFrame), FLACLoadRow(inBuffer[3], inFrame), theFrames, 1);
+			
+			// the last 2 channels of frames 0 and 1, and of frames 2 and 3
+			__m128i theFifth = FLACLoadRow(inBuffer[4], inFrame);
+			__m128i theSixth = FLACLoadRow(inBuffer[5], inFrame);
+			__m128i theFirstPairs = _mm_unpacklo_epi32(theFifth, theSixth);
+			__m128i theLastPairs = _mm_unpackhi_epi32(theFifth, theSixth);
+			outRows[0] = theFrames[0];
+			outRows[1] = _mm_unpacklo_epi64(theFirstPairs, theFrames[1]);
+			outRows[2] = _mm_unpackhi_epi64(theFrames[1], theFirstPairs);
+			outRows[3] = theFrames[2];
+			outRows[4] = _mm_unpacklo_epi64(theLastPairs, theFrames[3]);
+			outRows[5] = _mm_unpackhi_epi64(theFrames[3], theLastPairs);
+		}
+	};
+	
+	template <>
+	struct FLACInterleaver<7>
+	{
+		enum { kVector = 1 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)
+		{
+			__m128i theFrames[4];
+			__m128i theLastSamples[4];
+			FLACTranspose4(FLACLoadRow(inBuffer[0], inFrame), FLACLoadRow(inBuffer[1], inFrame), FLACLoadRow(inBuffer[2], inFrame), FLACLoadRow(inBuffer[3], inFrame), theFrames, 1);
+			FLACTranspose4(FLACLoadRow(inBuffer[4], inFrame), FLACLoadRow(inBuffer[5], inFrame), FLACLoadRow(inBuffer[6], inFrame), _mm_setzero_si128(), theLastSamples, 1);
+			outRows[0] = theFrames[0];
+			outRows[1] = _mm_or_si128(theLastSamples[0], _mm_slli_si128(theFrames[1], 12));
+			outRows[2] = _mm_or_si128(_mm_srli_si128(theFrames[1], 4), _mm_slli_si128(theLastSamples[1], 12));
+			outRows[3] = _mm_or_si128(_mm_srli_si128(theLastSamples[1], 4), _mm_slli_si128(theFrames[2], 8));
+			outRows[4] = _mm_or_si128(_mm_srli_si128(theFrames[2], 8), _mm_slli_si128(theLastSamples[2], 8));
+			outRows[5] = _mm_or_si128(_mm_srli_si128(theLastSamples[2], 8), _mm_slli_si128(theFrames[3], 4));
+			outRows[6] = _mm_or_si128(_mm_srli_si128(theFrames[3], 12), _mm_slli_si128(theLastSamples[3], 4));
+		}
+	};
+	
+	template <>
+	struct FLACInterleaver<8>
+	{
+		enum { kVector = 1 };
+		static inline void	Rows(const FLAC__int32 * const inBuffer[], UInt32 inFrame, __m128i * outRows)
+		{
+			// each frame is the first 4 channels' row followed by the last 4's
+			FLACTranspose4(FLACLoadRow(inBuffer[0], inFrame), FLACLoadRow(inBuffer[1], inFrame), FLACLoadRow(inBuffer[2], inFrame), FLACLoadRow(inBuffer[3], inFrame), outRows, 2);
+			FLACTranspose4(FLACLoadRow(inBuffer[4], inFrame), FLACLoadRow(inBuffer[5], inFrame), FLACLoadRow(inBuffer[6], inFrame), FLACLoadRow(inBuffer[7], inFrame), outRows + 1, 2);
+		}
+	};
+
+#endif
+
+template <UInt32 kChannels>
+static void	InterleaveSInt16(const FLAC__int32 * const inBuffer[], UInt32 inNumberFrames, SInt16 * outOutputData)
+{
+	UInt32 i = 0;
+
+#if defined(__SSE2__)
+	if (FLACInterleaver<kChannels>::kVector)
+	{
+		for ( ; i + 4 <= inNumberFrames; i += 4)
+		{
+			__m128i theRows[8];
+			SInt16 * theOutputData = outOutputData + i * kChannels;
+			
+			FLACInterleaver<kChannels>::Rows(inBuffer, i, theRows);
+			for (UInt32 j = 0; j + 2 <= kChannels; j += 2)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(theOutputData + 4 * j), _mm_packs_epi32(theRows[j], theRows[j + 1]));
+			}
+			// with an odd number of channels the last row only fills half a vector
+			if (kChannels % 2 == 1)
+			{
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(theOutputData + 4 * (kChannels - 1)), _mm_packs_epi32(theRows[kChannels - 1], theRows[kChannels - 1]));
+			}
+		}
+	}
+#endif
+	for ( ; i < inNumberFrames; ++i)
+	{
+		for (UInt32 j = 0; j < kChannels; ++j)
+		{
+			outOutputData[i * kChannels + j] = (SInt16)inBuffer[j][i];
+		}
+	}
+}
+
+//	3 byte samples -- 24 bit, or 20 bit aligned high with a kShift of 4
+template <UInt32 kChannels, UInt32 kShift>
+static void	InterleaveSInt24(const FLAC__int32 * const inBuffer[], UInt32 inNumberFrames, Byte * outOutputData)
+{
+	UInt32 i = 0;
+
+#if defined(__SSSE3__)
+	if (FLACInterleaver<kChannels>::kVector)
+	{
+		// drops the top byte of each lane
+		const __m128i theShuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+		
+		for ( ; i + 4 <= inNumberFrames; i += 4)
+		{
+			__m128i theRows[8];
+			Byte * theOutputData = outOutputData + 3 * i * kChannels;
+			
+			FLACInterleaver<kChannels>::Rows(inBuffer, i, theRows);
+			for (UInt32 j = 0; j < kChannels; ++j)
+			{
+				__m128i theBytes = _mm_shuffle_epi8(_mm_slli_epi32(theRows[j], kShift), theShuffle);
+				int theLastBytes = _mm_cvtsi128_si32(_mm_srli_si128(theBytes, 8));
+				
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(theOutputData + 12 * j), theBytes);
+				memcpy(theOutputData + 12 * j + 8, &theLastBytes, 4);
+			}
+		}
+	}
+#endif
+	for ( ; i < inNumberFrames; ++i)
+	{
+		for (UInt32 j = 0; j < kChannels; ++j)
+		{
+			UInt32 theSample = (UInt32)inBuffer[j][i] << kShift;
+			Byte * theOutputData = outOutputData + 3 * (i * kChannels + j);
+		#if TARGET_RT_BIG_ENDIAN
+			theOutputData[0] = (theSample >> 16) & 0xff;
+			theOutputData[1] = (theSample >> 8) & 0xff;
+			theOutputData[2] = theSample & 0xff;
+		#else
+			theOutputData[0] = theSample & 0xff;
+			theOutputData[1] = (theSample >> 8) & 0xff;
+			theOutputData[2] = (theSample >> 16) & 0xff;
+		#endif
+		}
+	}
+}
+
+template <UInt32 kChannels>
+static void	InterleaveSInt32(const FLAC__int32 * const inBuffer[], UInt32 inNumberFrames, SInt32 * outOutputData)
+{
+	UInt32 i = 0;
+
+#if defined(__SSE2__)
+	if (FLACInterleaver<kChannels>::kVector)
+	{
+		for ( ; i + 4 <= inNumberFrames; i += 4)
+		{
+			__m128i theRows[8];
+			SInt32 * theOutputData = outOutputData + i * kChannels;
+			
+			FLACInterleaver<kChannels>::Rows(inBuffer, i, theRows);
+			for (UInt32 j = 0; j < kChannels; ++j)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(theOutputData + 4 * j), theRows[j]);
+			}
+		}
+	}
+#endif
+	for ( ; i < inNumberFrames; ++i)
+	{
+		for (UInt32 j = 0; j < kChannels; ++j)
+		{
+			outOutputData[i * kChannels + j] = inBuffer[j][i];
+		}
+	}
+}
+
+//	Core Audio floats -- the conversion and the scaling to [-1, 1) are done on the way through
+template <UInt32 kChannels>
+static void	InterleaveFloat32(const FLAC__int32 * const inBuffer[], UInt32 inNumberFrames, Float32 inScale, Float32 * outOutputData)
+{
+	UInt32 i = 0;
+
+#if defined(__SSE2__)
+	if (FLACInterleaver<kChannels>::kVector)
+	{
+		const __m128 theScale = _mm_set1_ps(inScale);
+		
+		for ( ; i + 4 <= inNumberFrames; i += 4)
+		{
+			__m128i theRows[8];
+			Float32 * theOutputData = outOutputData + i * kChannels;
+			
+			FLACInterleaver<kChannels>::Rows(inBuffer, i, theRows);
+			for (UInt32 j = 0; j < kChannels; ++j)
+			{
+				_mm_storeu_ps(theOutputData + 4 * j, _mm_mul_ps(_mm_cvtepi32_ps(theRows[j]), theScale));
+			}
+		}
+	}
+#endif
+	for ( ; i < inNumberFrames; ++i)
+	{
+		for (UInt32 j = 0; j < kChannels; ++j)
+		{
+			outOutputData[i * kChannels + j] = (Float32)inBuffer[j][i] * inScale;
+		}
+	}
+}
+
+template <UInt32 kChannels>
+static void	InterleaveFrame(const FLAC__int32 * const inBuffer[], UInt32 inNumberFrames, UInt32 inBitsPerSample, bool inFloat, Byte * outOutputData)
+{
+	if (inFloat)
+	{
+		// full scale for the source's bit depth
+		InterleaveFloat32<kChannels>(inBuffer, inNumberFrames, 1.0f / (Float32)(1UL << (inBitsPerSample - 1)), reinterpret_cast<Float32*>(outOutputData));
+		return;
+	}
+	switch (inBitsPerSample)
+	{
+		case 16:
+			InterleaveSInt16<kChannels>(inBuffer, inNumberFrames, reinterpret_cast<SInt16*>(outOutputData));
+			break;
+		case 20:
+			InterleaveSInt24<kChannels, 4>(inBuffer, inNumberFrames, outOutputData);
+			break;
+		case 32:
+			InterleaveSInt32<kChannels>(inBuffer, inNumberFrames, reinterpret_cast<SInt32*>(outOutputData));
+			break;
+		default: // 24
+			InterleaveSInt24<kChannels, 0>(inBuffer, inNumberFrames, outOutputData);
+			break;
+	}
+}
+
+#endif
@@ -0,0 +1,227 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACAppleIMA4BatchDecoder.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACAppleIMA4BatchDecoder.h"
+#include "ACAppleIMA4Vector.h"
+
+#if defined(kIMA4VectorLanes)
+	#define	kBatchDecoderLanes	kIMA4VectorLanes
+#else
+	#define	kBatchDecoderLanes	1
+#endif
+
+//=============================================================================
+//	ACAppleIMA4BatchDecoder
+//=============================================================================
+
+ACAppleIMA4BatchDecoder::ACAppleIMA4BatchDecoder(UInt32 inNumberStreams, UInt32 inNumberChannels)
+:
+	mNumberStreams(0),
+	mNumberChannels(inNumberChannels)
+{
+	SetNumberStreams(inNumberStreams);
+}
+
+ACAppleIMA4BatchDecoder::~ACAppleIMA4BatchDecoder()
+{
+}
+
+void	ACAppleIMA4BatchDecoder::SetNumberStreams(UInt32 inNumberStreams)
+{
+	//	new streams start out reset, existing ones keep their state
+	UInt32 theNumberUsedLanes = inNumberStreams * mNumberChannels;
+	UInt32 theNumberLanes = ((theNumberUsedLanes + kBatchDecoderLanes - 1) / kBatchDecoderLanes) * kBatchDecoderLanes;
+	mPredictedSamples.resize(theNumberLanes, 0);
+	mTableRows.resize(theNumberLanes, 0);
+	mCodes.resize(theNumberLanes * kFramesPerPacket, 0);
+	mSamples.resize(theNumberLanes * kFramesPerPacket, 0);
+	for(UInt32 theLane = ((mNumberStreams < inNumberStreams) ? mNumberStreams : inNumberStreams) * mNumberChannels; theLane < theNumberLanes; ++theLane)
+	{
+		mPredictedSamples[theLane] = 0;
+		mTableRows[theLane] = 0;
+	}
+	mNumberStreams = inNumberStreams;
+}
+
+void	ACAppleIMA4BatchDecoder::ResetStream(UInt32 inStream)
+{
+	for(UInt32 theLane = inStream * mNumberChannels; theLane < (inStream + 1) * mNumberChannels; ++theLane)
+	{
+		mPredictedSamples[theLane] = 0;
+		mTableRows[theLane] = 0;
+	}
+}
+
+void	ACAppleIMA4BatchDecoder::Reset()
+{
+	for(UInt32 theLane = 0; theLane < mPredictedSamples.size(); ++theLane)
+	{
+		mPredictedSamples[theLane] = 0;
+		mTableRows[theLane] = 0;
+	}
+}
+
+void	ACAppleIMA4BatchDecoder::DecodePackets(const Byte* const* inInputData, SInt16* const* outOutputData)
+{
+	const SInt32* theDecodeTable = ACAppleIMA4Decoder::GetDecodeTable();
+	UInt32 theNumberUsedLanes = mNumberStreams * mNumberChannels;
+	
+	for(UInt32 theFirstLane = 0; theFirstLane < theNumberUsedLanes; theFirstLane += kBatchDecoderLanes)
+	{
+		UInt32 theNumberLanes = theNumberUsedLanes - theFirstLane;
+		if(theNumberLanes > kBatchDecoderLanes)
+		{
+			theNumberLanes = kBatchDecoderLanes;
+		}
+		
+		SInt32* thePredictedSamples = &mPredictedSamples[theFirstLane];
+		SInt32* theTableRows = &mTableRows[theFirstLane];
+		SInt32* theCodes = &mCodes[theFirstLane * kFramesPerPacket];
+		SInt32* theSamples = &mSamples[theFirstLane * kFramesPerPacket];
+		
+		//	resync each channel with its packet header and spread its codes across the lanes
+		bool theGroupHasData = false;
+		for(UInt32 theLane = 0; theLane < theNumberLanes; ++theLane)
+		{
+			UInt32 theStream = (theFirstLane + theLane) / mNumberChannels;
+			UInt32 theChannel = (theFirstLane + theLane) % mNumberChannels;
+			const Byte* theInputData = inInputData[theStream];
+			if(theInputData == NULL)
+			{
+				//	decode a silent packet in this lane, the results are thrown away
+				for(UInt32 theFrame = 0; theFrame < kFramesPerPacket; ++theFrame)
+				{
+					theCodes[(theFrame * kBatchDecoderLanes) + theLane] = 0;
+				}
+				continue;
+			}
+			theGroupHasData = true;
+			theInputData += theChannel * ACAppleIMA4Decoder::kIMA4PacketBytes;
+			
+			SInt32 theStepTableIndex = theTableRows[theLane] >> 4;
+			ACAppleIMA4Decoder::ResyncChannel(theInputData, thePredictedSamples[theLane], theStepTableIndex);
+			theTableRows[theLane] = theStepTableIndex << 4;
+			
+			theInputData += ACAppleIMA4Decoder::kHeaderBytes;
+			for(UInt32 theByte = 0; theByte < ACAppleIMA4Decoder::kBytesPerChannelPerPacket; ++theByte)
+			{
+				theCodes[((2 * theByte) * kBatchDecoderLanes) + theLane] = theInputData[theByte] & 0x0F;
+				theCodes[((2 * theByte + 1) * kBatchDecoderLanes) + theLane] = theInputData[theByte] >> 4;
+			}
+		}
+		if(!theGroupHasData)
+		{
+			continue;
+		}
+		
+		//	keep the state of skipped streams
+		SInt32 theSavedPredictedSamples[kBatchDecoderLanes];
+		SInt32 theSavedTableRows[kBatchDecoderLanes];
+		for(UInt32 theLane = 0; theLane < theNumberLanes; ++theLane)
+		{
+			theSavedPredictedSamples[theLane] = thePredictedSamples[theLane];
+			theSavedTableRows[theLane] = theTableRows[theLane];
+		}
+		
+#if defined(kIMA4VectorLanes)
+		const IMA4Vector theRowMask = IMA4VectorSet(ACAppleIMA4Decoder::kDecodeTableRowMask);
+		const IMA4Vector theMinimumSample = IMA4VectorSet(-32768);
+		const IMA4Vector theMaximumSample = IMA4VectorSet(32767);
+		
+		IMA4Vector thePredictedSample = IMA4VectorLoad(thePredictedSamples);
+		IMA4Vector theTableRow = IMA4VectorLoad(theTableRows);
+		for(UInt32 theFrame = 0; theFrame < kFramesPerPacket; ++theFrame)
+		{
+			IMA4Vector theEntry = IMA4VectorLookUp(theDecodeTable, IMA4VectorOr(theTableRow, IMA4VectorLoad(theCodes + (theFrame * kBatchDecoderLanes))));
+			thePredictedSample = IMA4VectorAdd(thePredictedSample, IMA4VectorShiftRight(theEntry, ACAppleIMA4Decoder::kDecodeTableShift));
+			thePredictedSample = IMA4VectorMin(IMA4VectorMax(thePredictedSample, theMinimumSample), theMaximumSample);
+			IMA4VectorStore(theSamples + (theFrame * kBatchDecoderLanes), thePredictedSample);
+			theTableRow = IMA4VectorAnd(theEntry, theRowMask);
+		}
+		IMA4VectorStore(thePredictedSamples, thePredictedSample);
+		IMA4VectorStore(theTableRows, theTableRow);
+#else
+		SInt32 thePredictedSample = thePredictedSamples[0];
+		SInt32 theTableRow = theTableRows[0];
+		for(UInt32 theFrame = 0; theFrame < kFramesPerPacket; ++theFrame)
+		{
+			SInt32 theEntry = theDecodeTable[theTableRow | theCodes[theFrame]];
+			thePredictedSample += theEntry >> ACAppleIMA4Decoder::kDecodeTableShift;
+			if(thePredictedSample > 32767)
+			{
+				thePredictedSample = 32767;
+			}
+			else if(thePredictedSample < -32768)
+			{
+				thePredictedSample = -32768;
+			}
+			theSamples[theFrame] = thePredictedSample;
+			theTableRow = theEntry & ACAppleIMA4Decoder::kDecodeTableRowMask;
+		}
+		thePredictedSamples[0] = thePredictedSample;
+		theTableRows[0] = theTableRow;
+#endif
+		
+		//	hand each channel its samples
+		for(UInt32 theLane = 0; theLane < theNumberLanes; ++theLane)
+		{
+			UInt32 theStream = (theFirstLane + theLane) / mNumberChannels;
+			UInt32 theChannel = (theFirstLane + theLane) % mNumberChannels;
+			if(inInputData[theStream] == NULL)
+			{
+				thePredictedSamples[theLane] = theSavedPredictedSamples[theLane];
+				theTableRows[theLane] = theSavedTableRows[theLane];
+				continue;
+			}
+			
+			SInt16* theOutputData = outOutputData[theStream] + theChannel;
+			for(UInt32 theFrame = 0; theFrame < kFramesPerPacket; ++theFrame)
+			{
+				theOutputData[theFrame * mNumberChannels] = theSamples[(theFrame * kBatchDecoderLanes) + theLane];
+			}
+		}
+	}
+}
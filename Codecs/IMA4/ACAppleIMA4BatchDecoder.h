@@ -0,0 +1,111 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACAppleIMA4BatchDecoder.h
+
+=============================================================================*/
+#if !defined(__ACAppleIMA4BatchDecoder_h__)
+#define __ACAppleIMA4BatchDecoder_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACAppleIMA4Decoder.h"
+
+//=============================================================================
+//	ACAppleIMA4BatchDecoder
+//
+//	This class decodes many independent Apple IMA4 streams side by side, one
+//	packet from each stream per call, into interleaved 16 bit signed integer.
+//	Every stream has the same number of channels. It isn't a codec component,
+//	it's meant for servers that would otherwise need one ACAppleIMA4Decoder (and
+//	its input buffer) per stream. The state of every channel of every stream is
+//	kept as arrays so that each one maps to a vector lane, and the decoding uses
+//	the same tables as ACAppleIMA4Decoder, so the output is identical to decoding
+//	each stream with its own decoder.
+//=============================================================================
+
+class ACAppleIMA4BatchDecoder
+{
+
+//	Construction/Destruction
+public:
+						ACAppleIMA4BatchDecoder(UInt32 inNumberStreams, UInt32 inNumberChannels = 1);
+						~ACAppleIMA4BatchDecoder();
+
+//	Stream Handling
+public:
+	UInt32				GetNumberStreams() const { return mNumberStreams; }
+	void				SetNumberStreams(UInt32 inNumberStreams);
+	UInt32				GetNumberChannels() const { return mNumberChannels; }
+	
+	//	puts a stream back in its initial state, ie for reuse by a new call
+	void				ResetStream(UInt32 inStream);
+	void				Reset();
+
+//	Data Handling
+public:
+	enum
+	{
+		kFramesPerPacket = ACAppleIMA4Decoder::kFramesPerPacket
+	};
+	
+	//	the size of one packet of a stream, ie one IMA4 packet per channel
+	UInt32				GetPacketByteSize() const { return mNumberChannels * ACAppleIMA4Decoder::kIMA4PacketBytes; }
+	
+	//	Decodes one packet, GetPacketByteSize() long, from each stream. inInputData
+	//	and outOutputData have GetNumberStreams() entries, each output takes
+	//	kFramesPerPacket interleaved frames. A NULL input skips the stream, its
+	//	state and output are left alone.
+	void				DecodePackets(const Byte* const* inInputData, SInt16* const* outOutputData);
+
+//	Implementation
+private:
+	UInt32				mNumberStreams;
+	UInt32				mNumberChannels;
+	
+	//	one lane per channel of each stream, stream major, sized to a whole number of vector lanes
+	std::vector<SInt32>	mPredictedSamples;
+	std::vector<SInt32>	mTableRows;		//	step table index << 4, a row of ACAppleIMA4Decoder::GetDecodeTable()
+	std::vector<SInt32>	mCodes;			//	kFramesPerPacket codes for each lane, lane minor
+	std::vector<SInt32>	mSamples;		//	kFramesPerPacket samples for each lane, lane minor
+
+};
+
+#endif
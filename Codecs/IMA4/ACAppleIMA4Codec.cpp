@@ -50,9 +50,9 @@
 //	ACAppleIMA4Codec
 //=============================================================================
 
-ACAppleIMA4Codec::ACAppleIMA4Codec(UInt32 inInputBufferByteSize)
+ACAppleIMA4Codec::ACAppleIMA4Codec(UInt32 inInputBufferByteSize, bool inUseMirroredInputBuffer)
 :
-	ACSimpleCodec(inInputBufferByteSize),
+	ACSimpleCodec(inInputBufferByteSize, inUseMirroredInputBuffer),
 	mChannelStateList()
 {
 }
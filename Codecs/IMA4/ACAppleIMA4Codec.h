@@ -62,7 +62,7 @@ class ACAppleIMA4Codec
 
 //	Construction/Destruction
 public:
-						ACAppleIMA4Codec(UInt32 inInputBufferByteSize);
+						ACAppleIMA4Codec(UInt32 inInputBufferByteSize, bool inUseMirroredInputBuffer = false);
 	virtual				~ACAppleIMA4Codec();
 
 //	Data Handling
@@ -92,8 +92,8 @@ protected:
 	typedef std::vector<ChannelState>	ChannelStateList;
 	ChannelStateList	mChannelStateList;
 
-//	Implementation Constants
-protected:
+//	Format Constants
+public:
 	enum
 	{
 		kFramesPerPacket = 64,
@@ -102,6 +102,9 @@ protected:
 		kInputBufferPackets = 32,
 		kIMA4PacketBytes = kHeaderBytes + kBytesPerChannelPerPacket
 	};
+
+//	Implementation Constants
+protected:
 	static const UInt16	kPredictorMask;
 	static const UInt16	kStepTableIndexMask;
 	static const SInt32	kPredictorTolerance;
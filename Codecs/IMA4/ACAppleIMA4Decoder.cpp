@@ -45,6 +45,7 @@
 //=============================================================================
 
 #include "ACAppleIMA4Decoder.h"
+#include "ACWorkerPool.h"
 #include "ACCodecDispatch.h"
 #include "CAStreamBasicDescription.h"
 #include "CASampleTools.h"
@@ -54,9 +55,47 @@
 //	ACAppleIMA4Decoder
 //=============================================================================
 
+SInt32			ACAppleIMA4Decoder::sDecodeTable[89 * 16];
+const bool		ACAppleIMA4Decoder::sDecodeTableIsInitialized = ACAppleIMA4Decoder::InitializeDecodeTable();
+
+bool	ACAppleIMA4Decoder::InitializeDecodeTable()
+{
+	//	fold the difference calculation and the step table index update for
+	//	every combination of step table index and code into a single entry
+	for(SInt32 theStepTableIndex = 0; theStepTableIndex < 89; ++theStepTableIndex)
+	{
+		SInt32 theStep = sStepTable[theStepTableIndex];
+		for(SInt32 theCode = 0; theCode < 16; ++theCode)
+		{
+			SInt32 theDifference = theStep >> 3;
+			if (theCode & 4)
+				theDifference += theStep;
+			if (theCode & 2)
+				theDifference += theStep >> 1;
+			if (theCode & 1)
+				theDifference += theStep >> 2;
+			if (theCode & 8)
+				theDifference = -theDifference;
+			
+			SInt32 theNextStepTableIndex = theStepTableIndex + sIndexTable[theCode];
+			if (theNextStepTableIndex < 0)
+				theNextStepTableIndex = 0;
+			else if (theNextStepTableIndex > 88)
+				theNextStepTableIndex = 88;
+			
+			sDecodeTable[(theStepTableIndex << 4) | theCode] = (theDifference * (1 << kDecodeTableShift)) | (theNextStepTableIndex << 4);
+		}
+	}
+	return true;
+}
+
 ACAppleIMA4Decoder::ACAppleIMA4Decoder()
 :
-	ACAppleIMA4Codec(kInputBufferPackets * kIMA4PacketBytes)
+	//	a mirrored input buffer saves GetBytes copying the wrapped part of every
+	//	request, which matters once the buffer is sized for the decode threads
+	ACAppleIMA4Codec(kInputBufferPackets * kIMA4PacketBytes, true),
+	mDecodeThreadCount(1),
+	mWorkerPool(NULL)
 {
 	//	One issue to talk about here is how do we represent the fact that this
 	//	decoder doesn't care about the number of channels or the sample rate?
@@ -113,12 +152,38 @@ ACAppleIMA4Decoder::ACAppleIMA4Decoder()
 
 ACAppleIMA4Decoder::~ACAppleIMA4Decoder()
 {
+	delete mWorkerPool;
+}
+
+void	ACAppleIMA4Decoder::GetPropertyInfo(AudioCodecPropertyID inPropertyID, UInt32& outPropertyDataSize, bool& outWritable)
+{
+	switch(inPropertyID)
+	{
+		case kAppleIMA4DecoderPropertyDecodeThreadCount:
+			outPropertyDataSize = sizeof(UInt32);
+			outWritable = true;
+			break;
+			
+		default:
+			ACAppleIMA4Codec::GetPropertyInfo(inPropertyID, outPropertyDataSize, outWritable);
+			break;
+	};
 }
 
 void	ACAppleIMA4Decoder::GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPropertyDataSize, void* outPropertyData)
 {	
 	switch(inPropertyID)
 	{
+		case kAppleIMA4DecoderPropertyDecodeThreadCount:
+			if(ioPropertyDataSize == sizeof(UInt32))
+			{
+				*reinterpret_cast<UInt32*>(outPropertyData) = mDecodeThreadCount;
+			}
+			else
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			break;
 #if TARGET_OS_MAC
 		case kAudioCodecPropertyNameCFString:
 		{
@@ -134,6 +199,69 @@ void	ACAppleIMA4Decoder::GetProperty(AudioCodecPropertyID inPropertyID, UInt32&
 	}
 }
 
+void	ACAppleIMA4Decoder::SetProperty(AudioCodecPropertyID inPropertyID, UInt32 inPropertyDataSize, const void* inPropertyData)
+{
+	switch(inPropertyID)
+	{
+		case kAppleIMA4DecoderPropertyDecodeThreadCount:
+			if(mIsInitialized)
+			{
+				CODEC_THROW(kAudioCodecStateError);
+			}
+			if(inPropertyDataSize != sizeof(UInt32))
+			{
+				CODEC_THROW(kAudioCodecBadPropertySizeError);
+			}
+			mDecodeThreadCount = *reinterpret_cast<const UInt32*>(inPropertyData);
+			if(mDecodeThreadCount > kParallelDecodeMaxThreads)
+			{
+				mDecodeThreadCount = kParallelDecodeMaxThreads;
+			}
+			break;
+			
+		default:
+			ACAppleIMA4Codec::SetProperty(inPropertyID, inPropertyDataSize, inPropertyData);
+			break;
+	}
+}
+
+void	ACAppleIMA4Decoder::Initialize(const AudioStreamBasicDescription* inInputFormat, const AudioStreamBasicDescription* inOutputFormat, const void* inMagicCookie, UInt32 inMagicCookieByteSize)
+{
+	ACAppleIMA4Codec::Initialize(inInputFormat, inOutputFormat, inMagicCookie, inMagicCookieByteSize);
+	
+	//	the pool's threads live as long as we're initialized
+	delete mWorkerPool;
+	mWorkerPool = NULL;
+	if(mDecodeThreadCount >= kParallelDecodeMinThreads)
+	{
+		mWorkerPool = new ACWorkerPool(mDecodeThreadCount);
+		if(mWorkerPool->GetNumberThreads() < kParallelDecodeMinThreads)
+		{
+			//	not enough threads could be started to be worth it
+			delete mWorkerPool;
+			mWorkerPool = NULL;
+		}
+		else
+		{
+			//	a request can't be bigger than the input buffer, so make sure it can hold
+			//	a full range for every thread or the parallel path would never be taken
+			UInt32 theParallelByteSize = mWorkerPool->GetNumberThreads() * kParallelDecodeMinPacketsPerRange * mInputFormat.mBytesPerPacket;
+			if(GetInputBufferByteSize() < theParallelByteSize)
+			{
+				ReallocateInputBuffer(theParallelByteSize);
+			}
+		}
+	}
+}
+
+void	ACAppleIMA4Decoder::Uninitialize()
+{
+	delete mWorkerPool;
+	mWorkerPool = NULL;
+	
+	ACAppleIMA4Codec::Uninitialize();
+}
+
 void	ACAppleIMA4Decoder::SetCurrentInputFormat(const AudioStreamBasicDescription& inInputFormat)
 {
 	if(!mIsInitialized)
@@ -219,13 +347,19 @@ UInt32	ACAppleIMA4Decoder::ProduceOutputPackets(void* outOutputData, UInt32& ioO
 		
 		//	decode the input data for each channel
 		Byte* theInputData = GetBytes(inputByteSize);
-		if (mOutputFormat.mBitsPerChannel == 16)
+		if((mWorkerPool != NULL) && (ioNumberPackets >= mWorkerPool->GetNumberThreads() * kParallelDecodeMinPacketsPerRange))
+		{
+			DecodePacketsParallel(ioNumberPackets, theInputData, outOutputData);
+			ConsumeInputData(inputByteSize);
+		}
+		else if (mOutputFormat.mBitsPerChannel == 16)
 		{
 			SInt16* theOutputData = reinterpret_cast<SInt16*>(outOutputData);
 			ChannelStateList::iterator theIterator = mChannelStateList.begin();
 			for(UInt32 theChannelIndex = 0; theChannelIndex < mOutputFormat.mChannelsPerFrame; ++theChannelIndex)
 			{
 				//printf("->DecodeChannel %d %d %d %08X %08X\n", mOutputFormat.mChannelsPerFrame, theChannelIndex, ioNumberPackets, theInputData, theOutputData);
+				CheckState(theInputData + (theChannelIndex * kIMA4PacketBytes), *theIterator);	/* make sure state predictors match stream */
 				DecodeChannelSInt16(*theIterator, mOutputFormat.mChannelsPerFrame, theChannelIndex, ioNumberPackets, theInputData, theOutputData);
 				std::advance(theIterator, 1);
 			}
@@ -238,6 +372,7 @@ UInt32	ACAppleIMA4Decoder::ProduceOutputPackets(void* outOutputData, UInt32& ioO
 			for(UInt32 theChannelIndex = 0; theChannelIndex < mOutputFormat.mChannelsPerFrame; ++theChannelIndex)
 			{
 				//printf("->DecodeChannel %d %d %d %08X %08X\n", mOutputFormat.mChannelsPerFrame, theChannelIndex, ioNumberPackets, theInputData, theOutputData);
+				CheckState(theInputData + (theChannelIndex * kIMA4PacketBytes), *theIterator);	/* make sure state predictors match stream */
 				DecodeChannelCAFloat(*theIterator, mOutputFormat.mChannelsPerFrame, theChannelIndex, ioNumberPackets, theInputData, theOutputData);
 				std::advance(theIterator, 1);
 			}
@@ -262,6 +397,39 @@ UInt32	ACAppleIMA4Decoder::ProduceOutputPackets(void* outOutputData, UInt32& ioO
 }
 
 
+void	ACAppleIMA4Decoder::DecodePacketRange(const void* inInputData, UInt32 inNumberPackets, void* outOutputData, UInt32& ioOutputDataByteSize) const
+{
+	//	the output format isn't settled until we're initialized
+	if(!mIsInitialized)
+		CODEC_THROW(kAudioCodecStateError);
+	
+	//	it is an error to ask for more output than you pass in buffer space for
+	UInt32	theOutputByteSize = inNumberPackets * kFramesPerPacket * mOutputFormat.mBytesPerFrame;
+	ThrowIf(ioOutputDataByteSize < theOutputByteSize, static_cast<ComponentResult>(kAudioCodecNotEnoughBufferSpaceError), "ACAppleIMA4Decoder::DecodePacketRange: not enough space in the output buffer");
+	ioOutputDataByteSize = theOutputByteSize;
+	
+	if(inNumberPackets == 0)
+		return;
+	
+	const Byte* theInputData = static_cast<const Byte*>(inInputData);
+	for(UInt32 theChannelIndex = 0; theChannelIndex < mOutputFormat.mChannelsPerFrame; ++theChannelIndex)
+	{
+		//	no stored index is negative, so CheckState always takes the header's state
+		ChannelState theChannelState;
+		theChannelState.mStepTableIndex = -1;
+		CheckState(theInputData + (theChannelIndex * kIMA4PacketBytes), theChannelState);
+		
+		if (mOutputFormat.mBitsPerChannel == 16)
+		{
+			DecodeChannelSInt16(theChannelState, mOutputFormat.mChannelsPerFrame, theChannelIndex, inNumberPackets, theInputData, reinterpret_cast<SInt16*>(outOutputData));
+		}
+		else
+		{
+			DecodeChannelCAFloat(theChannelState, mOutputFormat.mChannelsPerFrame, theChannelIndex, inNumberPackets, theInputData, reinterpret_cast<float*>(outOutputData));
+		}
+	}
+}
+
 void	ACAppleIMA4Decoder::DecodeChannelSInt16(ChannelState& ioChannelState, UInt32 inNumberChannels, UInt32 inDecodeChannel, UInt32 inNumberPacketsToDecode, const Byte* inInputData, SInt16* outOutputData)
 {
 	//	This decoder can only decode one channel at a time.
@@ -274,7 +442,7 @@ void	ACAppleIMA4Decoder::DecodeChannelSInt16(ChannelState& ioChannelState, UInt3
 	Byte*	theInputData	= const_cast<Byte*>(inInputData) + (inDecodeChannel * kIMA4PacketBytes);
 	UInt32	theOutputStride	= inNumberChannels;
 
-	SInt32 theDifference;
+	SInt32 theEntry;
 	SInt32 theCode = 0;
 	UInt32 theTemporaryInputData = 0;					/* initialize so warnings go away */
 
@@ -283,12 +451,10 @@ void	ACAppleIMA4Decoder::DecodeChannelSInt16(ChannelState& ioChannelState, UInt3
 	if (inNumberPacketsToDecode == 0)
 		return;
 
-	CheckState(theInputData, ioChannelState);						/* make sure state predictors match stream */
 	theInputData += 2;										/* skip first predictor */
 
 	SInt32 thePredictedSample = ioChannelState.mPredictedSample;					/* continue where we left off last time */
-	SInt32	theStepTableIndex = ioChannelState.mStepTableIndex;
-	SInt32	theStep = sStepTable[theStepTableIndex];
+	UInt32	theTableRow = ioChannelState.mStepTableIndex << 4;
 
 	for (; inNumberPacketsToDecode > 0; --inNumberPacketsToDecode)
 	{
@@ -304,19 +470,8 @@ void	ACAppleIMA4Decoder::DecodeChannelSInt16(ChannelState& ioChannelState, UInt3
 				theCode = theTemporaryInputData & 0x0F;
 			}
 			
-			theDifference = 0;								/* compute new sample estimate thePredictedSample */
-			if (theCode & 4)
-				theDifference += theStep;
-			if (theCode & 2)
-				theDifference += theStep >> 1;
-			if (theCode & 1)
-				theDifference += theStep >> 2;
-				
-			theDifference += theStep >> 3;
-			if (theCode & 8)
-				theDifference = -theDifference;
-
-			thePredictedSample += theDifference;
+			theEntry = sDecodeTable[theTableRow | theCode];		/* compute new sample estimate thePredictedSample */
+			thePredictedSample += theEntry >> kDecodeTableShift;
 
 			//	check for overflow
 			if(thePredictedSample > 32767)
@@ -328,26 +483,21 @@ void	ACAppleIMA4Decoder::DecodeChannelSInt16(ChannelState& ioChannelState, UInt3
 				thePredictedSample = -32768;
 			}
 
-			//printf("   theCode %02X  theDifference %d\n", theCode, theDifference);
+			//printf("   theCode %02X  theDifference %d\n", theCode, theEntry >> kDecodeTableShift);
 			//printf("OUT %02X %d   \n", thePredictedSample & 255, thePredictedSample);
 
 			*theOutputData = thePredictedSample;
 			theOutputData += theOutputStride;
 			
-			theStepTableIndex += sIndexTable[theCode];				/* compute new stepsize step */
-			if (theStepTableIndex < 0)
-				theStepTableIndex = 0;
-			else if (theStepTableIndex > 88)
-				theStepTableIndex = 88;
-			theStep = sStepTable[theStepTableIndex];
-			//printf("   theStep %d  theStepTableIndex %d\n", theStep, theStepTableIndex);
+			theTableRow = theEntry & kDecodeTableRowMask;			/* compute new stepsize step */
+			//printf("   theStepTableIndex %d\n", theTableRow >> 4);
 		}
 
 		theInputData += theInputStride;
 	}
 
 	ioChannelState.mPredictedSample = thePredictedSample;
-	ioChannelState.mStepTableIndex = theStepTableIndex;
+	ioChannelState.mStepTableIndex = theTableRow >> 4;
 }
 
 void	ACAppleIMA4Decoder::DecodeChannelCAFloat(ChannelState& ioChannelState, UInt32 inNumberChannels, UInt32 inDecodeChannel, UInt32 inNumberPacketsToDecode, const Byte* inInputData, float* outOutputData)
@@ -362,7 +512,7 @@ void	ACAppleIMA4Decoder::DecodeChannelCAFloat(ChannelState& ioChannelState, UInt
 	Byte*	theInputData	= const_cast<Byte*>(inInputData) + (inDecodeChannel * kIMA4PacketBytes);
 	UInt32	theOutputStride	= inNumberChannels;
 
-	SInt32 theDifference;
+	SInt32 theEntry;
 	SInt32 theCode = 0;
 	UInt32 theTemporaryInputData = 0;					/* initialize so warnings go away */
 	float * tempFloatPtr;
@@ -374,12 +524,10 @@ void	ACAppleIMA4Decoder::DecodeChannelCAFloat(ChannelState& ioChannelState, UInt
 	if (inNumberPacketsToDecode == 0)
 		return;
 
-	CheckState(theInputData, ioChannelState);						/* make sure state predictors match stream */
 	theInputData += 2;										/* skip first predictor */
 
 	SInt32 thePredictedSample = ioChannelState.mPredictedSample;					/* continue where we left off last time */
-	SInt32	theStepTableIndex = ioChannelState.mStepTableIndex;
-	SInt32	theStep = sStepTable[theStepTableIndex];
+	UInt32	theTableRow = ioChannelState.mStepTableIndex << 4;
 
 	for (; inNumberPacketsToDecode > 0; --inNumberPacketsToDecode)
 	{
@@ -395,19 +543,8 @@ void	ACAppleIMA4Decoder::DecodeChannelCAFloat(ChannelState& ioChannelState, UInt
 				theCode = theTemporaryInputData & 0x0F;
 			}
 			
-			theDifference = 0;								/* compute new sample estimate thePredictedSample */
-			if (theCode & 4)
-				theDifference += theStep;
-			if (theCode & 2)
-				theDifference += theStep >> 1;
-			if (theCode & 1)
-				theDifference += theStep >> 2;
-				
-			theDifference += theStep >> 3;
-			if (theCode & 8)
-				theDifference = -theDifference;
-
-			thePredictedSample += theDifference;
+			theEntry = sDecodeTable[theTableRow | theCode];		/* compute new sample estimate thePredictedSample */
+			thePredictedSample += theEntry >> kDecodeTableShift;
 
 			//	check for overflow
 			if(thePredictedSample > 32767)
@@ -419,7 +556,7 @@ void	ACAppleIMA4Decoder::DecodeChannelCAFloat(ChannelState& ioChannelState, UInt
 				thePredictedSample = -32768;
 			}
 
-			//printf("   theCode %02X  theDifference %d\n", theCode, theDifference);
+			//printf("   theCode %02X  theDifference %d\n", theCode, theEntry >> kDecodeTableShift);
 			//printf("OUT %02X %d   \n", thePredictedSample & 255, thePredictedSample);
 
 			// Cheaper than floating point division
@@ -434,20 +571,15 @@ void	ACAppleIMA4Decoder::DecodeChannelCAFloat(ChannelState& ioChannelState, UInt
 			*theOutputData = *tempFloatPtr;
 			theOutputData += theOutputStride;
 			
-			theStepTableIndex += sIndexTable[theCode];				/* compute new stepsize step */
-			if (theStepTableIndex < 0)
-				theStepTableIndex = 0;
-			else if (theStepTableIndex > 88)
-				theStepTableIndex = 88;
-			theStep = sStepTable[theStepTableIndex];
-			//printf("   theStep %d  theStepTableIndex %d\n", theStep, theStepTableIndex);
+			theTableRow = theEntry & kDecodeTableRowMask;			/* compute new stepsize step */
+			//printf("   theStepTableIndex %d\n", theTableRow >> 4);
 		}
 
 		theInputData += theInputStride;
 	}
 
 	ioChannelState.mPredictedSample = thePredictedSample;
-	ioChannelState.mStepTableIndex = theStepTableIndex;
+	ioChannelState.mStepTableIndex = theTableRow >> 4;
 }
 
 UInt32	ACAppleIMA4Decoder::GetVersion() const
@@ -471,6 +603,8 @@ void ACAppleIMA4Decoder::CheckState(const Byte *inInputData, ChannelState& ioCha
 {
 	SInt16 s = EndianS16_BtoN(*((short *) inInputData));
 	SInt16 theStepTableIndex = s & kIndexMask;					// get stored index
+	if (theStepTableIndex > 88)								// a damaged header mustn't send us off the end of the tables
+		theStepTableIndex = 88;
 	s &= kPredictorMask;					// get stored thePredictedSample
 	SInt32 thePredictedSample = s;							// make sure it gets sign-extended!
 
@@ -487,6 +621,192 @@ void ACAppleIMA4Decoder::CheckState(const Byte *inInputData, ChannelState& ioCha
 	ioChannelState.mStepTableIndex = theStepTableIndex;
 }
 
+void	ACAppleIMA4Decoder::ResyncChannel(const Byte* inInputData, SInt32& ioPredictedSample, SInt32& ioStepTableIndex)
+{
+	ChannelState theChannelState;
+	theChannelState.mPredictedSample = ioPredictedSample;
+	theChannelState.mStepTableIndex = ioStepTableIndex;
+	CheckState(inInputData, theChannelState);
+	ioPredictedSample = theChannelState.mPredictedSample;
+	ioStepTableIndex = theChannelState.mStepTableIndex;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//	Parallel decoding
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+//	clamp(clamp(x + a1, l1, h1) + a2, l2, h2) == clamp(x + a1 + a2, clamp(l1 + a2, l2, h2), clamp(h1 + a2, l2, h2))
+//	so a range sums up as the total offset plus where the lowest and highest
+//	starting values end up, and those are just two more paths through the range.
+
+ACAppleIMA4Decoder::ClampedOffset	ACAppleIMA4Decoder::SummarizeChannelIndex(UInt32 inNumberChannels, UInt32 inDecodeChannel, UInt32 inNumberPacketsToDecode, const Byte* inInputData)
+{
+	//	the step table index only depends on the codes, so the whole range can be
+	//	summed up without knowing where it starts. The decode table already clamps
+	//	the paths from 0 and 88.
+	ClampedOffset theAnswer;
+	const Byte* theInputData = inInputData + (inDecodeChannel * kIMA4PacketBytes) + kHeaderBytes;
+	UInt32 theInputStride = (inNumberChannels - 1) * kIMA4PacketBytes + kHeaderBytes;
+	SInt64 theOffset = 0;
+	UInt32 theLowTableRow = 0;
+	UInt32 theHighTableRow = 88 << 4;
+	
+	for(; inNumberPacketsToDecode > 0; --inNumberPacketsToDecode)
+	{
+		for(UInt32 theByteIndex = 0; theByteIndex < kBytesPerChannelPerPacket; ++theByteIndex)
+		{
+			UInt32 theTemporaryInputData = *theInputData++;
+			UInt32 theCode = theTemporaryInputData & 0x0F;
+			theOffset += sIndexTable[theCode];
+			theLowTableRow = sDecodeTable[theLowTableRow | theCode] & kDecodeTableRowMask;
+			theHighTableRow = sDecodeTable[theHighTableRow | theCode] & kDecodeTableRowMask;
+			theCode = theTemporaryInputData >> 4;
+			theOffset += sIndexTable[theCode];
+			theLowTableRow = sDecodeTable[theLowTableRow | theCode] & kDecodeTableRowMask;
+			theHighTableRow = sDecodeTable[theHighTableRow | theCode] & kDecodeTableRowMask;
+		}
+		theInputData += theInputStride;
+	}
+	
+	theAnswer.mOffset = theOffset;
+	theAnswer.mLow = theLowTableRow >> 4;
+	theAnswer.mHigh = theHighTableRow >> 4;
+	return theAnswer;
+}
+
+ACAppleIMA4Decoder::ClampedOffset	ACAppleIMA4Decoder::SummarizeChannelPredictor(SInt32 inStepTableIndex, UInt32 inNumberChannels, UInt32 inDecodeChannel, UInt32 inNumberPacketsToDecode, const Byte* inInputData)
+{
+	//	once the starting step table index is known, every difference is known too
+	//	and the predicted sample can be summed up without knowing where it starts
+	//	The bounds are the paths taken from -32768 and 32767.
+	ClampedOffset theAnswer;
+	const Byte* theInputData = inInputData + (inDecodeChannel * kIMA4PacketBytes) + kHeaderBytes;
+	UInt32 theInputStride = (inNumberChannels - 1) * kIMA4PacketBytes + kHeaderBytes;
+	UInt32 theTableRow = inStepTableIndex << 4;
+	SInt64 theOffset = 0;
+	SInt32 theLow = -32768;
+	SInt32 theHigh = 32767;
+	
+	for(; inNumberPacketsToDecode > 0; --inNumberPacketsToDecode)
+	{
+		for(UInt32 theNumberSamplesLeft = kFramesPerPacket; theNumberSamplesLeft > 0; --theNumberSamplesLeft)
+		{
+			SInt32 theCode = (theNumberSamplesLeft & 1) ? (theInputData[-1] >> 4) : (*theInputData++ & 0x0F);
+			SInt32 theEntry = sDecodeTable[theTableRow | theCode];
+			SInt32 theDifference = theEntry >> kDecodeTableShift;
+			theOffset += theDifference;
+			theLow += theDifference;
+			theLow = (theLow < -32768) ? -32768 : ((theLow > 32767) ? 32767 : theLow);
+			theHigh += theDifference;
+			theHigh = (theHigh < -32768) ? -32768 : ((theHigh > 32767) ? 32767 : theHigh);
+			theTableRow = theEntry & kDecodeTableRowMask;
+		}
+		theInputData += theInputStride;
+	}
+	
+	theAnswer.mOffset = theOffset;
+	theAnswer.mLow = theLow;
+	theAnswer.mHigh = theHigh;
+	return theAnswer;
+}
+
+void	ACAppleIMA4Decoder::ParallelDecodeTask(void* inContext, UInt32 inRangeIndex)
+{
+	ParallelDecodeContext* theContext = static_cast<ParallelDecodeContext*>(inContext);
+	ParallelDecodeRange& theRange = theContext->mRanges[inRangeIndex];
+	UInt32 theNumberChannels = theContext->mDecoder->mOutputFormat.mChannelsPerFrame;
+	const Byte* theInputData = theContext->mInputData + (theRange.mFirstPacket * theNumberChannels * kIMA4PacketBytes);
+	UInt32 theFirstSample = theRange.mFirstPacket * kFramesPerPacket * theNumberChannels;
+	
+	for(UInt32 theChannelIndex = 0; theChannelIndex < theNumberChannels; ++theChannelIndex)
+	{
+		ChannelState& theChannelState = theRange.mChannelStateList[theChannelIndex];
+		switch(theContext->mPhase)
+		{
+			case kParallelDecodeSummarizeIndex:
+				theRange.mSummary[theChannelIndex] = SummarizeChannelIndex(theNumberChannels, theChannelIndex, theRange.mNumberPackets, theInputData);
+				break;
+			
+			case kParallelDecodeSummarizePredictor:
+				theRange.mSummary[theChannelIndex] = SummarizeChannelPredictor(theChannelState.mStepTableIndex, theNumberChannels, theChannelIndex, theRange.mNumberPackets, theInputData);
+				break;
+			
+			case kParallelDecodeDecode:
+				if(theContext->mDecoder->mOutputFormat.mBitsPerChannel == 16)
+				{
+					DecodeChannelSInt16(theChannelState, theNumberChannels, theChannelIndex, theRange.mNumberPackets, theInputData, static_cast<SInt16*>(theContext->mOutputData) + theFirstSample);
+				}
+				else
+				{
+					DecodeChannelCAFloat(theChannelState, theNumberChannels, theChannelIndex, theRange.mNumberPackets, theInputData, static_cast<float*>(theContext->mOutputData) + theFirstSample);
+				}
+				break;
+		};
+	}
+}
+
+void	ACAppleIMA4Decoder::DecodePacketsParallel(UInt32 inNumberPackets, const Byte* inInputData, void* outOutputData)
+{
+	//	only called once there's a full range for every thread
+	UInt32 theNumberChannels = mOutputFormat.mChannelsPerFrame;
+	UInt32 theNumberRanges = mWorkerPool->GetNumberThreads();
+
+	ParallelDecodeContext theContext;
+	theContext.mDecoder = this;
+	theContext.mInputData = inInputData;
+	theContext.mOutputData = outOutputData;
+	theContext.mRanges.resize(theNumberRanges);
+	
+	UInt32 theFirstPacket = 0;
+	for(UInt32 theRangeIndex = 0; theRangeIndex < theNumberRanges; ++theRangeIndex)
+	{
+		ParallelDecodeRange& theRange = theContext.mRanges[theRangeIndex];
+		theRange.mFirstPacket = theFirstPacket;
+		theRange.mNumberPackets = (inNumberPackets / theNumberRanges) + ((theRangeIndex < (inNumberPackets % theNumberRanges)) ? 1 : 0);
+		theRange.mChannelStateList.resize(theNumberChannels);
+		theRange.mSummary.resize(theNumberChannels);
+		theFirstPacket += theRange.mNumberPackets;
+	}
+	
+	//	the serial decoder only resyncs with the stream at the start of the request
+	//	so that's the only place the packet headers matter
+	for(UInt32 theChannelIndex = 0; theChannelIndex < theNumberChannels; ++theChannelIndex)
+	{
+		CheckState(inInputData + (theChannelIndex * kIMA4PacketBytes), mChannelStateList[theChannelIndex]);
+	}
+	theContext.mRanges[0].mChannelStateList = mChannelStateList;
+	
+	//	work out where the step table index starts in each range
+	theContext.mPhase = kParallelDecodeSummarizeIndex;
+	mWorkerPool->Run(ParallelDecodeTask, &theContext, theNumberRanges - 1);
+	for(UInt32 theRangeIndex = 1; theRangeIndex < theNumberRanges; ++theRangeIndex)
+	{
+		ParallelDecodeRange& thePreviousRange = theContext.mRanges[theRangeIndex - 1];
+		for(UInt32 theChannelIndex = 0; theChannelIndex < theNumberChannels; ++theChannelIndex)
+		{
+			theContext.mRanges[theRangeIndex].mChannelStateList[theChannelIndex].mStepTableIndex = thePreviousRange.mSummary[theChannelIndex].Apply(thePreviousRange.mChannelStateList[theChannelIndex].mStepTableIndex);
+		}
+	}
+	
+	//	then where the predicted sample starts
+	theContext.mPhase = kParallelDecodeSummarizePredictor;
+	mWorkerPool->Run(ParallelDecodeTask, &theContext, theNumberRanges - 1);
+	for(UInt32 theRangeIndex = 1; theRangeIndex < theNumberRanges; ++theRangeIndex)
+	{
+		ParallelDecodeRange& thePreviousRange = theContext.mRanges[theRangeIndex - 1];
+		for(UInt32 theChannelIndex = 0; theChannelIndex < theNumberChannels; ++theChannelIndex)
+		{
+			theContext.mRanges[theRangeIndex].mChannelStateList[theChannelIndex].mPredictedSample = thePreviousRange.mSummary[theChannelIndex].Apply(thePreviousRange.mChannelStateList[theChannelIndex].mPredictedSample);
+		}
+	}
+	
+	//	and now every range can be decoded on its own
+	theContext.mPhase = kParallelDecodeDecode;
+	mWorkerPool->Run(ParallelDecodeTask, &theContext, theNumberRanges);
+	
+	mChannelStateList = theContext.mRanges[theNumberRanges - 1].mChannelStateList;
+}
+
 void ACAppleIMA4Decoder::FixFormats()
 {
 	mInputFormat.mFramesPerPacket = 64;
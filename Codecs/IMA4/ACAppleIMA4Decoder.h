@@ -48,6 +48,20 @@
 
 #include "ACAppleIMA4Codec.h"
 
+class ACWorkerPool;
+
+//	Private properties
+enum
+{
+	//	UInt32, the number of threads used to decode large requests, at most 32.
+	//	Staying bit exact costs the parallel path up to three times the work of a
+	//	serial decode, so anything under 4 threads (1 is the default) decodes
+	//	everything on the calling thread. Only settable while uninitialized.
+	//	Initialize grows the input buffer so that it holds enough packets to give
+	//	every thread a share of a request.
+	kAppleIMA4DecoderPropertyDecodeThreadCount = 'dthr'
+};
+
 //=============================================================================
 //	ACAppleIMA4Decoder
 //
@@ -64,7 +78,14 @@ public:
 					ACAppleIMA4Decoder();
 	virtual			~ACAppleIMA4Decoder();
 
+	virtual void	GetPropertyInfo(AudioCodecPropertyID inPropertyID, UInt32& outPropertyDataSize, bool& outWritable);
 	virtual void	GetProperty(AudioCodecPropertyID inPropertyID, UInt32& ioPropertyDataSize, void* outPropertyData);
+	virtual void	SetProperty(AudioCodecPropertyID inPropertyID, UInt32 inPropertyDataSize, const void* inPropertyData);
+
+//	Data Handling
+public:
+	virtual void	Initialize(const AudioStreamBasicDescription* inInputFormat, const AudioStreamBasicDescription* inOutputFormat, const void* inMagicCookie, UInt32 inMagicCookieByteSize);
+	virtual void	Uninitialize();
 
 //	Format Information
 public:
@@ -76,15 +97,108 @@ public:
 public:
 	virtual UInt32	ProduceOutputPackets(void* outOutputData, UInt32& ioOutputDataByteSize, UInt32& ioNumberPackets, AudioStreamPacketDescription* outPacketDescription);
 
+//	Random Access
+public:
+	//	Decodes inNumberPackets packets straight from the caller's data into the
+	//	current output format, bypassing the input buffer and leaving the codec's
+	//	state alone. inInputData has to point at the start of a packet, ie packet N
+	//	of a stored stream is at N * mBytesPerPacket of the input format. Since each
+	//	channel starts from the state stored in the first packet's header, any packet
+	//	can be decoded on its own. Throws kAudioCodecStateError if uninitialized.
+	void			DecodePacketRange(const void* inInputData, UInt32 inNumberPackets, void* outOutputData, UInt32& ioOutputDataByteSize) const;
+
+//	Table Driven Decoding
+public:
+	//	sDecodeTable[(step table index << 4) | code] has the signed difference for the
+	//	code in the bits above kDecodeTableShift and the row for the next step table
+	//	index, (next index << 4), in the bits below it. It's built from sStepTable and
+	//	sIndexTable when the codec is loaded. ACAppleIMA4BatchDecoder decodes with
+	//	the same table and resyncs the same way, so their output matches.
+	enum
+	{
+		kDecodeTableShift = 11,
+		kDecodeTableRowMask = (1 << kDecodeTableShift) - 1
+	};
+	static const SInt32*	GetDecodeTable() { return sDecodeTable; }
+	
+	//	takes the state stored in the packet header at inInputData when the
+	//	channel's state has drifted too far from it
+	static void		ResyncChannel(const Byte* inInputData, SInt32& ioPredictedSample, SInt32& ioStepTableIndex);
+
 //	Implementation
 private:
+	//	the decode kernels pick up where ioChannelState left off, it's up to the
+	//	caller to resync the state with the stream first using CheckState
 	static void		DecodeChannelSInt16(ChannelState& ioChannelState, UInt32 inNumberChannels, UInt32 inDecodeChannel, UInt32 inNumberPacketsToDecode, const Byte* inInputData, SInt16* outOutputData);
 
 	static void		DecodeChannelCAFloat(ChannelState& ioChannelState, UInt32 inNumberChannels, UInt32 inDecodeChannel, UInt32 inNumberPacketsToDecode, const Byte* inInputData, float* outOutputData);
 	
 	static void CheckState(const Byte *inInputData, ChannelState& ioChannelState);
 
+	static SInt32		sDecodeTable[89 * 16];
+	static const bool	sDecodeTableIsInitialized;
+	static bool			InitializeDecodeTable();
+
 	virtual void		FixFormats();
+
+	//	Parallel decoding
+	//
+	//	Each range of packets is decoded on its own thread. To stay bit exact with
+	//	decoding the whole request serially, every range has to start from exactly
+	//	the state the serial decoder would have had there, not from the (rounded)
+	//	state in the packet header. Both the step table index and the predicted
+	//	sample evolve as x -> clamp(x + a, low, high), where a only depends on the
+	//	nibbles and the step table index. That form is closed under composition, so
+	//	each range can be summed up on its own, the summaries chained serially (which
+	//	is cheap) and the ranges then decoded in parallel from their exact state.
+	struct	ClampedOffset
+	{
+		SInt64			mOffset;
+		SInt32			mLow;
+		SInt32			mHigh;
+		
+		ClampedOffset() : mOffset(0), mLow(-0x7FFFFFFF), mHigh(0x7FFFFFFF) {}
+		SInt32 Apply(SInt32 inValue) const { SInt64 theValue = inValue + mOffset; return (theValue < mLow) ? mLow : ((theValue > mHigh) ? mHigh : static_cast<SInt32>(theValue)); }
+	};
+	
+	struct	ParallelDecodeRange
+	{
+		UInt32			mFirstPacket;
+		UInt32			mNumberPackets;
+		ChannelStateList	mChannelStateList;	//	the state at the start of the range, at the end once decoded
+		std::vector<ClampedOffset>	mSummary;
+	};
+	
+	struct	ParallelDecodeContext
+	{
+		ACAppleIMA4Decoder*	mDecoder;
+		const Byte*			mInputData;
+		void*				mOutputData;
+		UInt32				mPhase;
+		std::vector<ParallelDecodeRange>	mRanges;
+	};
+	
+	enum
+	{
+		kParallelDecodeSummarizeIndex = 0,
+		kParallelDecodeSummarizePredictor = 1,
+		kParallelDecodeDecode = 2,
+		
+		//	fewer threads than this can't make up for the two summary passes
+		kParallelDecodeMinThreads = 4,
+		kParallelDecodeMaxThreads = 32,
+		
+		//	ranges smaller than this aren't worth the three trips through the pool
+		kParallelDecodeMinPacketsPerRange = 256
+	};
+	
+	void			DecodePacketsParallel(UInt32 inNumberPackets, const Byte* inInputData, void* outOutputData);
+	static void		ParallelDecodeTask(void* inContext, UInt32 inRangeIndex);
+	static ClampedOffset	SummarizeChannelIndex(UInt32 inNumberChannels, UInt32 inDecodeChannel, UInt32 inNumberPacketsToDecode, const Byte* inInputData);
+	static ClampedOffset	SummarizeChannelPredictor(SInt32 inStepTableIndex, UInt32 inNumberChannels, UInt32 inDecodeChannel, UInt32 inNumberPacketsToDecode, const Byte* inInputData);
+
+	UInt32			mDecodeThreadCount;
+	ACWorkerPool*	mWorkerPool;
 	
 };
 
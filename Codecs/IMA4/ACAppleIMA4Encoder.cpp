@@ -49,6 +49,7 @@
 #include "CAStreamBasicDescription.h"
 #include "CASampleTools.h"
 #include "CADebugMacros.h"
+#include "ACAppleIMA4Vector.h"
 
 //=============================================================================
 //	ACAppleIMA4Encoder
@@ -280,21 +281,15 @@ UInt32	ACAppleIMA4Encoder::ProduceOutputPackets(
 		//	set the return value
 		ioOutputDataByteSize = theOutputByteSize;
 		
-		//	encode the input data for each channel
+		//	encode the input data for all the channels
 		SInt16* theInputData = reinterpret_cast<SInt16*>(GetBytes(inputByteSize));
 		Byte* theOutputData = reinterpret_cast<Byte*>(outOutputData);
-		ChannelStateList::iterator theIterator = mChannelStateList.begin();
-		for(UInt32 theChannelIndex = 0; theChannelIndex < mOutputFormat.mChannelsPerFrame; ++theChannelIndex)
-		{
-			EncodeChannel(
-				*theIterator, 
-				mOutputFormat.mChannelsPerFrame, 
-				theChannelIndex, 
-				ioNumberPackets, 
-				theInputData, 
-				theOutputData);
-			std::advance(theIterator, 1);
-		}
+		EncodeChannels(
+			mChannelStateList, 
+			mOutputFormat.mChannelsPerFrame, 
+			ioNumberPackets, 
+			theInputData, 
+			theOutputData);
 
 		ConsumeInputData(inputByteSize);
 	}
@@ -454,6 +449,155 @@ void	ACAppleIMA4Encoder::EncodeChannel(
 	ioChannelState.mStepTableIndex = theStepTableIndex;
 }
 
+void	ACAppleIMA4Encoder::EncodeChannels(
+					ChannelStateList& 	ioChannelStateList, 
+					UInt32 				inNumberChannels, 
+					UInt32 				inNumberPacketsToEncode, 
+					const SInt16* 		inInputData, 
+					Byte* 				outOutputData)
+{
+#if defined(kIMA4VectorLanes)
+	//	This runs exactly the same arithmetic as EncodeChannel, just for
+	//	kIMA4VectorLanes channels at a time, one channel per lane, so the
+	//	packets come out byte for byte the same.
+	
+	//	the lookups want 32 bit entries
+	SInt32 theStepTable[89];
+	for(UInt32 theIndex = 0; theIndex < 89; ++theIndex)
+	{
+		theStepTable[theIndex] = sStepTable[theIndex];
+	}
+	
+	const IMA4Vector theZero = IMA4VectorSet(0);
+	const IMA4Vector theAllOnes = IMA4VectorSet(-1);
+	const IMA4Vector theSignCode = IMA4VectorSet(8);
+	const IMA4Vector theThree = IMA4VectorSet(3);
+	const IMA4Vector theSevens = IMA4VectorSet(7);
+	const IMA4Vector theMaximumIndex = IMA4VectorSet(88);
+	const IMA4Vector theMinimumSample = IMA4VectorSet(-32768);
+	const IMA4Vector theMaximumSample = IMA4VectorSet(32767);
+	
+	for(UInt32 theFirstChannel = 0; theFirstChannel < inNumberChannels; theFirstChannel += kIMA4VectorLanes)
+	{
+		UInt32 theNumberLanes = inNumberChannels - theFirstChannel;
+		if(theNumberLanes > kIMA4VectorLanes)
+		{
+			theNumberLanes = kIMA4VectorLanes;
+		}
+		
+		//	unused lanes just encode silence that never gets written out
+		SInt32 thePredictedSamples[kIMA4VectorLanes] = { 0 };
+		SInt32 theStepTableIndices[kIMA4VectorLanes] = { 0 };
+		SInt32 theSamples[kFramesPerPacket * kIMA4VectorLanes] = { 0 };
+		SInt32 theCodes[kFramesPerPacket * kIMA4VectorLanes];
+		
+		for(UInt32 theLane = 0; theLane < theNumberLanes; ++theLane)
+		{
+			thePredictedSamples[theLane] = ioChannelStateList[theFirstChannel + theLane].mPredictedSample;
+			theStepTableIndices[theLane] = ioChannelStateList[theFirstChannel + theLane].mStepTableIndex;
+		}
+		
+		IMA4Vector thePredictedSample = IMA4VectorLoad(thePredictedSamples);
+		IMA4Vector theStepTableIndex = IMA4VectorLoad(theStepTableIndices);
+		IMA4Vector theStep = IMA4VectorLookUp(theStepTable, theStepTableIndex);
+		
+		const SInt16* theInputData = inInputData + theFirstChannel;
+		Byte* theOutputData = outOutputData + (theFirstChannel * kIMA4PacketBytes);
+		
+		for(UInt32 thePacket = 0; thePacket < inNumberPacketsToEncode; ++thePacket)
+		{
+			//	write out the state for this packet
+			IMA4VectorStore(thePredictedSamples, thePredictedSample);
+			IMA4VectorStore(theStepTableIndices, theStepTableIndex);
+			for(UInt32 theLane = 0; theLane < theNumberLanes; ++theLane)
+			{
+				UInt16 theSavedState = (static_cast<SInt16>(thePredictedSamples[theLane]) & kPredictorMask) | (static_cast<SInt16>(theStepTableIndices[theLane]) & kStepTableIndexMask);
+				*reinterpret_cast<UInt16*>(theOutputData + (theLane * kIMA4PacketBytes)) = CASampleTools::UInt16NativeToBigEndian(theSavedState);
+			}
+			
+			//	gather the packet's samples into lanes in a single pass over the interleaved input
+			for(UInt32 theFrame = 0; theFrame < kFramesPerPacket; ++theFrame)
+			{
+				for(UInt32 theLane = 0; theLane < theNumberLanes; ++theLane)
+				{
+					theSamples[(theFrame * kIMA4VectorLanes) + theLane] = theInputData[theLane];
+				}
+				theInputData += inNumberChannels;
+			}
+			
+			for(UInt32 theFrame = 0; theFrame < kFramesPerPacket; ++theFrame)
+			{
+				//	calculate the difference between the predicted value and the actual value
+				IMA4Vector theDifference = IMA4VectorSub(IMA4VectorLoad(theSamples + (theFrame * kIMA4VectorLanes)), thePredictedSample);
+				
+				//	set the sign bit
+				IMA4Vector theNegative = IMA4VectorCompareGreater(theZero, theDifference);
+				IMA4Vector theCode = IMA4VectorAnd(theNegative, theSignCode);
+				theDifference = IMA4VectorAbs(theDifference);
+				
+				//	quantize the difference
+				IMA4Vector theTempStep = theStep;
+				for(SInt32 theMask = 4; theMask > 0; theMask >>= 1)
+				{
+					IMA4Vector theBitIsSet = IMA4VectorAndNot(IMA4VectorCompareGreater(theTempStep, theDifference), theAllOnes);
+					theCode = IMA4VectorOr(theCode, IMA4VectorAnd(theBitIsSet, IMA4VectorSet(theMask)));
+					theDifference = IMA4VectorSub(theDifference, IMA4VectorAnd(theBitIsSet, theTempStep));
+					theTempStep = IMA4VectorShiftRight(theTempStep, 1);
+				}
+				IMA4VectorStore(theCodes + (theFrame * kIMA4VectorLanes), theCode);
+				
+				//	predict the next sample
+				IMA4Vector theMagnitude = IMA4VectorShiftRight(theStep, 3);
+				theMagnitude = IMA4VectorAdd(theMagnitude, IMA4VectorAnd(IMA4VectorCompareGreater(IMA4VectorAnd(theCode, IMA4VectorSet(4)), theZero), theStep));
+				theMagnitude = IMA4VectorAdd(theMagnitude, IMA4VectorAnd(IMA4VectorCompareGreater(IMA4VectorAnd(theCode, IMA4VectorSet(2)), theZero), IMA4VectorShiftRight(theStep, 1)));
+				theMagnitude = IMA4VectorAdd(theMagnitude, IMA4VectorAnd(IMA4VectorCompareGreater(IMA4VectorAnd(theCode, IMA4VectorSet(1)), theZero), IMA4VectorShiftRight(theStep, 2)));
+				theMagnitude = IMA4VectorSub(IMA4VectorXor(theMagnitude, theNegative), theNegative);
+				thePredictedSample = IMA4VectorMin(IMA4VectorMax(IMA4VectorAdd(thePredictedSample, theMagnitude), theMinimumSample), theMaximumSample);
+				
+				//	compute the new step size, sIndexTable is -1 for codes 0-3 and 2 * (code - 3) for codes 4-7
+				IMA4Vector theIndexDelta = IMA4VectorSub(IMA4VectorAnd(theCode, theSevens), theThree);
+				IMA4Vector theIndexGrows = IMA4VectorCompareGreater(theIndexDelta, theZero);
+				theIndexDelta = IMA4VectorOr(IMA4VectorAnd(theIndexGrows, IMA4VectorAdd(theIndexDelta, theIndexDelta)), IMA4VectorAndNot(theIndexGrows, theAllOnes));
+				theStepTableIndex = IMA4VectorMin(IMA4VectorMax(IMA4VectorAdd(theStepTableIndex, theIndexDelta), theZero), theMaximumIndex);
+				theStep = IMA4VectorLookUp(theStepTable, theStepTableIndex);
+			}
+			
+			//	pack the nibbles, low nibble first
+			for(UInt32 theLane = 0; theLane < theNumberLanes; ++theLane)
+			{
+				Byte* theChannelData = theOutputData + (theLane * kIMA4PacketBytes) + kHeaderBytes;
+				for(UInt32 theByte = 0; theByte < kBytesPerChannelPerPacket; ++theByte)
+				{
+					theChannelData[theByte] = static_cast<Byte>(theCodes[(2 * theByte * kIMA4VectorLanes) + theLane] | (theCodes[((2 * theByte + 1) * kIMA4VectorLanes) + theLane] << 4));
+				}
+			}
+			
+			theOutputData += inNumberChannels * kIMA4PacketBytes;
+		}
+		
+		//	update the state that's passed back to the caller
+		IMA4VectorStore(thePredictedSamples, thePredictedSample);
+		IMA4VectorStore(theStepTableIndices, theStepTableIndex);
+		for(UInt32 theLane = 0; theLane < theNumberLanes; ++theLane)
+		{
+			ioChannelStateList[theFirstChannel + theLane].mPredictedSample = thePredictedSamples[theLane];
+			ioChannelStateList[theFirstChannel + theLane].mStepTableIndex = theStepTableIndices[theLane];
+		}
+	}
+#else
+	for(UInt32 theChannelIndex = 0; theChannelIndex < inNumberChannels; ++theChannelIndex)
+	{
+		EncodeChannel(
+			ioChannelStateList[theChannelIndex], 
+			inNumberChannels, 
+			theChannelIndex, 
+			inNumberPacketsToEncode, 
+			inInputData, 
+			outOutputData);
+	}
+#endif
+}
+
 UInt32	ACAppleIMA4Encoder::GetVersion() const
 {
 	return 0x00010000;
@@ -80,10 +80,16 @@ public:
 	virtual UInt32	ProduceOutputPackets(void* outOutputData, UInt32& ioOutputDataByteSize, UInt32& ioNumberPackets, AudioStreamPacketDescription* outPacketDescription);
 
 //	Implementation
-private:
+protected:
 	static void		EncodeChannel(ChannelState& ioChannelState, UInt32 inNumberChannels, UInt32 inEncodeChannel, UInt32 inNumberPacketsToEncode, const SInt16* inInputData, Byte* outOutputData);
 
+	//	encodes every channel in a single pass over the input, vectorized across channels where possible
+	static void		EncodeChannels(ChannelStateList& ioChannelStateList, UInt32 inNumberChannels, UInt32 inNumberPacketsToEncode, const SInt16* inInputData, Byte* outOutputData);
+
 	virtual void		FixFormats();
+	
+	//	the input format's packets are single frames
+	virtual UInt32		GetInputPacketByteSize() const { return mInputFormat.mBytesPerFrame * kFramesPerPacket; }
 
 	UInt32 mSupportedChannelTotals[kIMANumberSupportedChannelTotals];
 
@@ -0,0 +1,142 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACAppleIMA4Vector.h
+
+=============================================================================*/
+#if !defined(__ACAppleIMA4Vector_h__)
+#define __ACAppleIMA4Vector_h__
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACCodec.h"
+
+//=============================================================================
+//	IMA4Vector
+//
+//	Thin wrappers around the 32 bit integer vector operations the IMA4 kernels
+//	need, so each kernel is written once for whatever the compiler is allowed
+//	to use. kIMA4VectorLanes is defined whenever AVX2, SSE4.1 or SSE2 is
+//	available, which covers every Intel Mac without any extra compiler flags.
+//	Otherwise the kernels fall back to their scalar versions.
+//=============================================================================
+
+#if defined(__AVX2__)
+
+	#include <immintrin.h>
+	
+	#define	kIMA4VectorLanes	8
+	typedef __m256i	IMA4Vector;
+	
+	static inline IMA4Vector	IMA4VectorLoad(const SInt32* inData)							{ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(inData)); }
+	static inline void			IMA4VectorStore(SInt32* outData, IMA4Vector inVector)			{ _mm256_storeu_si256(reinterpret_cast<__m256i*>(outData), inVector); }
+	static inline IMA4Vector	IMA4VectorSet(SInt32 inValue)									{ return _mm256_set1_epi32(inValue); }
+	static inline IMA4Vector	IMA4VectorAdd(IMA4Vector inA, IMA4Vector inB)					{ return _mm256_add_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorSub(IMA4Vector inA, IMA4Vector inB)					{ return _mm256_sub_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorAnd(IMA4Vector inA, IMA4Vector inB)					{ return _mm256_and_si256(inA, inB); }
+	static inline IMA4Vector	IMA4VectorAndNot(IMA4Vector inA, IMA4Vector inB)				{ return _mm256_andnot_si256(inA, inB); }
+	static inline IMA4Vector	IMA4VectorOr(IMA4Vector inA, IMA4Vector inB)					{ return _mm256_or_si256(inA, inB); }
+	static inline IMA4Vector	IMA4VectorXor(IMA4Vector inA, IMA4Vector inB)					{ return _mm256_xor_si256(inA, inB); }
+	static inline IMA4Vector	IMA4VectorCompareGreater(IMA4Vector inA, IMA4Vector inB)		{ return _mm256_cmpgt_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorMin(IMA4Vector inA, IMA4Vector inB)					{ return _mm256_min_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorMax(IMA4Vector inA, IMA4Vector inB)					{ return _mm256_max_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorAbs(IMA4Vector inA)									{ return _mm256_abs_epi32(inA); }
+	#define	IMA4VectorShiftRight(inA, inShift)	_mm256_srai_epi32(inA, inShift)
+	static inline IMA4Vector	IMA4VectorLookUp(const SInt32* inTable, IMA4Vector inIndex)		{ return _mm256_i32gather_epi32(reinterpret_cast<const int*>(inTable), inIndex, 4); }
+
+#elif defined(__SSE4_1__)
+
+	#include <smmintrin.h>
+	
+	#define	kIMA4VectorLanes	4
+	typedef __m128i	IMA4Vector;
+	
+	static inline IMA4Vector	IMA4VectorLoad(const SInt32* inData)							{ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(inData)); }
+	static inline void			IMA4VectorStore(SInt32* outData, IMA4Vector inVector)			{ _mm_storeu_si128(reinterpret_cast<__m128i*>(outData), inVector); }
+	static inline IMA4Vector	IMA4VectorSet(SInt32 inValue)									{ return _mm_set1_epi32(inValue); }
+	static inline IMA4Vector	IMA4VectorAdd(IMA4Vector inA, IMA4Vector inB)					{ return _mm_add_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorSub(IMA4Vector inA, IMA4Vector inB)					{ return _mm_sub_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorAnd(IMA4Vector inA, IMA4Vector inB)					{ return _mm_and_si128(inA, inB); }
+	static inline IMA4Vector	IMA4VectorAndNot(IMA4Vector inA, IMA4Vector inB)				{ return _mm_andnot_si128(inA, inB); }
+	static inline IMA4Vector	IMA4VectorOr(IMA4Vector inA, IMA4Vector inB)					{ return _mm_or_si128(inA, inB); }
+	static inline IMA4Vector	IMA4VectorXor(IMA4Vector inA, IMA4Vector inB)					{ return _mm_xor_si128(inA, inB); }
+	static inline IMA4Vector	IMA4VectorCompareGreater(IMA4Vector inA, IMA4Vector inB)		{ return _mm_cmpgt_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorMin(IMA4Vector inA, IMA4Vector inB)					{ return _mm_min_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorMax(IMA4Vector inA, IMA4Vector inB)					{ return _mm_max_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorAbs(IMA4Vector inA)									{ return _mm_abs_epi32(inA); }
+	#define	IMA4VectorShiftRight(inA, inShift)	_mm_srai_epi32(inA, inShift)
+	static inline IMA4Vector	IMA4VectorLookUp(const SInt32* inTable, IMA4Vector inIndex)
+	{
+		//	no gather before AVX2
+		return _mm_set_epi32(inTable[_mm_extract_epi32(inIndex, 3)], inTable[_mm_extract_epi32(inIndex, 2)], inTable[_mm_extract_epi32(inIndex, 1)], inTable[_mm_extract_epi32(inIndex, 0)]);
+	}
+
+#elif defined(__SSE2__)
+
+	#include <emmintrin.h>
+	
+	#define	kIMA4VectorLanes	4
+	typedef __m128i	IMA4Vector;
+	
+	static inline IMA4Vector	IMA4VectorLoad(const SInt32* inData)							{ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(inData)); }
+	static inline void			IMA4VectorStore(SInt32* outData, IMA4Vector inVector)			{ _mm_storeu_si128(reinterpret_cast<__m128i*>(outData), inVector); }
+	static inline IMA4Vector	IMA4VectorSet(SInt32 inValue)									{ return _mm_set1_epi32(inValue); }
+	static inline IMA4Vector	IMA4VectorAdd(IMA4Vector inA, IMA4Vector inB)					{ return _mm_add_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorSub(IMA4Vector inA, IMA4Vector inB)					{ return _mm_sub_epi32(inA, inB); }
+	static inline IMA4Vector	IMA4VectorAnd(IMA4Vector inA, IMA4Vector inB)					{ return _mm_and_si128(inA, inB); }
+	static inline IMA4Vector	IMA4VectorAndNot(IMA4Vector inA, IMA4Vector inB)				{ return _mm_andnot_si128(inA, inB); }
+	static inline IMA4Vector	IMA4VectorOr(IMA4Vector inA, IMA4Vector inB)					{ return _mm_or_si128(inA, inB); }
+	static inline IMA4Vector	IMA4VectorXor(IMA4Vector inA, IMA4Vector inB)					{ return _mm_xor_si128(inA, inB); }
+	static inline IMA4Vector	IMA4VectorCompareGreater(IMA4Vector inA, IMA4Vector inB)		{ return _mm_cmpgt_epi32(inA, inB); }
+	#define	IMA4VectorShiftRight(inA, inShift)	_mm_srai_epi32(inA, inShift)
+	
+	//	SSE2 has no 32 bit min, max or abs, so build them out of compares and masks
+	static inline IMA4Vector	IMA4VectorMin(IMA4Vector inA, IMA4Vector inB)					{ IMA4Vector theMask = _mm_cmpgt_epi32(inA, inB); return _mm_or_si128(_mm_and_si128(theMask, inB), _mm_andnot_si128(theMask, inA)); }
+	static inline IMA4Vector	IMA4VectorMax(IMA4Vector inA, IMA4Vector inB)					{ IMA4Vector theMask = _mm_cmpgt_epi32(inA, inB); return _mm_or_si128(_mm_and_si128(theMask, inA), _mm_andnot_si128(theMask, inB)); }
+	static inline IMA4Vector	IMA4VectorAbs(IMA4Vector inA)									{ IMA4Vector theSign = _mm_srai_epi32(inA, 31); return _mm_sub_epi32(_mm_xor_si128(inA, theSign), theSign); }
+	static inline IMA4Vector	IMA4VectorLookUp(const SInt32* inTable, IMA4Vector inIndex)
+	{
+		//	no gather and no 32 bit extract, so shuffle each lane down to the bottom
+		return _mm_set_epi32(inTable[_mm_cvtsi128_si32(_mm_shuffle_epi32(inIndex, 3))], inTable[_mm_cvtsi128_si32(_mm_shuffle_epi32(inIndex, 2))], inTable[_mm_cvtsi128_si32(_mm_shuffle_epi32(inIndex, 1))], inTable[_mm_cvtsi128_si32(inIndex)]);
+	}
+
+#endif
+
+#endif
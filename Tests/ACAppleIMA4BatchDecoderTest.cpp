@@ -0,0 +1,170 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACAppleIMA4BatchDecoderTest.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACAppleIMA4BatchDecoder.h"
+#include "CAStreamBasicDescription.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+//=============================================================================
+//	ACAppleIMA4BatchDecoderTest
+//
+//	Decodes a batch of streams with ACAppleIMA4BatchDecoder and each stream on
+//	its own with ACAppleIMA4Decoder, one packet per request, and checks that
+//	every sample matches. Some packets are skipped by passing NULL, and some
+//	headers are zeroed so that both the resync and the keep state paths run.
+//=============================================================================
+
+static bool	IsSkipped(UInt32 inPacket, UInt32 inStream, UInt32 inNumberPackets, UInt32 inNumberStreams)
+{
+	//	a few packets are skipped here and there, and the second half of the
+	//	streams only joins the batch halfway through
+	return (((inPacket + inStream) % 11) == 0) || ((inStream >= inNumberStreams / 2) && (inPacket < inNumberPackets / 2));
+}
+
+static bool	TestBatchDecoder(UInt32 inNumberChannels, UInt32 inNumberStreams, UInt32 inNumberPackets)
+{
+	UInt32 thePacketByteSize = inNumberChannels * ACAppleIMA4Decoder::kIMA4PacketBytes;
+	UInt32 theFramesPerPacket = ACAppleIMA4BatchDecoder::kFramesPerPacket;
+	
+	//	random codes with legal headers
+	std::vector< std::vector<Byte> > theInputData(inNumberStreams);
+	for(UInt32 theStream = 0; theStream < inNumberStreams; ++theStream)
+	{
+		std::vector<Byte>& theStreamData = theInputData[theStream];
+		theStreamData.resize(inNumberPackets * thePacketByteSize);
+		for(UInt32 theByte = 0; theByte < theStreamData.size(); ++theByte)
+		{
+			theStreamData[theByte] = rand();
+		}
+		for(UInt32 theByte = 0; theByte < theStreamData.size(); theByte += ACAppleIMA4Decoder::kIMA4PacketBytes)
+		{
+			theStreamData[theByte + 1] = (theStreamData[theByte + 1] & 0x80) | (rand() % 89);
+			if((rand() % 3) != 0)
+			{
+				theStreamData[theByte] = 0;
+				theStreamData[theByte + 1] = 0;
+			}
+		}
+	}
+	
+	//	the reference, one decoder per stream
+	CAStreamBasicDescription theInputFormat(44100, kAudioFormatAppleIMA4, thePacketByteSize, theFramesPerPacket, 0, inNumberChannels, 0, 0);
+	CAStreamBasicDescription theOutputFormat(44100, kAudioFormatLinearPCM, 2 * inNumberChannels, 1, 2 * inNumberChannels, inNumberChannels, 16, kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked);
+	UInt32 theOutputPacketSize = theFramesPerPacket * inNumberChannels;
+	std::vector< std::vector<SInt16> > theExpectedData(inNumberStreams);
+	for(UInt32 theStream = 0; theStream < inNumberStreams; ++theStream)
+	{
+		ACAppleIMA4Decoder theDecoder;
+		theDecoder.Initialize(&theInputFormat, &theOutputFormat, NULL, 0);
+		theExpectedData[theStream].resize(inNumberPackets * theOutputPacketSize);
+		for(UInt32 thePacket = 0; thePacket < inNumberPackets; ++thePacket)
+		{
+			if(IsSkipped(thePacket, theStream, inNumberPackets, inNumberStreams))
+			{
+				continue;
+			}
+			UInt32 theInputByteSize = thePacketByteSize;
+			UInt32 theNumberPackets = 1;
+			theDecoder.AppendInputData(&theInputData[theStream][thePacket * thePacketByteSize], theInputByteSize, theNumberPackets, NULL);
+			UInt32 theOutputByteSize = theOutputPacketSize * sizeof(SInt16);
+			theDecoder.ProduceOutputPackets(&theExpectedData[theStream][thePacket * theOutputPacketSize], theOutputByteSize, theNumberPackets, NULL);
+		}
+	}
+	
+	//	the batch, which starts out with only the first half of the streams
+	ACAppleIMA4BatchDecoder theBatchDecoder(inNumberStreams / 2, inNumberChannels);
+	std::vector< std::vector<SInt16> > theOutputData(inNumberStreams);
+	for(UInt32 theStream = 0; theStream < inNumberStreams; ++theStream)
+	{
+		theOutputData[theStream].resize(inNumberPackets * theOutputPacketSize);
+	}
+	std::vector<const Byte*> theInputPackets(inNumberStreams);
+	std::vector<SInt16*> theOutputPackets(inNumberStreams);
+	for(UInt32 thePacket = 0; thePacket < inNumberPackets; ++thePacket)
+	{
+		if(thePacket == inNumberPackets / 2)
+		{
+			theBatchDecoder.SetNumberStreams(inNumberStreams);
+		}
+		for(UInt32 theStream = 0; theStream < inNumberStreams; ++theStream)
+		{
+			theInputPackets[theStream] = IsSkipped(thePacket, theStream, inNumberPackets, inNumberStreams) ? NULL : &theInputData[theStream][thePacket * thePacketByteSize];
+			theOutputPackets[theStream] = &theOutputData[theStream][thePacket * theOutputPacketSize];
+		}
+		theBatchDecoder.DecodePackets(&theInputPackets[0], &theOutputPackets[0]);
+	}
+	
+	UInt32 theNumberMismatches = 0;
+	for(UInt32 theStream = 0; theStream < inNumberStreams; ++theStream)
+	{
+		for(UInt32 theSample = 0; theSample < theOutputData[theStream].size(); ++theSample)
+		{
+			if(theOutputData[theStream][theSample] != theExpectedData[theStream][theSample])
+			{
+				++theNumberMismatches;
+			}
+		}
+	}
+	
+	printf("%s: %lu channels, %lu streams, %lu packets\n", (theNumberMismatches == 0) ? "ok" : "FAILED", (unsigned long)inNumberChannels, (unsigned long)inNumberStreams, (unsigned long)inNumberPackets);
+	return theNumberMismatches == 0;
+}
+
+int	main()
+{
+	static const UInt32 kNumberChannels[] = { 1, 2, 3, 6 };
+	
+	bool theAnswer = true;
+	for(UInt32 theIndex = 0; theIndex < sizeof(kNumberChannels) / sizeof(kNumberChannels[0]); ++theIndex)
+	{
+		srand(theIndex);
+		theAnswer = TestBatchDecoder(kNumberChannels[theIndex], 13, 200) && theAnswer;
+	}
+	
+	return theAnswer ? 0 : 1;
+}
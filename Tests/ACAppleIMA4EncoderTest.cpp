@@ -0,0 +1,163 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACAppleIMA4EncoderTest.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACAppleIMA4Encoder.h"
+#include "ACAppleIMA4Vector.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//=============================================================================
+//	ACAppleIMA4EncoderTest
+//
+//	Checks that EncodeChannels, which is vectorized across channels whenever
+//	kIMA4VectorLanes is defined, produces exactly the same packets and channel
+//	state as running the scalar EncodeChannel on every channel.
+//=============================================================================
+
+class ACAppleIMA4EncoderTest
+:
+	public ACAppleIMA4Encoder
+{
+
+public:
+	static bool		Run(UInt32 inNumberChannels, UInt32 inNumberPackets, UInt32 inSeed);
+
+};
+
+static SInt16	MakeSample(UInt32 inFrame, UInt32 inChannel)
+{
+	//	a mix of tones, noise, full scale square waves and pure noise bursts, so
+	//	the step table index visits both ends and the predictor clips
+	double theValue = 20000.0 * sin(inFrame * 0.01 * (inChannel + 1)) + ((rand() % 8000) - 4000);
+	if((inFrame % 5000) < 300)
+	{
+		theValue = (inFrame & 1) ? 40000.0 : -40000.0;
+	}
+	if((inFrame % 7000) < 100)
+	{
+		theValue = (rand() % 65536) - 32768;
+	}
+	if(theValue > 32767.0)
+	{
+		theValue = 32767.0;
+	}
+	else if(theValue < -32768.0)
+	{
+		theValue = -32768.0;
+	}
+	return static_cast<SInt16>(theValue);
+}
+
+bool	ACAppleIMA4EncoderTest::Run(UInt32 inNumberChannels, UInt32 inNumberPackets, UInt32 inSeed)
+{
+	srand(inSeed);
+	
+	UInt32 theNumberFrames = inNumberPackets * kFramesPerPacket;
+	std::vector<SInt16> theInputData(theNumberFrames * inNumberChannels);
+	for(UInt32 theFrame = 0; theFrame < theNumberFrames; ++theFrame)
+	{
+		for(UInt32 theChannel = 0; theChannel < inNumberChannels; ++theChannel)
+		{
+			theInputData[(theFrame * inNumberChannels) + theChannel] = MakeSample(theFrame, theChannel);
+		}
+	}
+	
+	//	start every channel from a different state
+	ChannelStateList theVectorState(inNumberChannels);
+	for(UInt32 theChannel = 0; theChannel < inNumberChannels; ++theChannel)
+	{
+		theVectorState[theChannel].mPredictedSample = (rand() % 65536) - 32768;
+		theVectorState[theChannel].mStepTableIndex = rand() % 89;
+	}
+	ChannelStateList theScalarState(theVectorState);
+	
+	UInt32 theOutputByteSize = inNumberPackets * inNumberChannels * kIMA4PacketBytes;
+	std::vector<Byte> theVectorOutput(theOutputByteSize);
+	std::vector<Byte> theScalarOutput(theOutputByteSize);
+	
+	EncodeChannels(theVectorState, inNumberChannels, inNumberPackets, &theInputData[0], &theVectorOutput[0]);
+	for(UInt32 theChannel = 0; theChannel < inNumberChannels; ++theChannel)
+	{
+		EncodeChannel(theScalarState[theChannel], inNumberChannels, theChannel, inNumberPackets, &theInputData[0], &theScalarOutput[0]);
+	}
+	
+	bool theAnswer = memcmp(&theVectorOutput[0], &theScalarOutput[0], theOutputByteSize) == 0;
+	for(UInt32 theChannel = 0; theChannel < inNumberChannels; ++theChannel)
+	{
+		theAnswer = theAnswer && (theVectorState[theChannel].mPredictedSample == theScalarState[theChannel].mPredictedSample);
+		theAnswer = theAnswer && (theVectorState[theChannel].mStepTableIndex == theScalarState[theChannel].mStepTableIndex);
+	}
+	
+	printf("%s: %lu channels, %lu packets\n", theAnswer ? "ok" : "FAILED", (unsigned long)inNumberChannels, (unsigned long)inNumberPackets);
+	return theAnswer;
+}
+
+int	main()
+{
+#if defined(kIMA4VectorLanes)
+	printf("vector lanes: %d\n", kIMA4VectorLanes);
+#else
+	printf("vector lanes: none, EncodeChannels is scalar\n");
+#endif
+	
+	//	every lane count, plus channel counts that leave a partial last vector
+	static const UInt32 kNumberChannels[] = { 1, 2, 3, 4, 5, 7, 8, 9, 13, 16 };
+	static const UInt32 kNumberPackets[] = { 1, 2, 33, 500 };
+	
+	bool theAnswer = true;
+	for(UInt32 theChannelIndex = 0; theChannelIndex < sizeof(kNumberChannels) / sizeof(kNumberChannels[0]); ++theChannelIndex)
+	{
+		for(UInt32 thePacketIndex = 0; thePacketIndex < sizeof(kNumberPackets) / sizeof(kNumberPackets[0]); ++thePacketIndex)
+		{
+			theAnswer = ACAppleIMA4EncoderTest::Run(kNumberChannels[theChannelIndex], kNumberPackets[thePacketIndex], (theChannelIndex * 16) + thePacketIndex) && theAnswer;
+		}
+	}
+	
+	return theAnswer ? 0 : 1;
+}
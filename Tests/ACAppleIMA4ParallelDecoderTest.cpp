@@ -0,0 +1,186 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACAppleIMA4ParallelDecoderTest.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACAppleIMA4Decoder.h"
+#include "CAStreamBasicDescription.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+//=============================================================================
+//	ACAppleIMA4ParallelDecoderTest
+//
+//	Decodes the same packets with kAppleIMA4DecoderPropertyDecodeThreadCount
+//	set to 1, 2 and 4 and checks that every output byte matches. The serial
+//	decoder resyncs with the packet headers at the start of every request, so
+//	each run makes the same requests, some too small for the parallel path and
+//	some big enough to be split across the threads.
+//=============================================================================
+
+enum
+{
+	kNumberPackets = 6000,
+	kParallelRequestPackets = 4 * 256	//	the smallest request split across 4 threads
+};
+
+static bool	DecodeStream(const std::vector<Byte>& inInputData, UInt32 inNumberChannels, bool inFloat, UInt32 inThreadCount, UInt32 inRequestPackets, std::vector<Byte>& outOutputData)
+{
+	UInt32 thePacketByteSize = inNumberChannels * ACAppleIMA4Decoder::kIMA4PacketBytes;
+	UInt32 theSampleByteSize = inFloat ? sizeof(float) : sizeof(SInt16);
+	UInt32 theOutputPacketByteSize = ACAppleIMA4Decoder::kFramesPerPacket * inNumberChannels * theSampleByteSize;
+	CAStreamBasicDescription theInputFormat(44100, kAudioFormatAppleIMA4, thePacketByteSize, ACAppleIMA4Decoder::kFramesPerPacket, 0, inNumberChannels, 0, 0);
+	CAStreamBasicDescription theOutputFormat(44100, kAudioFormatLinearPCM, theSampleByteSize * inNumberChannels, 1, theSampleByteSize * inNumberChannels, inNumberChannels, 8 * theSampleByteSize, inFloat ? kAudioFormatFlagsNativeFloatPacked : (kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked));
+	
+	ACAppleIMA4Decoder theDecoder;
+	theDecoder.SetProperty(kAppleIMA4DecoderPropertyDecodeThreadCount, sizeof(UInt32), &inThreadCount);
+	UInt32 theInputBufferByteSize = inRequestPackets * thePacketByteSize;
+	theDecoder.SetProperty(kAudioCodecPropertyInputBufferSize, sizeof(UInt32), &theInputBufferByteSize);
+	theDecoder.Initialize(&theInputFormat, &theOutputFormat, NULL, 0);
+	
+	UInt32 theNumberPackets = inInputData.size() / thePacketByteSize;
+	outOutputData.resize(theNumberPackets * theOutputPacketByteSize);
+	for(UInt32 thePacket = 0; thePacket < theNumberPackets; )
+	{
+		UInt32 theRequestPackets = theNumberPackets - thePacket;
+		if(theRequestPackets > inRequestPackets)
+		{
+			theRequestPackets = inRequestPackets;
+		}
+		
+		UInt32 theInputByteSize = theRequestPackets * thePacketByteSize;
+		UInt32 theNumberInputPackets = theRequestPackets;
+		theDecoder.AppendInputData(&inInputData[thePacket * thePacketByteSize], theInputByteSize, theNumberInputPackets, NULL);
+		
+		UInt32 theOutputByteSize = theRequestPackets * theOutputPacketByteSize;
+		UInt32 theNumberOutputPackets = theRequestPackets;
+		theDecoder.ProduceOutputPackets(&outOutputData[thePacket * theOutputPacketByteSize], theOutputByteSize, theNumberOutputPackets, NULL);
+		if((theNumberInputPackets != theRequestPackets) || (theNumberOutputPackets != theRequestPackets))
+		{
+			printf("FAILED: asked for %lu packets, appended %lu and decoded %lu\n", (unsigned long)theRequestPackets, (unsigned long)theNumberInputPackets, (unsigned long)theNumberOutputPackets);
+			return false;
+		}
+		thePacket += theRequestPackets;
+	}
+	return true;
+}
+
+static bool	TestParallelDecoder(UInt32 inNumberChannels, bool inFloat)
+{
+	static const UInt32 kThreadCounts[] = { 2, 4 };
+	static const UInt32 kRequestPackets[] = { 1, 100, kParallelRequestPackets - 1, kParallelRequestPackets, 2500 };
+	UInt32 thePacketByteSize = inNumberChannels * ACAppleIMA4Decoder::kIMA4PacketBytes;
+	
+	//	random codes with legal headers, some of them zeroed so that the serial
+	//	decoder's resync at the start of a request keeps its own state
+	std::vector<Byte> theInputData(kNumberPackets * thePacketByteSize);
+	for(UInt32 theByte = 0; theByte < theInputData.size(); ++theByte)
+	{
+		theInputData[theByte] = rand();
+	}
+	for(UInt32 theByte = 0; theByte < theInputData.size(); theByte += ACAppleIMA4Decoder::kIMA4PacketBytes)
+	{
+		theInputData[theByte + 1] = (theInputData[theByte + 1] & 0x80) | (rand() % 89);
+		if((rand() % 3) != 0)
+		{
+			theInputData[theByte] = 0;
+			theInputData[theByte + 1] = 0;
+		}
+	}
+	
+	bool theAnswer = true;
+	for(UInt32 theRequestIndex = 0; theRequestIndex < sizeof(kRequestPackets) / sizeof(kRequestPackets[0]); ++theRequestIndex)
+	{
+		std::vector<Byte> theExpectedData;
+		if(!DecodeStream(theInputData, inNumberChannels, inFloat, 1, kRequestPackets[theRequestIndex], theExpectedData))
+		{
+			return false;
+		}
+		
+		for(UInt32 theThreadIndex = 0; theThreadIndex < sizeof(kThreadCounts) / sizeof(kThreadCounts[0]); ++theThreadIndex)
+		{
+			std::vector<Byte> theOutputData;
+			bool theMatch = DecodeStream(theInputData, inNumberChannels, inFloat, kThreadCounts[theThreadIndex], kRequestPackets[theRequestIndex], theOutputData) && (theOutputData == theExpectedData);
+			printf("%s: %lu channels, %s, %lu threads, %lu packets per request\n", theMatch ? "ok" : "FAILED", (unsigned long)inNumberChannels, inFloat ? "float" : "16 bit", (unsigned long)kThreadCounts[theThreadIndex], (unsigned long)kRequestPackets[theRequestIndex]);
+			theAnswer = theMatch && theAnswer;
+		}
+	}
+	return theAnswer;
+}
+
+static bool	TestThreadCountLimit()
+{
+	//	a silly thread count is clamped rather than sizing the input buffer from it
+	CAStreamBasicDescription theInputFormat(44100, kAudioFormatAppleIMA4, 2 * ACAppleIMA4Decoder::kIMA4PacketBytes, ACAppleIMA4Decoder::kFramesPerPacket, 0, 2, 0, 0);
+	CAStreamBasicDescription theOutputFormat(44100, kAudioFormatLinearPCM, 4, 1, 4, 2, 16, kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked);
+	ACAppleIMA4Decoder theDecoder;
+	UInt32 theThreadCount = 0xFFFFFFFF;
+	theDecoder.SetProperty(kAppleIMA4DecoderPropertyDecodeThreadCount, sizeof(UInt32), &theThreadCount);
+	theDecoder.Initialize(&theInputFormat, &theOutputFormat, NULL, 0);
+	
+	UInt32 thePropertySize = sizeof(UInt32);
+	theDecoder.GetProperty(kAppleIMA4DecoderPropertyDecodeThreadCount, thePropertySize, &theThreadCount);
+	UInt32 theInputBufferByteSize = 0;
+	theDecoder.GetProperty(kAudioCodecPropertyInputBufferSize, thePropertySize, &theInputBufferByteSize);
+	UInt32 theParallelByteSize = 32 * 256 * theInputFormat.mBytesPerPacket;
+	bool theAnswer = (theThreadCount == 32) && (theInputBufferByteSize >= theParallelByteSize) && (theInputBufferByteSize < 2 * theParallelByteSize);
+	printf("%s: thread count clamped to %lu, %lu byte input buffer\n", theAnswer ? "ok" : "FAILED", (unsigned long)theThreadCount, (unsigned long)theInputBufferByteSize);
+	return theAnswer;
+}
+
+int	main()
+{
+	static const UInt32 kNumberChannels[] = { 1, 2, 6 };
+	
+	bool theAnswer = TestThreadCountLimit();
+	for(UInt32 theIndex = 0; theIndex < sizeof(kNumberChannels) / sizeof(kNumberChannels[0]); ++theIndex)
+	{
+		srand(theIndex);
+		theAnswer = TestParallelDecoder(kNumberChannels[theIndex], false) && theAnswer;
+		theAnswer = TestParallelDecoder(kNumberChannels[theIndex], true) && theAnswer;
+	}
+	
+	return theAnswer ? 0 : 1;
+}
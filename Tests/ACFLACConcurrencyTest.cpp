@@ -0,0 +1,615 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACFLACConcurrencyTest.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACFLACEncoder.h"
+#include "ACFLACDecoder.h"
+#include <pthread.h>
+#include <sched.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//=============================================================================
+//	ACFLACConcurrencyTest
+//
+//	Runs a batch of FLAC encoders and decoders at the same time, one job per
+//	thread, each on its own input, and checks that every job produces exactly
+//	the same packets, packet descriptions, magic cookie and decoded PCM as the
+//	same job run on its own. Any codec state still shared between instances
+//	shows up as a mismatch. The jobs yield after every ProduceOutputPackets
+//	call, so they take turns even on a single core.
+//
+//	The decoders run once more with kFLACDecoderPropertyDecodeThreadCount
+//	above 1, and their PCM has to match the serial decoders' byte for byte.
+//	Streams with damaged packets are decoded both ways too, trusted and not,
+//	and the PCM, the failures returned and the desync count have to match,
+//	so a dropped packet's gap has to be closed up the same as serially.
+//
+//	Streams are encoded with kFLACEncoderPropertyEncodeThreadCount above 1 as
+//	well, a few packets or a lot of them a call. At the default compression
+//	level the packets have to match the serial encoder's byte for byte, frame
+//	numbers and all, and so does the magic cookie, which is the STREAMINFO the
+//	encoder put together from the frame sizes and the MD5.
+//
+//	With kFLACEncoderPropertyAdaptiveCPUBudget set, a budget that's never used
+//	up has to leave one thread's packets and cookie as they are without one.
+//	A budget that's always blown takes the level all the way down. The frames
+//	still have to be numbered 0 on up, decode to the input and carry the same
+//	MD5 and sample count as the serial encode, on one thread and on several.
+//=============================================================================
+
+enum
+{
+	kFramesPerPacket	= 4608,
+	kPacketsPerCall		= 2,
+	kPacketsPerDecode	= 8		//	enough for every decode thread to get a range
+};
+
+//	holds every thread until they have all been started, so the jobs really overlap
+struct ACFLACConcurrencyGate
+{
+	pthread_mutex_t						mMutex;
+	pthread_cond_t						mCondition;
+	UInt32								mNumberWaiting;
+	UInt32								mNumberThreads;
+};
+
+struct ACFLACConcurrencyJob
+{
+	UInt32								mNumberChannels;
+	UInt32								mBitDepth;
+	UInt32								mNumberFrames;
+	UInt32								mSeed;
+	UInt32								mEncodeThreadCount;
+	UInt32								mPacketsPerCall;	//	encoded, and appended at a time
+	UInt32								mQuality;
+	Float64								mAdaptiveCPUBudget;
+	UInt32								mDecodeThreadCount;
+	bool								mTrustedSource;
+	bool								mDamagePackets;
+	
+	std::vector<Byte>					mInput;
+	std::vector<Byte>					mPackets;
+	std::vector<AudioStreamPacketDescription>	mPacketDescriptions;
+	std::vector<Byte>					mMagicCookie;
+	UInt32								mNumberLevelChanges;
+	std::vector<Byte>					mOutput;
+	UInt32								mNumberFailures;
+	UInt32								mDesyncCount;
+	bool								mSucceeded;
+	ACFLACConcurrencyGate*				mGate;
+};
+
+static void	SetUpJob(ACFLACConcurrencyJob& ioJob, UInt32 inNumberChannels, UInt32 inBitDepth, UInt32 inNumberFrames, UInt32 inSeed)
+{
+	ioJob.mNumberChannels = inNumberChannels;
+	ioJob.mBitDepth = inBitDepth;
+	ioJob.mNumberFrames = inNumberFrames;
+	ioJob.mSeed = inSeed;
+	ioJob.mEncodeThreadCount = 1;
+	ioJob.mPacketsPerCall = kPacketsPerCall;
+	ioJob.mQuality = 0;
+	ioJob.mAdaptiveCPUBudget = 0.0;
+	ioJob.mDecodeThreadCount = 1;
+	ioJob.mTrustedSource = false;
+	ioJob.mDamagePackets = false;
+	ioJob.mGate = NULL;
+}
+
+static AudioStreamBasicDescription	MakePCMFormat(UInt32 inNumberChannels, UInt32 inBitDepth)
+{
+	AudioStreamBasicDescription theFormat;
+	memset(&theFormat, 0, sizeof(theFormat));
+	theFormat.mSampleRate = 44100.0;
+	theFormat.mFormatID = kAudioFormatLinearPCM;
+	theFormat.mFormatFlags = kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+	theFormat.mBytesPerFrame = inNumberChannels * (inBitDepth / 8);
+	theFormat.mBytesPerPacket = theFormat.mBytesPerFrame;
+	theFormat.mFramesPerPacket = 1;
+	theFormat.mChannelsPerFrame = inNumberChannels;
+	theFormat.mBitsPerChannel = inBitDepth;
+	return theFormat;
+}
+
+static AudioStreamBasicDescription	MakeFLACFormat(UInt32 inNumberChannels, UInt32 inBitDepth)
+{
+	AudioStreamBasicDescription theFormat;
+	memset(&theFormat, 0, sizeof(theFormat));
+	theFormat.mSampleRate = 44100.0;
+	theFormat.mFormatID = kAudioFormatFLAC;
+	theFormat.mFormatFlags = (inBitDepth == 16) ? kFLACFormatFlag_16BitSourceData : kFLACFormatFlag_24BitSourceData;
+	theFormat.mFramesPerPacket = kFramesPerPacket;
+	theFormat.mChannelsPerFrame = inNumberChannels;
+	return theFormat;
+}
+
+static void	MakeInput(ACFLACConcurrencyJob& ioJob)
+{
+	//	a per-job linear congruential generator, rand() isn't ours to call from several threads.
+	//	A slow ramp with some noise on it, so the predictors have something to find.
+	UInt32 theState = ioJob.mSeed;
+	UInt32 theBytesPerSample = ioJob.mBitDepth / 8;
+	UInt32 theNumberSamples = ioJob.mNumberFrames * ioJob.mNumberChannels;
+	ioJob.mInput.resize(theNumberSamples * theBytesPerSample);
+	for(UInt32 theSample = 0; theSample < theNumberSamples; ++theSample)
+	{
+		theState = (theState * 1664525) + 1013904223;
+		SInt32 theValue = (SInt32)((theSample / ioJob.mNumberChannels) * (theSample % ioJob.mNumberChannels + 1) * 37) + (SInt32)(theState >> 24) - 128;
+		theValue = (theValue << (32 - ioJob.mBitDepth)) >> (32 - ioJob.mBitDepth);
+		for(UInt32 theByte = 0; theByte < theBytesPerSample; ++theByte)
+		{
+		#if TARGET_RT_BIG_ENDIAN
+			ioJob.mInput[(theSample * theBytesPerSample) + theByte] = (Byte)(theValue >> (8 * (theBytesPerSample - 1 - theByte)));
+		#else
+			ioJob.mInput[(theSample * theBytesPerSample) + theByte] = (Byte)(theValue >> (8 * theByte));
+		#endif
+		}
+	}
+}
+
+static void	Encode(ACFLACConcurrencyJob& ioJob)
+{
+	ACFLACEncoder theEncoder(kAudioFormatFLAC);
+	AudioStreamBasicDescription theInputFormat = MakePCMFormat(ioJob.mNumberChannels, ioJob.mBitDepth);
+	AudioStreamBasicDescription theOutputFormat = MakeFLACFormat(ioJob.mNumberChannels, ioJob.mBitDepth);
+	theEncoder.SetProperty(kFLACEncoderPropertyEncodeThreadCount, sizeof(ioJob.mEncodeThreadCount), &ioJob.mEncodeThreadCount);
+	theEncoder.SetProperty(kAudioCodecPropertyQualitySetting, sizeof(ioJob.mQuality), &ioJob.mQuality);
+	theEncoder.SetProperty(kFLACEncoderPropertyAdaptiveCPUBudget, sizeof(ioJob.mAdaptiveCPUBudget), &ioJob.mAdaptiveCPUBudget);
+	theEncoder.Initialize(&theInputFormat, &theOutputFormat, NULL, 0);
+	
+	UInt32 theMaximumPacketByteSize = 0;
+	UInt32 thePropertySize = sizeof(theMaximumPacketByteSize);
+	theEncoder.GetProperty(kAudioCodecPropertyMaximumPacketByteSize, thePropertySize, &theMaximumPacketByteSize);
+	std::vector<Byte> theOutputBuffer(theMaximumPacketByteSize * ioJob.mPacketsPerCall);
+	std::vector<AudioStreamPacketDescription> theOutputDescriptions(ioJob.mPacketsPerCall);
+	
+	UInt32 theInputPosition = 0;
+	bool theInputIsFlushed = false;
+	UInt32 theStatus = kAudioCodecProduceOutputPacketSuccess;
+	while(theStatus != kAudioCodecProduceOutputPacketAtEOF)
+	{
+		if(theInputPosition < ioJob.mInput.size())
+		{
+			//	a packet at a time by default, so the encoders interleave as much as possible
+			UInt32 theByteSize = ioJob.mInput.size() - theInputPosition;
+			if(theByteSize > ioJob.mPacketsPerCall * kFramesPerPacket * theInputFormat.mBytesPerFrame)
+			{
+				theByteSize = ioJob.mPacketsPerCall * kFramesPerPacket * theInputFormat.mBytesPerFrame;
+			}
+			UInt32 theNumberPackets = theByteSize / theInputFormat.mBytesPerFrame;
+			theEncoder.AppendInputData(&ioJob.mInput[theInputPosition], theByteSize, theNumberPackets, NULL);
+			theInputPosition += theByteSize;
+		}
+		else if(!theInputIsFlushed)
+		{
+			UInt32 theByteSize = 0;
+			UInt32 theNumberPackets = 0;
+			theEncoder.AppendInputData(&ioJob.mInput[0], theByteSize, theNumberPackets, NULL);
+			theInputIsFlushed = true;
+		}
+		
+		UInt32 theByteSize = theOutputBuffer.size();
+		UInt32 theNumberPackets = ioJob.mPacketsPerCall;
+		theStatus = theEncoder.ProduceOutputPackets(&theOutputBuffer[0], theByteSize, theNumberPackets, &theOutputDescriptions[0]);
+		sched_yield();
+		if(theStatus == kAudioCodecProduceOutputPacketFailure)
+		{
+			ioJob.mSucceeded = false;
+			return;
+		}
+		for(UInt32 thePacket = 0; thePacket < theNumberPackets; ++thePacket)
+		{
+			AudioStreamPacketDescription theDescription = theOutputDescriptions[thePacket];
+			const Byte* thePacketData = &theOutputBuffer[theDescription.mStartOffset];
+			theDescription.mStartOffset = ioJob.mPackets.size();
+			ioJob.mPackets.insert(ioJob.mPackets.end(), thePacketData, thePacketData + theDescription.mDataByteSize);
+			ioJob.mPacketDescriptions.push_back(theDescription);
+		}
+	}
+	
+	UInt32 theCookieByteSize = theEncoder.GetMagicCookieByteSize();
+	ioJob.mMagicCookie.resize(theCookieByteSize);
+	theEncoder.GetMagicCookie(&ioJob.mMagicCookie[0], theCookieByteSize);
+	
+	//	the history starts with the level the stream started at
+	Boolean theWritable = false;
+	theEncoder.GetPropertyInfo(kFLACEncoderPropertyCompressionLevelHistory, thePropertySize, theWritable);
+	ioJob.mNumberLevelChanges = (thePropertySize / sizeof(FLACCompressionLevelChange)) - 1;
+}
+
+static void	DamagePackets(ACFLACConcurrencyJob& ioJob)
+{
+	//	every seventh packet, alternately with its sync code wiped out, so nothing in
+	//	it decodes, and with a byte in the middle flipped, which the CRCs catch
+	for(UInt32 thePacket = 3; thePacket < ioJob.mPacketDescriptions.size(); thePacket += 7)
+	{
+		const AudioStreamPacketDescription& theDescription = ioJob.mPacketDescriptions[thePacket];
+		Byte* thePacketData = &ioJob.mPackets[theDescription.mStartOffset];
+		if((thePacket / 7) % 2 == 0)
+		{
+			thePacketData[0] = 0;
+			thePacketData[1] = 0;
+		}
+		else
+		{
+			thePacketData[theDescription.mDataByteSize / 2] ^= 0x5A;
+		}
+	}
+}
+
+static void	Decode(ACFLACConcurrencyJob& ioJob)
+{
+	ACFLACDecoder theDecoder(kAudioFormatFLAC);
+	AudioStreamBasicDescription theInputFormat = MakeFLACFormat(ioJob.mNumberChannels, ioJob.mBitDepth);
+	AudioStreamBasicDescription theOutputFormat = MakePCMFormat(ioJob.mNumberChannels, ioJob.mBitDepth);
+	UInt32 theTrustedSource = ioJob.mTrustedSource ? 1 : 0;
+	theDecoder.SetProperty(kFLACDecoderPropertyDecodeThreadCount, sizeof(ioJob.mDecodeThreadCount), &ioJob.mDecodeThreadCount);
+	theDecoder.SetProperty(kFLACDecoderPropertyTrustedSource, sizeof(theTrustedSource), &theTrustedSource);
+	theDecoder.Initialize(&theInputFormat, &theOutputFormat, &ioJob.mMagicCookie[0], ioJob.mMagicCookie.size());
+	
+	std::vector<Byte> theOutputBuffer(kFramesPerPacket * theOutputFormat.mBytesPerFrame * kPacketsPerDecode);
+	UInt32 theNextPacket = 0;
+	ioJob.mNumberFailures = 0;
+	while(true)
+	{
+		if(theNextPacket < ioJob.mPacketDescriptions.size())
+		{
+			UInt32 theNumberPackets = ioJob.mPacketDescriptions.size() - theNextPacket;
+			if(theNumberPackets > kPacketsPerDecode)
+			{
+				theNumberPackets = kPacketsPerDecode;
+			}
+			const AudioStreamPacketDescription* theDescriptions = &ioJob.mPacketDescriptions[theNextPacket];
+			UInt32 theFirstByte = theDescriptions[0].mStartOffset;
+			UInt32 theByteSize = theDescriptions[theNumberPackets - 1].mStartOffset + theDescriptions[theNumberPackets - 1].mDataByteSize - theFirstByte;
+			
+			//	the descriptions are relative to the data we hand over
+			std::vector<AudioStreamPacketDescription> theRelativeDescriptions(theDescriptions, theDescriptions + theNumberPackets);
+			for(UInt32 thePacket = 0; thePacket < theNumberPackets; ++thePacket)
+			{
+				theRelativeDescriptions[thePacket].mStartOffset -= theFirstByte;
+			}
+			theDecoder.AppendInputData(&ioJob.mPackets[theFirstByte], theByteSize, theNumberPackets, &theRelativeDescriptions[0]);
+			theNextPacket += theNumberPackets;
+		}
+		
+		UInt32 theByteSize = theOutputBuffer.size();
+		UInt32 theNumberFrames = kFramesPerPacket * kPacketsPerDecode;
+		UInt32 theStatus = theDecoder.ProduceOutputPackets(&theOutputBuffer[0], theByteSize, theNumberFrames, NULL);
+		sched_yield();
+		if(theStatus == kAudioCodecProduceOutputPacketFailure)
+		{
+			//	a damaged packet is used up by the failure, so the decode carries on after it
+			++ioJob.mNumberFailures;
+			if(!ioJob.mDamagePackets)
+			{
+				ioJob.mSucceeded = false;
+				return;
+			}
+			continue;
+		}
+		ioJob.mOutput.insert(ioJob.mOutput.end(), theOutputBuffer.begin(), theOutputBuffer.begin() + theByteSize);
+		if((theNextPacket >= ioJob.mPacketDescriptions.size()) && (theStatus == kAudioCodecProduceOutputPacketNeedsMoreInputData))
+		{
+			break;
+		}
+	}
+	
+	UInt32 thePropertySize = sizeof(ioJob.mDesyncCount);
+	theDecoder.GetProperty(kFLACDecoderPropertyDesyncCount, thePropertySize, &ioJob.mDesyncCount);
+}
+
+static void*	RunJob(void* inJob)
+{
+	ACFLACConcurrencyJob& theJob = *static_cast<ACFLACConcurrencyJob*>(inJob);
+	theJob.mSucceeded = true;
+	MakeInput(theJob);
+	
+	ACFLACConcurrencyGate* theGate = theJob.mGate;
+	if(theGate != NULL)
+	{
+		pthread_mutex_lock(&theGate->mMutex);
+		if(++theGate->mNumberWaiting == theGate->mNumberThreads)
+		{
+			pthread_cond_broadcast(&theGate->mCondition);
+		}
+		while(theGate->mNumberWaiting < theGate->mNumberThreads)
+		{
+			pthread_cond_wait(&theGate->mCondition, &theGate->mMutex);
+		}
+		pthread_mutex_unlock(&theGate->mMutex);
+	}
+	
+	try
+	{
+		Encode(theJob);
+		if(theJob.mSucceeded)
+		{
+			if(theJob.mDamagePackets)
+			{
+				DamagePackets(theJob);
+			}
+			Decode(theJob);
+		}
+	}
+	catch(...)
+	{
+		theJob.mSucceeded = false;
+	}
+	return NULL;
+}
+
+//	the frame number after a packet's 4 fixed header bytes, UTF-8 style
+static UInt32	FrameNumber(const ACFLACConcurrencyJob& inJob, UInt32 inPacket)
+{
+	const Byte* theHeader = &inJob.mPackets[inJob.mPacketDescriptions[inPacket].mStartOffset];
+	if((theHeader[4] & 0x80) == 0)
+	{
+		return theHeader[4];
+	}
+	UInt32 theByteSize = 0;
+	while((theByteSize < 7) && (theHeader[4] & (0x80 >> theByteSize)))
+	{
+		++theByteSize;
+	}
+	UInt32 theFrameNumber = theHeader[4] & (0x7F >> theByteSize);
+	for(UInt32 theByte = 1; theByte < theByteSize; ++theByte)
+	{
+		theFrameNumber = (theFrameNumber << 6) | (theHeader[4 + theByte] & 0x3F);
+	}
+	return theFrameNumber;
+}
+
+//	the STREAMINFO in a magic cookie comes after the 'frma' atom and the 'flac' atom's header
+static const FLAC__StreamMetadata_StreamInfo&	StreamInfo(const ACFLACConcurrencyJob& inJob)
+{
+	return *reinterpret_cast<const FLAC__StreamMetadata_StreamInfo*>(&inJob.mMagicCookie[24]);
+}
+
+static bool	SameDescriptions(const ACFLACConcurrencyJob& inJob, const ACFLACConcurrencyJob& inReference)
+{
+	if(inJob.mPacketDescriptions.size() != inReference.mPacketDescriptions.size())
+	{
+		return false;
+	}
+	for(UInt32 thePacket = 0; thePacket < inJob.mPacketDescriptions.size(); ++thePacket)
+	{
+		const AudioStreamPacketDescription& theDescription = inJob.mPacketDescriptions[thePacket];
+		const AudioStreamPacketDescription& theReference = inReference.mPacketDescriptions[thePacket];
+		if((theDescription.mStartOffset != theReference.mStartOffset) || (theDescription.mDataByteSize != theReference.mDataByteSize) || (theDescription.mVariableFramesInPacket != theReference.mVariableFramesInPacket))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool	Run(UInt32 inNumberThreads, UInt32 inDecodeThreadCount)
+{
+	//	mix channel counts, bit depths and lengths, including a short last packet, so
+	//	neighbouring jobs never happen to have the same stream info
+	static const UInt32 kNumberChannels[] = { 1, 2, 6 };
+	static const UInt32 kBitDepths[] = { 16, 24 };
+	
+	std::vector<ACFLACConcurrencyJob> theSerialJobs(inNumberThreads);
+	for(UInt32 theJob = 0; theJob < inNumberThreads; ++theJob)
+	{
+		SetUpJob(theSerialJobs[theJob], kNumberChannels[theJob % 3], kBitDepths[(theJob / 3) % 2], (kFramesPerPacket * (20 + theJob)) + (theJob * 131), theJob + 1);
+	}
+	std::vector<ACFLACConcurrencyJob> theThreadedJobs(theSerialJobs);
+	for(UInt32 theJob = 0; theJob < inNumberThreads; ++theJob)
+	{
+		theThreadedJobs[theJob].mDecodeThreadCount = inDecodeThreadCount;
+	}
+
+	for(UInt32 theJob = 0; theJob < inNumberThreads; ++theJob)
+	{
+		RunJob(&theSerialJobs[theJob]);
+	}
+	
+	ACFLACConcurrencyGate theGate;
+	pthread_mutex_init(&theGate.mMutex, NULL);
+	pthread_cond_init(&theGate.mCondition, NULL);
+	theGate.mNumberWaiting = 0;
+	theGate.mNumberThreads = inNumberThreads;
+	for(UInt32 theJob = 0; theJob < inNumberThreads; ++theJob)
+	{
+		theThreadedJobs[theJob].mGate = &theGate;
+	}
+	
+	std::vector<pthread_t> theThreads(inNumberThreads);
+	for(UInt32 theJob = 0; theJob < inNumberThreads; ++theJob)
+	{
+		if(pthread_create(&theThreads[theJob], NULL, RunJob, &theThreadedJobs[theJob]) != 0)
+		{
+			//	the threads already started are waiting at the gate for this one
+			printf("FAILED: couldn't start thread %lu\n", (unsigned long)theJob);
+			exit(1);
+		}
+	}
+	for(UInt32 theJob = 0; theJob < inNumberThreads; ++theJob)
+	{
+		pthread_join(theThreads[theJob], NULL);
+	}
+	pthread_cond_destroy(&theGate.mCondition);
+	pthread_mutex_destroy(&theGate.mMutex);
+	
+	bool theAnswer = true;
+	for(UInt32 theJob = 0; theJob < inNumberThreads; ++theJob)
+	{
+		const ACFLACConcurrencyJob& theSerialJob = theSerialJobs[theJob];
+		const ACFLACConcurrencyJob& theThreadedJob = theThreadedJobs[theJob];
+		bool theJobAnswer = theSerialJob.mSucceeded && theThreadedJob.mSucceeded;
+		theJobAnswer = theJobAnswer && (theSerialJob.mOutput == theSerialJob.mInput);
+		theJobAnswer = theJobAnswer && (theThreadedJob.mPackets == theSerialJob.mPackets);
+		theJobAnswer = theJobAnswer && SameDescriptions(theThreadedJob, theSerialJob);
+		theJobAnswer = theJobAnswer && (theThreadedJob.mMagicCookie == theSerialJob.mMagicCookie);
+		theJobAnswer = theJobAnswer && (theThreadedJob.mOutput == theSerialJob.mOutput);
+		if(!theJobAnswer)
+		{
+			printf("FAILED: job %lu of %lu (%lu channels, %lu bits)\n", (unsigned long)theJob, (unsigned long)inNumberThreads, (unsigned long)theSerialJob.mNumberChannels, (unsigned long)theSerialJob.mBitDepth);
+		}
+		theAnswer = theAnswer && theJobAnswer;
+	}
+	
+	printf("%s: %lu encoders and decoders on %lu threads, %lu decode threads each\n", theAnswer ? "ok" : "FAILED", (unsigned long)inNumberThreads, (unsigned long)inNumberThreads, (unsigned long)inDecodeThreadCount);
+	return theAnswer;
+}
+
+static bool	RunDamaged(UInt32 inDecodeThreadCount, bool inTrustedSource)
+{
+	ACFLACConcurrencyJob theSerialJob;
+	SetUpJob(theSerialJob, 2, 16, (kFramesPerPacket * 40) + 1000, 7);
+	theSerialJob.mTrustedSource = inTrustedSource;
+	theSerialJob.mDamagePackets = true;
+	ACFLACConcurrencyJob theParallelJob(theSerialJob);
+	theParallelJob.mDecodeThreadCount = inDecodeThreadCount;
+	RunJob(&theSerialJob);
+	RunJob(&theParallelJob);
+	
+	//	the packets ahead of the first damaged one decode as they were
+	UInt32 theIntactByteSize = 3 * kFramesPerPacket * theSerialJob.mNumberChannels * (theSerialJob.mBitDepth / 8);
+	bool theAnswer = theSerialJob.mSucceeded && theParallelJob.mSucceeded;
+	theAnswer = theAnswer && (theSerialJob.mOutput.size() >= theIntactByteSize) && (memcmp(&theSerialJob.mOutput[0], &theSerialJob.mInput[0], theIntactByteSize) == 0);
+	theAnswer = theAnswer && (theSerialJob.mDesyncCount > 0);
+	theAnswer = theAnswer && (theParallelJob.mOutput == theSerialJob.mOutput);
+	theAnswer = theAnswer && (theParallelJob.mNumberFailures == theSerialJob.mNumberFailures);
+	theAnswer = theAnswer && (theParallelJob.mDesyncCount == theSerialJob.mDesyncCount);
+	
+	printf("%s: damaged packets from %s source on %lu decode threads, %lu failures, %lu desyncs\n", theAnswer ? "ok" : "FAILED", inTrustedSource ? "a trusted" : "an untrusted", (unsigned long)inDecodeThreadCount, (unsigned long)theParallelJob.mNumberFailures, (unsigned long)theParallelJob.mDesyncCount);
+	return theAnswer;
+}
+
+static bool	RunParallelEncode(UInt32 inEncodeThreadCount, UInt32 inPacketsPerCall)
+{
+	//	a short last packet, and more packets than fit in the encoder's input buffer at once
+	ACFLACConcurrencyJob theSerialJob;
+	SetUpJob(theSerialJob, 2, 24, (kFramesPerPacket * 45) + 777, 11);
+	ACFLACConcurrencyJob theParallelJob(theSerialJob);
+	theParallelJob.mEncodeThreadCount = inEncodeThreadCount;
+	theParallelJob.mPacketsPerCall = inPacketsPerCall;
+	RunJob(&theSerialJob);
+	RunJob(&theParallelJob);
+	
+	bool theAnswer = theSerialJob.mSucceeded && theParallelJob.mSucceeded;
+	theAnswer = theAnswer && (theParallelJob.mOutput == theParallelJob.mInput);
+	theAnswer = theAnswer && (theParallelJob.mPackets == theSerialJob.mPackets);
+	theAnswer = theAnswer && SameDescriptions(theParallelJob, theSerialJob);
+	theAnswer = theAnswer && (theParallelJob.mMagicCookie == theSerialJob.mMagicCookie);
+	
+	printf("%s: encoding on %lu threads, %lu packets a call\n", theAnswer ? "ok" : "FAILED", (unsigned long)inEncodeThreadCount, (unsigned long)inPacketsPerCall);
+	return theAnswer;
+}
+
+static bool	RunAdaptiveEncode(UInt32 inEncodeThreadCount, Float64 inAdaptiveCPUBudget)
+{
+	//	level 4 uses loose mid-side, which only the single encoder does
+	ACFLACConcurrencyJob theSerialJob;
+	SetUpJob(theSerialJob, 2, 16, (kFramesPerPacket * 45) + 777, 13);
+	theSerialJob.mQuality = 4;
+	ACFLACConcurrencyJob theAdaptiveJob(theSerialJob);
+	theAdaptiveJob.mEncodeThreadCount = inEncodeThreadCount;
+	theAdaptiveJob.mPacketsPerCall = 8;
+	theAdaptiveJob.mAdaptiveCPUBudget = inAdaptiveCPUBudget;
+	RunJob(&theSerialJob);
+	RunJob(&theAdaptiveJob);
+	
+	bool theAnswer = theSerialJob.mSucceeded && theAdaptiveJob.mSucceeded;
+	theAnswer = theAnswer && (theAdaptiveJob.mOutput == theAdaptiveJob.mInput);
+	theAnswer = theAnswer && (theAdaptiveJob.mPacketDescriptions.size() == theSerialJob.mPacketDescriptions.size());
+	for(UInt32 thePacket = 0; theAnswer && (thePacket < theAdaptiveJob.mPacketDescriptions.size()); ++thePacket)
+	{
+		theAnswer = (FrameNumber(theAdaptiveJob, thePacket) == thePacket);
+	}
+	theAnswer = theAnswer && (memcmp(StreamInfo(theAdaptiveJob).md5sum, StreamInfo(theSerialJob).md5sum, sizeof(StreamInfo(theSerialJob).md5sum)) == 0);
+	theAnswer = theAnswer && (StreamInfo(theAdaptiveJob).total_samples == StreamInfo(theSerialJob).total_samples);
+	if(inAdaptiveCPUBudget >= 1.0)
+	{
+		theAnswer = theAnswer && (theAdaptiveJob.mNumberLevelChanges == 0);
+		if(inEncodeThreadCount <= 1)
+		{
+			theAnswer = theAnswer && (theAdaptiveJob.mPackets == theSerialJob.mPackets);
+			theAnswer = theAnswer && (theAdaptiveJob.mMagicCookie == theSerialJob.mMagicCookie);
+		}
+	}
+	else
+	{
+		theAnswer = theAnswer && (theAdaptiveJob.mNumberLevelChanges == theSerialJob.mQuality);
+	}
+	
+	printf("%s: adaptive level on %lu threads, a budget of %g, %lu level changes\n", theAnswer ? "ok" : "FAILED", (unsigned long)inEncodeThreadCount, inAdaptiveCPUBudget, (unsigned long)theAdaptiveJob.mNumberLevelChanges);
+	return theAnswer;
+}
+
+int	main()
+{
+	static const UInt32 kNumberThreads[] = { 2, 4, 8, 12 };
+	static const UInt32 kDecodeThreadCounts[] = { 2, 4 };
+	static const UInt32 kEncodeThreadCounts[] = { 2, 3, 4 };
+	
+	bool theAnswer = true;
+	for(UInt32 theIndex = 0; theIndex < sizeof(kNumberThreads) / sizeof(kNumberThreads[0]); ++theIndex)
+	{
+		theAnswer = Run(kNumberThreads[theIndex], 1) && theAnswer;
+	}
+	for(UInt32 theIndex = 0; theIndex < sizeof(kDecodeThreadCounts) / sizeof(kDecodeThreadCounts[0]); ++theIndex)
+	{
+		theAnswer = Run(4, kDecodeThreadCounts[theIndex]) && theAnswer;
+		theAnswer = RunDamaged(kDecodeThreadCounts[theIndex], false) && theAnswer;
+		theAnswer = RunDamaged(kDecodeThreadCounts[theIndex], true) && theAnswer;
+	}
+	for(UInt32 theIndex = 0; theIndex < sizeof(kEncodeThreadCounts) / sizeof(kEncodeThreadCounts[0]); ++theIndex)
+	{
+		theAnswer = RunParallelEncode(kEncodeThreadCounts[theIndex], kPacketsPerCall) && theAnswer;
+		theAnswer = RunParallelEncode(kEncodeThreadCounts[theIndex], 16) && theAnswer;
+	}
+	theAnswer = RunAdaptiveEncode(1, 1000.0) && theAnswer;
+	theAnswer = RunAdaptiveEncode(1, 1.0e-9) && theAnswer;
+	theAnswer = RunAdaptiveEncode(3, 1.0e-9) && theAnswer;
+	
+	return theAnswer ? 0 : 1;
+}
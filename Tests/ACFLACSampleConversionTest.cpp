@@ -0,0 +1,208 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACFLACSampleConversionTest.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACFLACSampleConversion.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//=============================================================================
+//	ACFLACSampleConversionTest
+//
+//	Checks that the vector sample conversions the FLAC encoder feeds libFLAC
+//	with match the scalar ones bit for bit, for 16 and 24 bit input, every
+//	length that leaves a different tail after the vector loop, and input and
+//	output that start off a vector boundary. Nothing past the last sample may
+//	be written. The 24 bit values that need sign extending are also checked
+//	against their known values, so the scalar code is held to something too.
+//=============================================================================
+
+enum
+{
+	kMaxOffset		= 3,
+	kGuardSamples	= 4,
+	kGuardValue		= 0x5A5A5A5A
+};
+
+//	the lengths around every multiple of every vector width, plus a couple of packets
+static const UInt32 kNumberSamples[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 23, 24, 25, 31, 32, 33, 63, 64, 65, 1151, 1152, 4608 * 2 + 5 };
+
+//	where the edge values go, spread out so some land in the vector loop and some in the tail
+static UInt32	EdgePosition(UInt32 inEdge, UInt32 inNumberEdges, UInt32 inNumberSamples)
+{
+	return (inNumberSamples >= inNumberEdges) ? inEdge * (inNumberSamples / inNumberEdges) + (inNumberSamples % inNumberEdges) : inEdge;
+}
+
+static UInt32	NextRandom(UInt32& ioState)
+{
+	ioState = (ioState * 1664525) + 1013904223;
+	return ioState >> 8;
+}
+
+static bool	OutputMatches(const std::vector<SInt32>& inVector, const std::vector<SInt32>& inScalar, UInt32 inOffset, UInt32 inNumberSamples)
+{
+	if(memcmp(&inVector[inOffset], &inScalar[inOffset], inNumberSamples * sizeof(SInt32)) != 0)
+	{
+		return false;
+	}
+	for(UInt32 theSample = 0; theSample < kGuardSamples; ++theSample)
+	{
+		if((inVector[inOffset + inNumberSamples + theSample] != (SInt32)kGuardValue) || (inScalar[inOffset + inNumberSamples + theSample] != (SInt32)kGuardValue))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool	TestSInt16(UInt32 inNumberSamples, UInt32 inSeed)
+{
+	bool theAnswer = true;
+	UInt32 theState = inSeed;
+	
+	for(UInt32 theInputOffset = 0; theInputOffset <= kMaxOffset; ++theInputOffset)
+	{
+		std::vector<SInt16> theInputData(kMaxOffset + inNumberSamples + 1);
+		for(UInt32 theSample = 0; theSample < theInputData.size(); ++theSample)
+		{
+			theInputData[theSample] = (SInt16)NextRandom(theState);
+		}
+		//	both ends of the range, and the values either side of 0
+		static const SInt16 kEdgeValues[] = { -32768, 32767, -1, 0, 1, -32767 };
+		static const UInt32 kNumberEdges = sizeof(kEdgeValues) / sizeof(kEdgeValues[0]);
+		for(UInt32 theEdge = 0; (theEdge < kNumberEdges) && (theEdge < inNumberSamples); ++theEdge)
+		{
+			theInputData[theInputOffset + EdgePosition(theEdge, kNumberEdges, inNumberSamples)] = kEdgeValues[theEdge];
+		}
+		
+		for(UInt32 theOutputOffset = 0; theOutputOffset <= kMaxOffset; ++theOutputOffset)
+		{
+			std::vector<SInt32> theVectorOutput(kMaxOffset + inNumberSamples + kGuardSamples, kGuardValue);
+			std::vector<SInt32> theScalarOutput(theVectorOutput);
+			
+			ConvertSInt16ToSInt32(&theInputData[theInputOffset], &theVectorOutput[theOutputOffset], inNumberSamples);
+			ConvertSInt16ToSInt32Scalar(&theInputData[theInputOffset], &theScalarOutput[theOutputOffset], inNumberSamples);
+			theAnswer = OutputMatches(theVectorOutput, theScalarOutput, theOutputOffset, inNumberSamples) && theAnswer;
+		}
+	}
+	return theAnswer;
+}
+
+static bool	TestSInt24(UInt32 inNumberSamples, UInt32 inSeed)
+{
+	bool theAnswer = true;
+	UInt32 theState = inSeed;
+	
+	for(UInt32 theInputOffset = 0; theInputOffset <= kMaxOffset; ++theInputOffset)
+	{
+		//	the input starts theInputOffset bytes in, so most of the time it's not even sample aligned
+		std::vector<Byte> theInputData(kMaxOffset + 3 * inNumberSamples + 1);
+		for(UInt32 theByte = 0; theByte < theInputData.size(); ++theByte)
+		{
+			theInputData[theByte] = (Byte)NextRandom(theState);
+		}
+		static const SInt32 kEdgeValues[] = { -8388608, 8388607, -1, 0, 1, -8388607, -65536, -256 };
+		static const UInt32 kNumberEdges = sizeof(kEdgeValues) / sizeof(kEdgeValues[0]);
+		for(UInt32 theEdge = 0; (theEdge < kNumberEdges) && (theEdge < inNumberSamples); ++theEdge)
+		{
+			Byte * theBytes = &theInputData[theInputOffset + 3 * EdgePosition(theEdge, kNumberEdges, inNumberSamples)];
+		#if TARGET_RT_BIG_ENDIAN
+			theBytes[0] = (Byte)(kEdgeValues[theEdge] >> 16);
+			theBytes[1] = (Byte)(kEdgeValues[theEdge] >> 8);
+			theBytes[2] = (Byte)kEdgeValues[theEdge];
+		#else
+			theBytes[0] = (Byte)kEdgeValues[theEdge];
+			theBytes[1] = (Byte)(kEdgeValues[theEdge] >> 8);
+			theBytes[2] = (Byte)(kEdgeValues[theEdge] >> 16);
+		#endif
+		}
+		
+		for(UInt32 theOutputOffset = 0; theOutputOffset <= kMaxOffset; ++theOutputOffset)
+		{
+			std::vector<SInt32> theVectorOutput(kMaxOffset + inNumberSamples + kGuardSamples, kGuardValue);
+			std::vector<SInt32> theScalarOutput(theVectorOutput);
+			
+			ConvertSInt24ToSInt32(&theInputData[theInputOffset], &theVectorOutput[theOutputOffset], inNumberSamples);
+			ConvertSInt24ToSInt32Scalar(&theInputData[theInputOffset], &theScalarOutput[theOutputOffset], inNumberSamples);
+			theAnswer = OutputMatches(theVectorOutput, theScalarOutput, theOutputOffset, inNumberSamples) && theAnswer;
+			
+			for(UInt32 theEdge = 0; (theEdge < kNumberEdges) && (theEdge < inNumberSamples); ++theEdge)
+			{
+				theAnswer = (theScalarOutput[theOutputOffset + EdgePosition(theEdge, kNumberEdges, inNumberSamples)] == kEdgeValues[theEdge]) && theAnswer;
+			}
+		}
+	}
+	return theAnswer;
+}
+
+int	main()
+{
+#if defined(__AVX2__)
+	printf("vector code: AVX2\n");
+#elif defined(__SSSE3__)
+	printf("vector code: SSE2 for 16 bit, SSSE3 for 24 bit\n");
+#elif defined(__SSE2__)
+	printf("vector code: SSE2 for 16 bit, none for 24 bit\n");
+#elif defined(kFLACConvertNEON)
+	printf("vector code: NEON\n");
+#else
+	printf("vector code: none, both conversions are scalar\n");
+#endif
+	
+	bool theAnswer = true;
+	for(UInt32 theIndex = 0; theIndex < sizeof(kNumberSamples) / sizeof(kNumberSamples[0]); ++theIndex)
+	{
+		bool the16BitAnswer = TestSInt16(kNumberSamples[theIndex], theIndex + 1);
+		bool the24BitAnswer = TestSInt24(kNumberSamples[theIndex], theIndex + 1);
+		
+		printf("%s: 16 bit, %lu samples\n", the16BitAnswer ? "ok" : "FAILED", (unsigned long)kNumberSamples[theIndex]);
+		printf("%s: 24 bit, %lu samples\n", the24BitAnswer ? "ok" : "FAILED", (unsigned long)kNumberSamples[theIndex]);
+		theAnswer = theAnswer && the16BitAnswer && the24BitAnswer;
+	}
+	
+	return theAnswer ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACFLACSampleInterleavingTest.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACFLACSampleInterleaving.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//=============================================================================
+//	ACFLACSampleInterleavingTest
+//
+//	Checks that the kernels the FLAC decoder interleaves libFLAC's channels
+//	with match a plain scalar interleave byte for byte, for every channel
+//	count from 1 to 8, 16, 20, 24 and 32 bit output and float output, and
+//	every length that leaves a different tail after the 4 frame vector loop.
+//	The output starts a sample or more off a vector boundary too, and nothing
+//	either side of it may be written. The samples include the ends of each
+//	bit depth's range.
+//=============================================================================
+
+enum
+{
+	kMaxOutputOffset	= 3,		//	in samples
+	kGuardBytes			= 16,
+	kGuardValue			= 0x5A
+};
+
+//	the lengths around multiples of the vector width, plus a couple of packets
+static const UInt32 kNumberFrames[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 13, 15, 16, 17, 63, 64, 65, 1151, 1152, 4608 };
+
+static UInt32	NextRandom(UInt32& ioState)
+{
+	ioState = (ioState * 1664525) + 1013904223;
+	return ioState >> 8;
+}
+
+static UInt32	BytesPerSample(UInt32 inBitsPerSample, bool inFloat)
+{
+	if(inFloat)
+	{
+		return sizeof(Float32);
+	}
+	return (inBitsPerSample == 16) ? 2 : ((inBitsPerSample == 32) ? 4 : 3);
+}
+
+//	what the kernels have to match, one sample at a time in frame order
+static void	InterleaveScalar(const std::vector< std::vector<FLAC__int32> >& inChannels, UInt32 inNumberFrames, UInt32 inBitsPerSample, bool inFloat, Byte* outOutputData)
+{
+	UInt32 theNumberChannels = inChannels.size();
+	UInt32 theBytesPerSample = BytesPerSample(inBitsPerSample, inFloat);
+	for(UInt32 theFrame = 0; theFrame < inNumberFrames; ++theFrame)
+	{
+		for(UInt32 theChannel = 0; theChannel < theNumberChannels; ++theChannel)
+		{
+			FLAC__int32 theSample = inChannels[theChannel][theFrame];
+			Byte* theOutputData = outOutputData + ((theFrame * theNumberChannels) + theChannel) * theBytesPerSample;
+			if(inFloat)
+			{
+				Float32 theValue = (Float32)theSample / (Float32)(1UL << (inBitsPerSample - 1));
+				memcpy(theOutputData, &theValue, sizeof(theValue));
+			}
+			else if(inBitsPerSample == 16)
+			{
+				SInt16 theValue = (SInt16)theSample;
+				memcpy(theOutputData, &theValue, sizeof(theValue));
+			}
+			else if(inBitsPerSample == 32)
+			{
+				SInt32 theValue = theSample;
+				memcpy(theOutputData, &theValue, sizeof(theValue));
+			}
+			else
+			{
+				//	20 bit samples are aligned high in 3 bytes
+				UInt32 theValue = (UInt32)theSample << (24 - inBitsPerSample);
+			#if TARGET_RT_BIG_ENDIAN
+				theOutputData[0] = (Byte)(theValue >> 16);
+				theOutputData[1] = (Byte)(theValue >> 8);
+				theOutputData[2] = (Byte)theValue;
+			#else
+				theOutputData[0] = (Byte)theValue;
+				theOutputData[1] = (Byte)(theValue >> 8);
+				theOutputData[2] = (Byte)(theValue >> 16);
+			#endif
+			}
+		}
+	}
+}
+
+template <UInt32 kChannels>
+static bool	TestChannels(UInt32 inBitsPerSample, bool inFloat, UInt32 inSeed)
+{
+	bool theAnswer = true;
+	UInt32 theState = inSeed;
+	UInt32 theShift = 32 - inBitsPerSample;
+	SInt32 theMaximum = (SInt32)((1UL << (inBitsPerSample - 1)) - 1);
+	UInt32 theBytesPerSample = BytesPerSample(inBitsPerSample, inFloat);
+	UInt32 theBytesPerFrame = kChannels * theBytesPerSample;
+	
+	for(UInt32 theIndex = 0; theIndex < sizeof(kNumberFrames) / sizeof(kNumberFrames[0]); ++theIndex)
+	{
+		UInt32 theNumberFrames = kNumberFrames[theIndex];
+		
+		//	random samples sign extended from the bit depth, like libFLAC's
+		std::vector< std::vector<FLAC__int32> > theChannels(kChannels, std::vector<FLAC__int32>(theNumberFrames + 1));
+		const FLAC__int32* theBuffer[kChannels];
+		for(UInt32 theChannel = 0; theChannel < kChannels; ++theChannel)
+		{
+			for(UInt32 theFrame = 0; theFrame < theNumberFrames; ++theFrame)
+			{
+				UInt32 theRandom = (NextRandom(theState) << 16) ^ NextRandom(theState);
+				theChannels[theChannel][theFrame] = (SInt32)(theRandom << theShift) >> theShift;
+			}
+			
+			//	both ends of the range and the values either side of 0, in a different place in each channel
+			const SInt32 kEdgeValues[] = { -theMaximum - 1, theMaximum, -1, 0, 1 };
+			const UInt32 kNumberEdges = sizeof(kEdgeValues) / sizeof(kEdgeValues[0]);
+			for(UInt32 theEdge = 0; (theEdge < kNumberEdges) && (theEdge < theNumberFrames); ++theEdge)
+			{
+				theChannels[theChannel][(theEdge * 7 + theChannel) % theNumberFrames] = kEdgeValues[theEdge];
+			}
+			theBuffer[theChannel] = &theChannels[theChannel][0];
+		}
+		
+		for(UInt32 theOutputOffset = 0; theOutputOffset <= kMaxOutputOffset; ++theOutputOffset)
+		{
+			std::vector<Byte> theVectorOutput((kMaxOutputOffset * theBytesPerSample) + (theNumberFrames * theBytesPerFrame) + kGuardBytes, kGuardValue);
+			std::vector<Byte> theScalarOutput(theVectorOutput);
+			
+			InterleaveFrame<kChannels>(theBuffer, theNumberFrames, inBitsPerSample, inFloat, &theVectorOutput[theOutputOffset * theBytesPerSample]);
+			InterleaveScalar(theChannels, theNumberFrames, inBitsPerSample, inFloat, &theScalarOutput[theOutputOffset * theBytesPerSample]);
+			if(theVectorOutput != theScalarOutput)
+			{
+				printf("%lu frames at offset %lu don't match\n", (unsigned long)theNumberFrames, (unsigned long)theOutputOffset);
+				theAnswer = false;
+			}
+		}
+	}
+	return theAnswer;
+}
+
+static bool	Test(UInt32 inNumberChannels, UInt32 inBitsPerSample, bool inFloat, UInt32 inSeed)
+{
+	switch(inNumberChannels)
+	{
+		case 1:		return TestChannels<1>(inBitsPerSample, inFloat, inSeed);
+		case 2:		return TestChannels<2>(inBitsPerSample, inFloat, inSeed);
+		case 3:		return TestChannels<3>(inBitsPerSample, inFloat, inSeed);
+		case 4:		return TestChannels<4>(inBitsPerSample, inFloat, inSeed);
+		case 5:		return TestChannels<5>(inBitsPerSample, inFloat, inSeed);
+		case 6:		return TestChannels<6>(inBitsPerSample, inFloat, inSeed);
+		case 7:		return TestChannels<7>(inBitsPerSample, inFloat, inSeed);
+		default:	return TestChannels<8>(inBitsPerSample, inFloat, inSeed);
+	}
+}
+
+int	main()
+{
+#if defined(__SSSE3__)
+	printf("vector code: SSE2, SSSE3 for 20 and 24 bit\n");
+#elif defined(__SSE2__)
+	printf("vector code: SSE2, none for 20 and 24 bit\n");
+#else
+	printf("vector code: none, every interleave is scalar\n");
+#endif
+	
+	static const UInt32 kBitDepths[] = { 16, 20, 24, 32 };
+	
+	bool theAnswer = true;
+	for(UInt32 theNumberChannels = 1; theNumberChannels <= 8; ++theNumberChannels)
+	{
+		for(UInt32 theIndex = 0; theIndex < sizeof(kBitDepths) / sizeof(kBitDepths[0]); ++theIndex)
+		{
+			for(UInt32 theFloat = 0; theFloat < 2; ++theFloat)
+			{
+				bool theFormatAnswer = Test(theNumberChannels, kBitDepths[theIndex], theFloat != 0, (theNumberChannels * 8) + (theIndex * 2) + theFloat);
+				printf("%s: %lu channels, %lu bit%s\n", theFormatAnswer ? "ok" : "FAILED", (unsigned long)theNumberChannels, (unsigned long)kBitDepths[theIndex], (theFloat != 0) ? " to float" : "");
+				theAnswer = theAnswer && theFormatAnswer;
+			}
+		}
+	}
+	
+	return theAnswer ? 0 : 1;
+}
@@ -0,0 +1,372 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACFLACStreamInputTest.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACFLACEncoder.h"
+#include "ACFLACDecoder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//=============================================================================
+//	ACFLACStreamInputTest
+//
+//	Checks how the FLAC decoder finds frames in stream input
+//	(kFLACDecoderPropertyStreamInput), where the packets arrive as plain bytes
+//	in chunks of any size. An encoded stream is fed in whole and in chunks from
+//	a byte up, and has to decode to the input exactly without a desync. Then
+//	the stream is damaged: junk in front of it, with and without copies of a
+//	real frame header in it whose CRC-8 checks out, frames with a byte flipped
+//	so their CRC-16 doesn't, and a fake header between two frames. Only the
+//	damaged frames may go missing from the PCM, and every kind of damage has
+//	to show up in kFLACDecoderPropertyDesyncCount.
+//=============================================================================
+
+enum
+{
+	kFramesPerPacket	= 4608,
+	kNumberPackets		= 24,
+	kPacketsPerCall		= 4
+};
+
+struct ACFLACEncodedStream
+{
+	UInt32								mNumberChannels;
+	UInt32								mBitDepth;
+	std::vector<Byte>					mInput;
+	std::vector<Byte>					mPackets;
+	std::vector<AudioStreamPacketDescription>	mPacketDescriptions;
+	std::vector<Byte>					mMagicCookie;
+};
+
+static AudioStreamBasicDescription	MakePCMFormat(UInt32 inNumberChannels, UInt32 inBitDepth)
+{
+	AudioStreamBasicDescription theFormat;
+	memset(&theFormat, 0, sizeof(theFormat));
+	theFormat.mSampleRate = 44100.0;
+	theFormat.mFormatID = kAudioFormatLinearPCM;
+	theFormat.mFormatFlags = kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+	theFormat.mBytesPerFrame = inNumberChannels * (inBitDepth / 8);
+	theFormat.mBytesPerPacket = theFormat.mBytesPerFrame;
+	theFormat.mFramesPerPacket = 1;
+	theFormat.mChannelsPerFrame = inNumberChannels;
+	theFormat.mBitsPerChannel = inBitDepth;
+	return theFormat;
+}
+
+static AudioStreamBasicDescription	MakeFLACFormat(UInt32 inNumberChannels, UInt32 inBitDepth)
+{
+	AudioStreamBasicDescription theFormat;
+	memset(&theFormat, 0, sizeof(theFormat));
+	theFormat.mSampleRate = 44100.0;
+	theFormat.mFormatID = kAudioFormatFLAC;
+	theFormat.mFormatFlags = (inBitDepth == 16) ? kFLACFormatFlag_16BitSourceData : kFLACFormatFlag_24BitSourceData;
+	theFormat.mFramesPerPacket = kFramesPerPacket;
+	theFormat.mChannelsPerFrame = inNumberChannels;
+	return theFormat;
+}
+
+static UInt32	NextRandom(UInt32& ioState)
+{
+	ioState = (ioState * 1664525) + 1013904223;
+	return ioState >> 8;
+}
+
+//	a slow ramp with some noise on it, every packet full
+static bool	Encode(ACFLACEncodedStream& ioStream, UInt32 inSeed)
+{
+	UInt32 theState = inSeed;
+	UInt32 theBytesPerSample = ioStream.mBitDepth / 8;
+	UInt32 theNumberSamples = kNumberPackets * kFramesPerPacket * ioStream.mNumberChannels;
+	ioStream.mInput.resize(theNumberSamples * theBytesPerSample);
+	for(UInt32 theSample = 0; theSample < theNumberSamples; ++theSample)
+	{
+		SInt32 theValue = (SInt32)((theSample / ioStream.mNumberChannels) * (theSample % ioStream.mNumberChannels + 1) * 29) + (SInt32)(NextRandom(theState) & 0xFF) - 128;
+		theValue = (theValue << (32 - ioStream.mBitDepth)) >> (32 - ioStream.mBitDepth);
+		for(UInt32 theByte = 0; theByte < theBytesPerSample; ++theByte)
+		{
+		#if TARGET_RT_BIG_ENDIAN
+			ioStream.mInput[(theSample * theBytesPerSample) + theByte] = (Byte)(theValue >> (8 * (theBytesPerSample - 1 - theByte)));
+		#else
+			ioStream.mInput[(theSample * theBytesPerSample) + theByte] = (Byte)(theValue >> (8 * theByte));
+		#endif
+		}
+	}
+	
+	ACFLACEncoder theEncoder(kAudioFormatFLAC);
+	AudioStreamBasicDescription theInputFormat = MakePCMFormat(ioStream.mNumberChannels, ioStream.mBitDepth);
+	AudioStreamBasicDescription theOutputFormat = MakeFLACFormat(ioStream.mNumberChannels, ioStream.mBitDepth);
+	theEncoder.Initialize(&theInputFormat, &theOutputFormat, NULL, 0);
+	
+	UInt32 theMaximumPacketByteSize = 0;
+	UInt32 thePropertySize = sizeof(theMaximumPacketByteSize);
+	theEncoder.GetProperty(kAudioCodecPropertyMaximumPacketByteSize, thePropertySize, &theMaximumPacketByteSize);
+	std::vector<Byte> theOutputBuffer(theMaximumPacketByteSize);
+	AudioStreamPacketDescription theOutputDescription;
+	
+	UInt32 theInputPosition = 0;
+	bool theInputIsFlushed = false;
+	UInt32 theStatus = kAudioCodecProduceOutputPacketSuccess;
+	while(theStatus != kAudioCodecProduceOutputPacketAtEOF)
+	{
+		if(theInputPosition < ioStream.mInput.size())
+		{
+			UInt32 theByteSize = kFramesPerPacket * theInputFormat.mBytesPerFrame;
+			UInt32 theNumberPackets = kFramesPerPacket;
+			theEncoder.AppendInputData(&ioStream.mInput[theInputPosition], theByteSize, theNumberPackets, NULL);
+			theInputPosition += theByteSize;
+		}
+		else if(!theInputIsFlushed)
+		{
+			UInt32 theByteSize = 0;
+			UInt32 theNumberPackets = 0;
+			theEncoder.AppendInputData(&ioStream.mInput[0], theByteSize, theNumberPackets, NULL);
+			theInputIsFlushed = true;
+		}
+		
+		UInt32 theByteSize = theOutputBuffer.size();
+		UInt32 theNumberPackets = 1;
+		theStatus = theEncoder.ProduceOutputPackets(&theOutputBuffer[0], theByteSize, theNumberPackets, &theOutputDescription);
+		if(theStatus == kAudioCodecProduceOutputPacketFailure)
+		{
+			return false;
+		}
+		if(theNumberPackets == 1)
+		{
+			const Byte* thePacketData = &theOutputBuffer[theOutputDescription.mStartOffset];
+			theOutputDescription.mStartOffset = ioStream.mPackets.size();
+			ioStream.mPackets.insert(ioStream.mPackets.end(), thePacketData, thePacketData + theOutputDescription.mDataByteSize);
+			ioStream.mPacketDescriptions.push_back(theOutputDescription);
+		}
+	}
+	
+	UInt32 theCookieByteSize = theEncoder.GetMagicCookieByteSize();
+	ioStream.mMagicCookie.resize(theCookieByteSize);
+	theEncoder.GetMagicCookie(&ioStream.mMagicCookie[0], theCookieByteSize);
+	return ioStream.mPacketDescriptions.size() == kNumberPackets;
+}
+
+//	Feeds inStreamData to a stream input decoder inChunkByteSize bytes at a time, or in random
+//	chunks of up to 5000 bytes when it's 0, and collects the PCM
+static bool	DecodeStream(const ACFLACEncodedStream& inStream, const std::vector<Byte>& inStreamData, UInt32 inChunkByteSize, UInt32 inSeed, std::vector<Byte>& outOutput, UInt32& outDesyncCount)
+{
+	ACFLACDecoder theDecoder(kAudioFormatFLAC);
+	AudioStreamBasicDescription theInputFormat = MakeFLACFormat(inStream.mNumberChannels, inStream.mBitDepth);
+	AudioStreamBasicDescription theOutputFormat = MakePCMFormat(inStream.mNumberChannels, inStream.mBitDepth);
+	UInt32 theStreamInput = 1;
+	theDecoder.SetProperty(kFLACDecoderPropertyStreamInput, sizeof(theStreamInput), &theStreamInput);
+	theDecoder.Initialize(&theInputFormat, &theOutputFormat, &inStream.mMagicCookie[0], inStream.mMagicCookie.size());
+	
+	std::vector<Byte> theOutputBuffer(kFramesPerPacket * theOutputFormat.mBytesPerFrame * kPacketsPerCall);
+	UInt32 theState = inSeed;
+	UInt32 thePosition = 0;
+	bool theStreamIsFinished = false;
+	UInt32 theNumberIdleCalls = 0;
+	outOutput.clear();
+	while(theNumberIdleCalls < 2)
+	{
+		UInt32 theByteSize = 0;
+		if(thePosition < inStreamData.size())
+		{
+			theByteSize = (inChunkByteSize != 0) ? inChunkByteSize : 1 + (NextRandom(theState) % 5000);
+			if(theByteSize > inStreamData.size() - thePosition)
+			{
+				theByteSize = inStreamData.size() - thePosition;
+			}
+			UInt32 theNumberPackets = 0;
+			theDecoder.AppendInputData(&inStreamData[thePosition], theByteSize, theNumberPackets, NULL);
+			thePosition += theByteSize;
+		}
+		else if(!theStreamIsFinished)
+		{
+			//	no more to come, so the last frame can go
+			UInt32 theNumberPackets = 0;
+			theDecoder.AppendInputData(&inStreamData[0], theByteSize, theNumberPackets, NULL);
+			theStreamIsFinished = true;
+		}
+		
+		UInt32 theOutputByteSize = theOutputBuffer.size();
+		UInt32 theNumberFrames = kFramesPerPacket * kPacketsPerCall;
+		UInt32 theStatus = theDecoder.ProduceOutputPackets(&theOutputBuffer[0], theOutputByteSize, theNumberFrames, NULL);
+		if(theStatus == kAudioCodecProduceOutputPacketFailure)
+		{
+			printf("decode failure %lu bytes into the stream\n", (unsigned long)thePosition);
+			return false;
+		}
+		outOutput.insert(outOutput.end(), theOutputBuffer.begin(), theOutputBuffer.begin() + theOutputByteSize);
+		
+		//	once everything's in, keep going until the decoder has nothing left to give
+		theNumberIdleCalls = (theStreamIsFinished && (theByteSize == 0) && (theOutputByteSize == 0)) ? theNumberIdleCalls + 1 : 0;
+	}
+	
+	UInt32 thePropertySize = sizeof(outDesyncCount);
+	theDecoder.GetProperty(kFLACDecoderPropertyDesyncCount, thePropertySize, &outDesyncCount);
+	return true;
+}
+
+//	the input with the PCM of the packets in inMissingPackets taken out
+static std::vector<Byte>	ExpectedOutput(const ACFLACEncodedStream& inStream, const std::vector<UInt32>& inMissingPackets)
+{
+	UInt32 thePacketByteSize = kFramesPerPacket * inStream.mNumberChannels * (inStream.mBitDepth / 8);
+	std::vector<Byte> theOutput;
+	for(UInt32 thePacket = 0; thePacket < kNumberPackets; ++thePacket)
+	{
+		bool theIsMissing = false;
+		for(UInt32 theIndex = 0; theIndex < inMissingPackets.size(); ++theIndex)
+		{
+			theIsMissing = theIsMissing || (inMissingPackets[theIndex] == thePacket);
+		}
+		if(!theIsMissing)
+		{
+			theOutput.insert(theOutput.end(), inStream.mInput.begin() + (thePacket * thePacketByteSize), inStream.mInput.begin() + ((thePacket + 1) * thePacketByteSize));
+		}
+	}
+	return theOutput;
+}
+
+static bool	Check(const char* inDescription, const ACFLACEncodedStream& inStream, const std::vector<Byte>& inStreamData, UInt32 inChunkByteSize, const std::vector<UInt32>& inMissingPackets, bool inDesyncExpected)
+{
+	std::vector<Byte> theOutput;
+	UInt32 theDesyncCount = 0;
+	bool theAnswer = DecodeStream(inStream, inStreamData, inChunkByteSize, inChunkByteSize + 1, theOutput, theDesyncCount);
+	theAnswer = theAnswer && (theOutput == ExpectedOutput(inStream, inMissingPackets));
+	theAnswer = theAnswer && (inDesyncExpected ? (theDesyncCount >= inMissingPackets.size()) && (theDesyncCount > 0) : (theDesyncCount == 0));
+	
+	char theChunks[32];
+	if(inChunkByteSize == 0)
+	{
+		strcpy(theChunks, "random chunks");
+	}
+	else if(inChunkByteSize >= inStreamData.size())
+	{
+		strcpy(theChunks, "all at once");
+	}
+	else
+	{
+		snprintf(theChunks, sizeof(theChunks), "%lu byte chunks", (unsigned long)inChunkByteSize);
+	}
+	printf("%s: %lu channels, %lu bits, %s, %s, %lu desyncs\n", theAnswer ? "ok" : "FAILED", (unsigned long)inStream.mNumberChannels, (unsigned long)inStream.mBitDepth, inDescription, theChunks, (unsigned long)theDesyncCount);
+	return theAnswer;
+}
+
+static bool	Test(UInt32 inNumberChannels, UInt32 inBitDepth)
+{
+	ACFLACEncodedStream theStream;
+	theStream.mNumberChannels = inNumberChannels;
+	theStream.mBitDepth = inBitDepth;
+	if(!Encode(theStream, inNumberChannels))
+	{
+		printf("FAILED: couldn't encode %lu channels, %lu bits\n", (unsigned long)inNumberChannels, (unsigned long)inBitDepth);
+		return false;
+	}
+	const std::vector<Byte>& thePackets = theStream.mPackets;
+	const std::vector<AudioStreamPacketDescription>& theDescriptions = theStream.mPacketDescriptions;
+	std::vector<UInt32> theNoPackets;
+	UInt32 theState = inNumberChannels;
+	bool theAnswer = true;
+	
+	//	the whole stream, a byte at a time, in odd sized and random chunks, and all at once
+	static const UInt32 kChunkByteSizes[] = { 1, 7, 1000, 4099, 0, 0xFFFFFFFF };
+	for(UInt32 theIndex = 0; theIndex < sizeof(kChunkByteSizes) / sizeof(kChunkByteSizes[0]); ++theIndex)
+	{
+		theAnswer = Check("whole stream", theStream, thePackets, kChunkByteSizes[theIndex], theNoPackets, false) && theAnswer;
+	}
+	
+	//	junk in front of the first frame, plain and then with sync codes and copies of the first
+	//	frame's header and what follows it, CRC-8 and all, none of which lead anywhere
+	std::vector<Byte> theJunk(3000);
+	for(UInt32 theByte = 0; theByte < theJunk.size(); ++theByte)
+	{
+		theJunk[theByte] = NextRandom(theState);
+	}
+	std::vector<Byte> theStreamData(theJunk);
+	theStreamData.insert(theStreamData.end(), thePackets.begin(), thePackets.end());
+	theAnswer = Check("leading junk", theStream, theStreamData, 0, theNoPackets, true) && theAnswer;
+	
+	for(UInt32 theByte = 0; theByte + 64 < theJunk.size(); theByte += 500)
+	{
+		memcpy(&theJunk[theByte], &thePackets[0], 32);
+		theJunk[theByte + 250] = 0xFF;
+		theJunk[theByte + 251] = 0xF8;
+	}
+	theStreamData.assign(theJunk.begin(), theJunk.end());
+	theStreamData.insert(theStreamData.end(), thePackets.begin(), thePackets.end());
+	theAnswer = Check("leading junk with false headers", theStream, theStreamData, 0, theNoPackets, true) && theAnswer;
+	theAnswer = Check("leading junk with false headers", theStream, theStreamData, 1, theNoPackets, true) && theAnswer;
+	
+	//	a byte flipped in the middle of a few frames, the last one included, so their CRC-16 fails
+	std::vector<UInt32> theDamagedPackets;
+	theDamagedPackets.push_back(3);
+	theDamagedPackets.push_back(4);
+	theDamagedPackets.push_back(15);
+	theDamagedPackets.push_back(kNumberPackets - 1);
+	theStreamData.assign(thePackets.begin(), thePackets.end());
+	for(UInt32 theIndex = 0; theIndex < theDamagedPackets.size(); ++theIndex)
+	{
+		const AudioStreamPacketDescription& theDescription = theDescriptions[theDamagedPackets[theIndex]];
+		theStreamData[theDescription.mStartOffset + (theDescription.mDataByteSize / 2)] ^= 0x5A;
+	}
+	theAnswer = Check("damaged frames", theStream, theStreamData, 0, theDamagedPackets, true) && theAnswer;
+	theAnswer = Check("damaged frames", theStream, theStreamData, 7, theDamagedPackets, true) && theAnswer;
+	
+	//	a copy of a real frame header with a bit of junk after it, between two frames
+	const AudioStreamPacketDescription& theSplitPacket = theDescriptions[10];
+	theStreamData.assign(thePackets.begin(), thePackets.begin() + theSplitPacket.mStartOffset);
+	theStreamData.insert(theStreamData.end(), thePackets.begin(), thePackets.begin() + 40);
+	theStreamData.insert(theStreamData.end(), thePackets.begin() + theSplitPacket.mStartOffset, thePackets.end());
+	theAnswer = Check("a false header between frames", theStream, theStreamData, 0, theNoPackets, true) && theAnswer;
+	theAnswer = Check("a false header between frames", theStream, theStreamData, 13, theNoPackets, true) && theAnswer;
+	
+	return theAnswer;
+}
+
+int	main()
+{
+	bool theAnswer = Test(2, 16);
+	theAnswer = Test(6, 24) && theAnswer;
+	
+	return theAnswer ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+/*	Copyright: 	 Copyright 2003 Apple Computer, Inc. All rights reserved.
+
+	Disclaimer:	IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc.
+			("Apple") in consideration of your agreement to the following terms, and your
+			use, installation, modification or redistribution of this Apple software
+			constitutes acceptance of these terms.  If you do not agree with these terms,
+			please do not use, install, modify or redistribute this Apple software.
+
+			In consideration of your agreement to abide by the following terms, and subject
+			to these terms, Apple grants you a personal, non-exclusive license, under Apples
+			copyrights in this original Apple software (the "Apple Software"), to use,
+			reproduce, modify and redistribute the Apple Software, with or without
+			modifications, in source and/or binary forms; provided that if you redistribute
+			the Apple Software in its entirety and without modifications, you must retain
+			this notice and the following text and disclaimers in all such redistributions of
+			the Apple Software.  Neither the name, trademarks, service marks or logos of
+			Apple Computer, Inc. may be used to endorse or promote products derived from the
+			Apple Software without specific prior written permission from Apple.  Except as
+			expressly stated in this notice, no other rights or licenses, express or implied,
+			are granted by Apple herein, including but not limited to any patent rights that
+			may be infringed by your derivative works or by other works in which the Apple
+			Software may be incorporated.
+
+			The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO
+			WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED
+			WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+			PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN
+			COMBINATION WITH YOUR PRODUCTS.
+
+			IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR
+			CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+			GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+			ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION
+			OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT
+			(INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN
+			ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*=============================================================================
+	ACSimpleCodecPacketQueueTest.cpp
+
+=============================================================================*/
+
+//=============================================================================
+//	Includes
+//=============================================================================
+
+#include "ACSimpleCodec.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//=============================================================================
+//	ACSimpleCodecPacketQueueTest
+//
+//	Checks ACSimpleCodec's queue of VBR packets with a codec that hands every
+//	queued packet straight back out. Packets of random sizes are appended many
+//	at a time from a buffer with gaps between them, into an input buffer small
+//	enough that appends stop short and the ring wraps, and have to come back
+//	out whole, in order and byte for byte. Partly consumed packets, appends
+//	without packet descriptions and Reset are checked on their own.
+//=============================================================================
+
+enum
+{
+	kInputBufferByteSize	= 1000,
+	kMaxPacketByteSize		= 300,
+	kNumberPackets			= 5000
+};
+
+class PacketCopier
+:
+	public ACSimpleCodec
+{
+
+public:
+						PacketCopier(bool inUseMirroredInputBuffer) : ACSimpleCodec(kInputBufferByteSize, inUseMirroredInputBuffer) {}
+	
+	virtual void		Initialize(const AudioStreamBasicDescription* inInputFormat, const AudioStreamBasicDescription* inOutputFormat, const void* inMagicCookie, UInt32 inMagicCookieByteSize)
+	{
+		SetCurrentInputFormat(*inInputFormat);
+		SetCurrentOutputFormat(*inOutputFormat);
+		ACSimpleCodec::Initialize(inInputFormat, inOutputFormat, inMagicCookie, inMagicCookieByteSize);
+	}
+	
+	//	one queued packet in, the same packet out
+	virtual UInt32		ProduceOutputPackets(void* outOutputData, UInt32& ioOutputDataByteSize, UInt32& ioNumberPackets, AudioStreamPacketDescription* outPacketDescription)
+	{
+		Byte* theOutputData = static_cast<Byte*>(outOutputData);
+		UInt32 theOutputByteSize = 0;
+		UInt32 theNumberPackets = 0;
+		while((theNumberPackets < ioNumberPackets) && (GetNumberQueuedPackets() > 0) && (theOutputByteSize + GetQueuedPacketByteSize(0) <= ioOutputDataByteSize))
+		{
+			UInt32 thePacketByteSize = GetQueuedPacketByteSize(0);
+			memcpy(theOutputData + theOutputByteSize, GetBytes(thePacketByteSize), thePacketByteSize);
+			outPacketDescription[theNumberPackets].mStartOffset = theOutputByteSize;
+			outPacketDescription[theNumberPackets].mVariableFramesInPacket = 0;
+			outPacketDescription[theNumberPackets].mDataByteSize = thePacketByteSize;
+			ConsumeInputPacket();
+			theOutputByteSize += thePacketByteSize;
+			++theNumberPackets;
+		}
+		UInt32 theAnswer = (theNumberPackets < ioNumberPackets) ? kAudioCodecProduceOutputPacketNeedsMoreInputData : kAudioCodecProduceOutputPacketSuccess;
+		ioOutputDataByteSize = theOutputByteSize;
+		ioNumberPackets = theNumberPackets;
+		return theAnswer;
+	}
+	
+	using ACSimpleCodec::ConsumeInputData;
+	using ACSimpleCodec::GetNumberQueuedPackets;
+	using ACSimpleCodec::GetQueuedPacketByteSize;
+
+};
+
+static void	InitializeCodec(PacketCopier& ioCodec)
+{
+	//	a made up VBR format, the queue only cares that mBytesPerPacket is 0
+	AudioStreamBasicDescription theFormat;
+	memset(&theFormat, 0, sizeof(theFormat));
+	theFormat.mSampleRate = 44100;
+	theFormat.mFormatID = 'vbrt';
+	theFormat.mFramesPerPacket = 1;
+	theFormat.mChannelsPerFrame = 1;
+	ioCodec.Initialize(&theFormat, &theFormat, NULL, 0);
+}
+
+static bool	TestPacketStream(bool inUseMirroredInputBuffer)
+{
+	//	the packets, with a gap of up to 3 bytes before each one
+	std::vector<Byte> theInputData;
+	std::vector<AudioStreamPacketDescription> thePackets(kNumberPackets);
+	for(UInt32 thePacket = 0; thePacket < kNumberPackets; ++thePacket)
+	{
+		theInputData.resize(theInputData.size() + (rand() % 4), 0xEE);
+		thePackets[thePacket].mStartOffset = theInputData.size();
+		thePackets[thePacket].mVariableFramesInPacket = 0;
+		thePackets[thePacket].mDataByteSize = 1 + (rand() % kMaxPacketByteSize);
+		for(UInt32 theByte = 0; theByte < thePackets[thePacket].mDataByteSize; ++theByte)
+		{
+			theInputData.push_back(rand());
+		}
+	}
+	
+	PacketCopier theCodec(inUseMirroredInputBuffer);
+	InitializeCodec(theCodec);
+	
+	UInt32 theNextInputPacket = 0;
+	UInt32 theNextOutputPacket = 0;
+	UInt32 theNumberErrors = 0;
+	std::vector<Byte> theOutputData(10 * kMaxPacketByteSize);
+	std::vector<AudioStreamPacketDescription> theOutputPackets(10);
+	while((theNextOutputPacket < kNumberPackets) && (theNumberErrors == 0))
+	{
+		//	up to 20 packets at a time, described relative to the first one's gap
+		if(theNextInputPacket < kNumberPackets)
+		{
+			UInt32 theNumberPackets = 1 + (rand() % 20);
+			if(theNumberPackets > kNumberPackets - theNextInputPacket)
+			{
+				theNumberPackets = kNumberPackets - theNextInputPacket;
+			}
+			UInt32 theBase = (theNextInputPacket == 0) ? 0 : static_cast<UInt32>(thePackets[theNextInputPacket - 1].mStartOffset + thePackets[theNextInputPacket - 1].mDataByteSize);
+			UInt32 theEnd = static_cast<UInt32>(thePackets[theNextInputPacket + theNumberPackets - 1].mStartOffset + thePackets[theNextInputPacket + theNumberPackets - 1].mDataByteSize);
+			std::vector<AudioStreamPacketDescription> theDescriptions(&thePackets[theNextInputPacket], &thePackets[theNextInputPacket] + theNumberPackets);
+			for(UInt32 thePacket = 0; thePacket < theNumberPackets; ++thePacket)
+			{
+				theDescriptions[thePacket].mStartOffset -= theBase;
+			}
+			
+			UInt32 theAvailableByteSize = theCodec.GetInputBufferByteSize() - theCodec.GetUsedInputBufferByteSize();
+			UInt32 theInputByteSize = theEnd - theBase;
+			UInt32 theNumberAppendedPackets = theNumberPackets;
+			theCodec.AppendInputData(&theInputData[theBase], theInputByteSize, theNumberAppendedPackets, &theDescriptions[0]);
+			
+			//	whole packets only, for as long as they fit, and the byte count
+			//	runs to the end of the last one taken
+			UInt32 theExpectedPackets = 0;
+			UInt32 theExpectedByteSize = 0;
+			while((theExpectedPackets < theNumberPackets) && (theDescriptions[theExpectedPackets].mDataByteSize <= theAvailableByteSize))
+			{
+				theAvailableByteSize -= theDescriptions[theExpectedPackets].mDataByteSize;
+				theExpectedByteSize = static_cast<UInt32>(theDescriptions[theExpectedPackets].mStartOffset + theDescriptions[theExpectedPackets].mDataByteSize);
+				++theExpectedPackets;
+			}
+			if((theNumberAppendedPackets != theExpectedPackets) || (theInputByteSize != theExpectedByteSize))
+			{
+				printf("packet %lu: appended %lu packets, %lu bytes, expected %lu packets, %lu bytes\n", (unsigned long)theNextInputPacket, (unsigned long)theNumberAppendedPackets, (unsigned long)theInputByteSize, (unsigned long)theExpectedPackets, (unsigned long)theExpectedByteSize);
+				++theNumberErrors;
+			}
+			theNextInputPacket += theNumberAppendedPackets;
+		}
+		
+		//	and up to 10 back out
+		UInt32 theOutputByteSize = theOutputData.size();
+		UInt32 theNumberPackets = 1 + (rand() % 10);
+		theCodec.ProduceOutputPackets(&theOutputData[0], theOutputByteSize, theNumberPackets, &theOutputPackets[0]);
+		for(UInt32 thePacket = 0; thePacket < theNumberPackets; ++thePacket, ++theNextOutputPacket)
+		{
+			const AudioStreamPacketDescription& theExpectedPacket = thePackets[theNextOutputPacket];
+			if((theOutputPackets[thePacket].mDataByteSize != theExpectedPacket.mDataByteSize) || (memcmp(&theOutputData[theOutputPackets[thePacket].mStartOffset], &theInputData[theExpectedPacket.mStartOffset], theExpectedPacket.mDataByteSize) != 0))
+			{
+				printf("packet %lu doesn't match\n", (unsigned long)theNextOutputPacket);
+				++theNumberErrors;
+			}
+		}
+	}
+	
+	bool theAnswer = (theNumberErrors == 0) && (theCodec.GetUsedInputBufferByteSize() == 0) && (theCodec.GetNumberQueuedPackets() == 0);
+	printf("%s: %lu packets through a %s input buffer\n", theAnswer ? "ok" : "FAILED", (unsigned long)theNextOutputPacket, inUseMirroredInputBuffer ? "mirrored" : "plain");
+	return theAnswer;
+}
+
+static bool	TestPartialConsume()
+{
+	PacketCopier theCodec(false);
+	InitializeCodec(theCodec);
+	
+	Byte theInputData[60];
+	AudioStreamPacketDescription thePackets[3] = { { 0, 0, 10 }, { 10, 0, 20 }, { 30, 0, 30 } };
+	UInt32 theInputByteSize = sizeof(theInputData);
+	UInt32 theNumberPackets = 3;
+	theCodec.AppendInputData(theInputData, theInputByteSize, theNumberPackets, thePackets);
+	
+	//	part of the first packet, then the rest of it and part of the second
+	bool theAnswer = (theNumberPackets == 3) && (theInputByteSize == 60);
+	theCodec.ConsumeInputData(4);
+	theAnswer = theAnswer && (theCodec.GetNumberQueuedPackets() == 3) && (theCodec.GetQueuedPacketByteSize(0) == 6);
+	theCodec.ConsumeInputData(11);
+	theAnswer = theAnswer && (theCodec.GetNumberQueuedPackets() == 2) && (theCodec.GetQueuedPacketByteSize(0) == 15) && (theCodec.GetQueuedPacketByteSize(1) == 30);
+	
+	//	Reset empties the queue along with the buffer
+	theCodec.Reset();
+	theAnswer = theAnswer && (theCodec.GetNumberQueuedPackets() == 0) && (theCodec.GetUsedInputBufferByteSize() == 0);
+	
+	printf("%s: partly consumed packets\n", theAnswer ? "ok" : "FAILED");
+	return theAnswer;
+}
+
+static bool	TestNoPacketDescriptions()
+{
+	PacketCopier theCodec(false);
+	InitializeCodec(theCodec);
+	
+	//	without descriptions the data goes in as one packet, if it fits
+	std::vector<Byte> theInputData(kInputBufferByteSize + 1);
+	UInt32 theInputByteSize = theInputData.size();
+	UInt32 theNumberPackets = 1;
+	theCodec.AppendInputData(&theInputData[0], theInputByteSize, theNumberPackets, NULL);
+	bool theAnswer = (theNumberPackets == 0) && (theInputByteSize == 0) && (theCodec.GetNumberQueuedPackets() == 0);
+	
+	theInputByteSize = 100;
+	theNumberPackets = 1;
+	theCodec.AppendInputData(&theInputData[0], theInputByteSize, theNumberPackets, NULL);
+	theAnswer = theAnswer && (theNumberPackets == 1) && (theInputByteSize == 100) && (theCodec.GetNumberQueuedPackets() == 1) && (theCodec.GetQueuedPacketByteSize(0) == 100);
+	
+	printf("%s: appends without packet descriptions\n", theAnswer ? "ok" : "FAILED");
+	return theAnswer;
+}
+
+int	main()
+{
+	srand(1);
+	bool theAnswer = TestPacketStream(false);
+	theAnswer = TestPacketStream(true) && theAnswer;
+	theAnswer = TestPartialConsume() && theAnswer;
+	theAnswer = TestNoPacketDescriptions() && theAnswer;
+	
+	return theAnswer ? 0 : 1;
+}